@@ -0,0 +1,66 @@
+/**
+ * @file
+ *
+ * This file contains the arena implementation.
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include "arena.h"
+
+/** Alignment of every allocation */
+#define ALIGNMENT 8
+
+namespace fusenet {
+
+  Arena::Arena(size_t chunkSize) :
+    current(NULL), remaining(0), chunkSize(chunkSize), used(0) {
+    // Does nothing
+  }
+
+  void* Arena::allocate(size_t size) {
+    char* memory;
+
+    size = (size + ALIGNMENT - 1) & ~static_cast<size_t>(ALIGNMENT - 1);
+    used += size;
+
+    if (size > chunkSize / 4) {
+      memory = static_cast<char*>(malloc(size));
+
+      if (memory == NULL) {
+	throw std::bad_alloc();
+      }
+
+      chunks.push_back(memory);
+      return memory;
+    }
+
+    if (size > remaining) {
+      current = static_cast<char*>(malloc(chunkSize));
+
+      if (current == NULL) {
+	remaining = 0;
+	throw std::bad_alloc();
+      }
+
+      chunks.push_back(current);
+      remaining = chunkSize;
+    }
+
+    memory = current;
+    current += size;
+    remaining -= size;
+    return memory;
+  }
+
+  size_t Arena::allocated(void) const {
+    return used;
+  }
+
+  Arena::~Arena(void) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+      free(chunks[i]);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/**
+ * @file
+ *
+ * This file contains the arena interface.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "shared.h"
+
+namespace fusenet {
+
+  /**
+   * Arena allocator. Hands out memory from large chunks by bumping a
+   * pointer. Nothing is ever freed on its own; all memory goes back
+   * at once when the arena is destroyed, which takes one free() per
+   * chunk no matter how many allocations were made.
+   *
+   * Allocations larger than a quarter of a chunk get a chunk of
+   * their own, so that a big allocation does not waste the rest of
+   * the current chunk.
+   *
+   * The arena is reference counted, so that whoever points into it
+   * can keep it alive after its creator is done with it.
+   */
+  class Arena : public Shared {
+
+  public:
+
+    /**
+     * Create an empty arena. No memory is allocated until the first
+     * call to allocate().
+     *
+     * @param chunkSize the size of each chunk
+     */
+    Arena(size_t chunkSize = 64 * 1024);
+
+    /**
+     * Allocate memory, aligned for any type.
+     *
+     * @param size the number of bytes
+     * @return the memory, which lives as long as the arena
+     */
+    void* allocate(size_t size);
+
+    /**
+     * Get the number of bytes handed out so far.
+     */
+    size_t allocated(void) const;
+
+  protected:
+
+    /**
+     * Destroy instance and free all memory. Only called when the last
+     * reference is released.
+     */
+    ~Arena(void);
+
+  private:
+
+    /**
+     * Chunks allocated so far.
+     */
+    std::vector<char*> chunks;
+
+    /**
+     * Next free byte in the current chunk.
+     */
+    char* current;
+
+    /**
+     * Number of free bytes in the current chunk.
+     */
+    size_t remaining;
+
+    /**
+     * Size of each chunk.
+     */
+    size_t chunkSize;
+
+    /**
+     * Number of bytes handed out.
+     */
+    size_t used;
+  };
+}
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file
+ *
+ * This file contains the article reference implementation.
+ */
+
+#include "article-ref.h"
+
+namespace fusenet {
+
+  ArticleRef::ArticleRef(void) :
+    owner(NULL), id(0), title(NULL), titleSize(0), author(NULL),
+    authorSize(0), text(NULL), textSize(0), textDescriptor(-1), textOffset(0) {
+    // Does nothing
+  }
+
+  ArticleRef::ArticleRef(const ArticleRef& other) : owner(NULL) {
+    *this = other;
+  }
+
+  ArticleRef& ArticleRef::operator=(const ArticleRef& other) {
+    set(other.owner, other.id,
+	other.title, other.titleSize,
+	other.author, other.authorSize,
+	other.text, other.textSize);
+    textDescriptor = other.textDescriptor;
+    textOffset = other.textOffset;
+    return *this;
+  }
+
+  void ArticleRef::set(Shared* owner, int id,
+		       const char* title, size_t titleSize,
+		       const char* author, size_t authorSize,
+		       const char* text, size_t textSize) {
+    // Take the new reference first, in case it is the same owner
+    if (owner) {
+      owner->acquire();
+    }
+
+    if (this->owner) {
+      this->owner->release();
+    }
+
+    this->owner = owner;
+    this->id = id;
+    this->title = title;
+    this->titleSize = titleSize;
+    this->author = author;
+    this->authorSize = authorSize;
+    this->text = text;
+    this->textSize = textSize;
+    this->textDescriptor = -1;
+    this->textOffset = 0;
+  }
+
+  void ArticleRef::setFile(Shared* owner, int id,
+			   const char* title, size_t titleSize,
+			   const char* author, size_t authorSize,
+			   int descriptor, off_t offset, size_t textSize) {
+    set(owner, id, title, titleSize, author, authorSize, NULL, textSize);
+    textDescriptor = descriptor;
+    textOffset = offset;
+  }
+
+  void ArticleRef::reset(void) {
+    set(NULL, 0, NULL, 0, NULL, 0, NULL, 0);
+  }
+
+  ArticleRef::~ArticleRef(void) {
+    if (owner) {
+      owner->release();
+    }
+  }
+}
@@ -0,0 +1,225 @@
+#ifndef ARTICLE_REF_H
+#define ARTICLE_REF_H
+
+/**
+ * @file
+ *
+ * This file contains the article reference interface.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "shared.h"
+
+namespace fusenet {
+
+  /**
+   * Article reference. Points at an article that is stored somewhere
+   * else, and keeps that storage alive through a reference to its
+   * owner for as long as the reference exists. The article is
+   * immutable, so copying a reference only copies pointers, and the
+   * fields can be encoded straight from where they are stored.
+   *
+   * The text may be left in a file instead of memory, for databases
+   * that keep articles in files, so that a large text can be sent
+   * straight from the file. The owner then keeps the file open.
+   */
+  class ArticleRef {
+
+  public:
+
+    /**
+     * Create an empty reference.
+     */
+    ArticleRef(void);
+
+    /**
+     * Copy a reference.
+     */
+    ArticleRef(const ArticleRef& other);
+
+    /**
+     * Assign a reference.
+     */
+    ArticleRef& operator=(const ArticleRef& other);
+
+    /**
+     * Point at an article. Takes a reference to the owner, and
+     * releases the one held before, if any.
+     *
+     * @param owner the object that keeps the article alive
+     * @param id the article identifier
+     * @param title the title
+     * @param titleSize the length of the title
+     * @param author the author
+     * @param authorSize the length of the author
+     * @param text the text
+     * @param textSize the length of the text
+     */
+    void set(Shared* owner, int id,
+	     const char* title, size_t titleSize,
+	     const char* author, size_t authorSize,
+	     const char* text, size_t textSize);
+
+    /**
+     * Point at an article whose text is in a file. Takes a reference
+     * to the owner, and releases the one held before, if any.
+     *
+     * @param owner the object that keeps the article and file alive
+     * @param id the article identifier
+     * @param title the title
+     * @param titleSize the length of the title
+     * @param author the author
+     * @param authorSize the length of the author
+     * @param descriptor the file holding the text
+     * @param offset where the text starts in the file
+     * @param textSize the length of the text
+     */
+    void setFile(Shared* owner, int id,
+		 const char* title, size_t titleSize,
+		 const char* author, size_t authorSize,
+		 int descriptor, off_t offset, size_t textSize);
+
+    /**
+     * Drop the reference.
+     */
+    void reset(void);
+
+    /**
+     * Get the article identifier.
+     */
+    int getIdentifier(void) const {
+      return id;
+    }
+
+    /**
+     * Get the title.
+     */
+    const char* getTitle(void) const {
+      return title;
+    }
+
+    /**
+     * Get the length of the title.
+     */
+    size_t getTitleSize(void) const {
+      return titleSize;
+    }
+
+    /**
+     * Get the author.
+     */
+    const char* getAuthor(void) const {
+      return author;
+    }
+
+    /**
+     * Get the length of the author.
+     */
+    size_t getAuthorSize(void) const {
+      return authorSize;
+    }
+
+    /**
+     * Get the owner, which keeps the article alive.
+     */
+    Shared* getOwner(void) const {
+      return owner;
+    }
+
+    /**
+     * Get the text, or NULL if the text is in a file.
+     */
+    const char* getText(void) const {
+      return text;
+    }
+
+    /**
+     * Get the length of the text.
+     */
+    size_t getTextSize(void) const {
+      return textSize;
+    }
+
+    /**
+     * Get the file holding the text, or -1 if the text is in memory.
+     */
+    int getTextDescriptor(void) const {
+      return textDescriptor;
+    }
+
+    /**
+     * Get where the text starts in its file.
+     */
+    off_t getTextOffset(void) const {
+      return textOffset;
+    }
+
+    /**
+     * Destroy instance, releasing the owner.
+     */
+    ~ArticleRef(void);
+
+  private:
+
+    /**
+     * Object keeping the article alive, or NULL.
+     */
+    Shared* owner;
+
+    /**
+     * Article identifier.
+     */
+    int id;
+
+    /**
+     * Title.
+     */
+    const char* title;
+
+    /**
+     * Length of the title.
+     */
+    size_t titleSize;
+
+    /**
+     * Author.
+     */
+    const char* author;
+
+    /**
+     * Length of the author.
+     */
+    size_t authorSize;
+
+    /**
+     * Text.
+     */
+    const char* text;
+
+    /**
+     * Length of the text.
+     */
+    size_t textSize;
+
+    /**
+     * File holding the text, or -1.
+     */
+    int textDescriptor;
+
+    /**
+     * Where the text starts in its file.
+     */
+    off_t textOffset;
+  };
+
+  /**
+   * Article reference list.
+   */
+  typedef std::vector<ArticleRef> ArticleRefList_t;
+}
+
+#endif
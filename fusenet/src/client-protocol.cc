@@ -7,6 +7,7 @@
 #include <cassert>
 
 #include "client-protocol.h"
+#include "message-builder.h"
 
 #define PRINT_ERR_NG  std::cout << "Newsgroup does not exist" << std::endl
 #define PRINT_ERR_ART std::cout << "Article does not exist" << std::endl
@@ -28,6 +29,9 @@ namespace fusenet {
     case ERR_ART_DOES_NOT_EXIST:
       status = STATUS_FAILURE_A_DOES_NOT_EXIST;
       break;
+    case ERR_NOT_MODIFIED:
+      status = STATUS_NOT_MODIFIED;
+      break;
     default:
       status = STATUS_FAILURE;
       break;
@@ -36,17 +40,33 @@ namespace fusenet {
     return status;
   }
 
+  void ClientProtocol::beginPipeline(void) {
+    transport->cork();
+  }
+
+  void ClientProtocol::endPipeline(void) {
+    transport->uncork();
+  }
+
+  int ClientProtocol::getOutstanding(void) const {
+    return outstanding;
+  }
+
   void ClientProtocol::listNewsgroups(void) {
-    sendCommand(COM_LIST_NG);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize());
+
+    message.addCommand(COM_LIST_NG);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
   
   void ClientProtocol::receiveListNewsgroups(void) {
-    size_t n, i;
+    int n, i;
     NewsgroupList_t newsgroupList;
     Newsgroup_t newsgroup;
     
-    receiveParameter(reinterpret_cast<int*>(&n));
+    receiveParameter(&n);
     
     for (i = 0; i < n; i++) {
       receiveParameter(&newsgroup.id);
@@ -55,13 +75,19 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onListNewsgroups(STATUS_SUCCESS, newsgroupList);
   }
 
   void ClientProtocol::createNewsgroup(const std::string& name) {
-    sendCommand(COM_CREATE_NG);
-    sendParameter(name);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::stringSize(name.size()));
+
+    message.addCommand(COM_CREATE_NG);
+    message.addString(name);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveCreateNewsgroup(void) {
@@ -74,13 +100,19 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onCreateNewsgroup(status);
   }
 
   void ClientProtocol::deleteNewsgroup(int newsgroupIdentifier) {
-    sendCommand(COM_DELETE_NG);
-    sendParameter(newsgroupIdentifier);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize());
+
+    message.addCommand(COM_DELETE_NG);
+    message.addNumber(newsgroupIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveDeleteNewsgroup(void) {
@@ -93,13 +125,19 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onDeleteNewsgroup(status);
   }
 
   void ClientProtocol::listArticles(int newsgroupIdentifier) {
-    sendCommand(COM_LIST_ART);
-    sendParameter(newsgroupIdentifier);
-    sendCommand(COM_END);    
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize());
+
+    message.addCommand(COM_LIST_ART);
+    message.addNumber(newsgroupIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveListArticles(void) {
@@ -124,19 +162,73 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onListArticles(status, articleList);
   }
 
+  void ClientProtocol::listArticlePage(int newsgroupIdentifier,
+				       int cursor,
+				       ListDirection_t direction,
+				       int maxCount) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   4 * MessageBuilder::numberSize());
+
+    message.addCommand(COM_LIST_ART_PAGE);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(cursor);
+    message.addNumber(direction);
+    message.addNumber(maxCount);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveListArticlePage(void) {
+    ArticleList_t articleList;
+    Article_t article;
+    Status_t status;
+    int nextCursor = CURSOR_NONE;
+    int n;
+    int i;
+
+    if (receiveCommand() == ANS_ACK) {
+      receiveParameter(&nextCursor);
+      receiveParameter(&n);
+
+      for (i = 0; i < n; i++) {
+	receiveParameter(&article.id);
+	receiveParameter(article.title);
+	articleList.push_back(article);
+      }
+
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onListArticlePage(status, articleList, nextCursor);
+  }
+
   void ClientProtocol::createArticle(int newsgroupIdentifier,
 				     const std::string& title,
 				     const std::string& author,
 				     const std::string& text) {
-    sendCommand(COM_CREATE_ART);
-    sendParameter(newsgroupIdentifier);
-    sendParameter(title);
-    sendParameter(author);
-    sendParameter(text);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize() +
+			   MessageBuilder::stringSize(title.size()) +
+			   MessageBuilder::stringSize(author.size()) +
+			   MessageBuilder::stringSize(text.size()));
+
+    message.addCommand(COM_CREATE_ART);
+    message.addNumber(newsgroupIdentifier);
+    message.addString(title);
+    message.addString(author);
+    message.addString(text);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveCreateArticle(void) {
@@ -149,15 +241,21 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onCreateArticle(status);
   }
   
   void ClientProtocol::deleteArticle(int newsgroupIdentifier,
 				     int articleIdentifier) {
-    sendCommand(COM_DELETE_ART);
-    sendParameter(newsgroupIdentifier);
-    sendParameter(articleIdentifier);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   2 * MessageBuilder::numberSize());
+
+    message.addCommand(COM_DELETE_ART);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(articleIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveDeleteArticle(void) {
@@ -170,15 +268,21 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onDeleteArticle(status);
   }
 
   void ClientProtocol::getArticle(int newsgroupIdentifier,
 				  int articleIdentifier) {
-    sendCommand(COM_GET_ART);
-    sendParameter(newsgroupIdentifier);
-    sendParameter(articleIdentifier);
-    sendCommand(COM_END);
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   2 * MessageBuilder::numberSize());
+
+    message.addCommand(COM_GET_ART);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(articleIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
   }
 
   void ClientProtocol::receiveGetArticle(void) {
@@ -195,9 +299,235 @@ namespace fusenet {
     }
 
     expectCommand(ANS_END);
+    outstanding--;
     onGetArticle(status, article);
   }
 
+  void ClientProtocol::getArticles(int newsgroupIdentifier,
+				   const IdentifierList_t& articleIdentifiers) {
+    IdentifierList_t::const_iterator i;
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   (2 + articleIdentifiers.size()) * MessageBuilder::numberSize());
+
+    message.addCommand(COM_GET_ARTS);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(articleIdentifiers.size());
+
+    for (i = articleIdentifiers.begin(); i != articleIdentifiers.end(); i++) {
+      message.addNumber(*i);
+    }
+
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveGetArticles(void) {
+    ArticleList_t articles;
+    StatusList_t statuses;
+    Status_t status;
+    int n;
+    int i;
+
+    if (receiveCommand() == ANS_ACK) {
+      receiveParameter(&n);
+      articles.resize(n);
+      statuses.resize(n);
+
+      for (i = 0; i < n; i++) {
+	receiveParameter(&articles[i].id);
+
+	if (receiveCommand() == ANS_ACK) {
+	  receiveParameter(articles[i].title);
+	  receiveParameter(articles[i].author);
+	  receiveParameter(articles[i].text);
+	  statuses[i] = STATUS_SUCCESS;
+	} else {
+	  statuses[i] = TranslateError(receiveCommand());
+	}
+      }
+
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onGetArticles(status, articles, statuses);
+  }
+
+  void ClientProtocol::listNewsgroupsIfModified(Version_t version) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize());
+
+    message.addCommand(COM_LIST_NG_IF);
+    message.addNumber(version);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveListNewsgroupsIfModified(void) {
+    NewsgroupList_t newsgroupList;
+    Newsgroup_t newsgroup;
+    Status_t status;
+    int version = VERSION_NONE;
+    int n;
+    int i;
+
+    if (receiveCommand() == ANS_ACK) {
+      receiveParameter(&version);
+      receiveParameter(&n);
+
+      for (i = 0; i < n; i++) {
+	receiveParameter(&newsgroup.id);
+	receiveParameter(newsgroup.name);
+	newsgroupList.push_back(newsgroup);
+      }
+
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onListNewsgroupsIfModified(status, version, newsgroupList);
+  }
+
+  void ClientProtocol::listArticlesIfModified(int newsgroupIdentifier,
+					      Version_t version) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   2 * MessageBuilder::numberSize());
+
+    message.addCommand(COM_LIST_ART_IF);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(version);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveListArticlesIfModified(void) {
+    ArticleList_t articleList;
+    Article_t article;
+    Status_t status;
+    int version = VERSION_NONE;
+    int n;
+    int i;
+
+    if (receiveCommand() == ANS_ACK) {
+      receiveParameter(&version);
+      receiveParameter(&n);
+
+      for (i = 0; i < n; i++) {
+	receiveParameter(&article.id);
+	receiveParameter(article.title);
+	articleList.push_back(article);
+      }
+
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onListArticlesIfModified(status, version, articleList);
+  }
+
+  void ClientProtocol::subscribe(int newsgroupIdentifier) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize());
+
+    message.addCommand(COM_SUBSCRIBE);
+    message.addNumber(newsgroupIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveSubscribe(void) {
+    Status_t status;
+
+    if (receiveCommand() == ANS_ACK) {
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onSubscribe(status);
+  }
+
+  void ClientProtocol::unsubscribe(int newsgroupIdentifier) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   MessageBuilder::numberSize());
+
+    message.addCommand(COM_UNSUBSCRIBE);
+    message.addNumber(newsgroupIdentifier);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveUnsubscribe(void) {
+    Status_t status;
+
+    if (receiveCommand() == ANS_ACK) {
+      status = STATUS_SUCCESS;
+    } else {
+      status = TranslateError(receiveCommand());
+    }
+
+    expectCommand(ANS_END);
+    outstanding--;
+    onUnsubscribe(status);
+  }
+
+  void ClientProtocol::getStatistics(void) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize());
+
+    message.addCommand(COM_STATS);
+    message.addCommand(COM_END);
+    outstanding++;
+    flush();
+  }
+
+  void ClientProtocol::receiveStatistics(void) {
+    std::string report;
+
+    receiveParameter(report);
+    expectCommand(ANS_END);
+    outstanding--;
+    onStatistics(report);
+  }
+
+  void ClientProtocol::receiveNewArticle(void) {
+    int newsgroupIdentifier;
+    int articleIdentifier;
+    std::string title;
+
+    // Not a reply, so nothing is outstanding
+    receiveParameter(&newsgroupIdentifier);
+    receiveParameter(&articleIdentifier);
+    receiveParameter(title);
+    expectCommand(ANS_END);
+    onNewArticle(newsgroupIdentifier, articleIdentifier, title);
+  }
+
+  void ClientProtocol::receiveArticleDeleted(void) {
+    int newsgroupIdentifier;
+    int articleIdentifier;
+
+    receiveParameter(&newsgroupIdentifier);
+    receiveParameter(&articleIdentifier);
+    expectCommand(ANS_END);
+    onArticleDeleted(newsgroupIdentifier, articleIdentifier);
+  }
+
   void ClientProtocol::onDataReceived(uint8_t data) {
     switch (data) {
     case ANS_LIST_NG:
@@ -221,6 +551,33 @@ namespace fusenet {
     case ANS_GET_ART:
       receiveGetArticle();
       break;
+    case ANS_GET_ARTS:
+      receiveGetArticles();
+      break;
+    case ANS_LIST_ART_PAGE:
+      receiveListArticlePage();
+      break;
+    case ANS_LIST_NG_IF:
+      receiveListNewsgroupsIfModified();
+      break;
+    case ANS_LIST_ART_IF:
+      receiveListArticlesIfModified();
+      break;
+    case ANS_SUBSCRIBE:
+      receiveSubscribe();
+      break;
+    case ANS_UNSUBSCRIBE:
+      receiveUnsubscribe();
+      break;
+    case ANS_STATS:
+      receiveStatistics();
+      break;
+    case ANS_NEW_ART:
+      receiveNewArticle();
+      break;
+    case ANS_ART_DELETED:
+      receiveArticleDeleted();
+      break;
     default:
       std::cout << "Throwing away data " << static_cast<int>(data)
 		<< " (this is a bad thing)" << std::endl;
@@ -34,7 +34,26 @@ namespace fusenet {
      *
      * @param transport the transport
      */
-    ClientProtocol(Transport* transport) : MessageProtocol(transport) { }
+    ClientProtocol(Transport* transport) : MessageProtocol(transport), outstanding(0) { }
+
+    /**
+     * Start a pipeline. The requests made until endPipeline() are
+     * sent together, without waiting for any replies. The replies
+     * come back in the order the requests were made, and each one
+     * ends up in its callback as usual.
+     */
+    void beginPipeline(void);
+
+    /**
+     * End a pipeline, and send the requests made since
+     * beginPipeline().
+     */
+    void endPipeline(void);
+
+    /**
+     * Get the number of requests that have not been replied to yet.
+     */
+    int getOutstanding(void) const;
 
     /**
      * Called on made connection.
@@ -99,6 +118,33 @@ namespace fusenet {
     virtual void onListArticles(Status_t status,
 				ArticleList_t& articleList) = 0;
     
+    /**
+     * List a page of articles.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param cursor list the articles after this identifier, or
+     *        CURSOR_NONE to start from the first or the last article
+     * @param direction LIST_FORWARD or LIST_BACKWARD
+     * @param maxCount the largest number of articles, or 0 for as many
+     *        as the server allows
+     */
+    void listArticlePage(int newsgroupIdentifier,
+			 int cursor,
+			 ListDirection_t direction,
+			 int maxCount);
+
+    /**
+     * List a page of articles callback.
+     *
+     * @param status the status
+     * @param articleList the articles, with identifiers and titles only
+     * @param nextCursor the cursor of the next page, or CURSOR_NONE if
+     *        this was the last
+     */
+    virtual void onListArticlePage(Status_t status,
+				   ArticleList_t& articleList,
+				   int nextCursor) = 0;
+
     /**
      * Create article.
      *
@@ -153,6 +199,135 @@ namespace fusenet {
     virtual void onGetArticle(Status_t status,
 			      Article_t& article) = 0;
 
+    /**
+     * Get several articles with one request.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifiers the article identifiers
+     */
+    void getArticles(int newsgroupIdentifier,
+		     const IdentifierList_t& articleIdentifiers);
+
+    /**
+     * Get several articles callback. The articles come in the order
+     * asked for, each with its identifier and its own status.
+     *
+     * @param status the status, failing if the newsgroup does not exist
+     * @param articles the articles
+     * @param statuses the status of each article
+     */
+    virtual void onGetArticles(Status_t status,
+			       ArticleList_t& articles,
+			       StatusList_t& statuses) = 0;
+
+    /**
+     * List newsgroups, unless the list has not changed since a
+     * version of it was listed.
+     *
+     * @param version the version of the list, or VERSION_NONE to
+     *        always list
+     */
+    void listNewsgroupsIfModified(Version_t version);
+
+    /**
+     * List newsgroups if modified callback.
+     *
+     * @param status the status, STATUS_NOT_MODIFIED if the list has
+     *        not changed
+     * @param version the version of the list
+     * @param newsgroupList the newsgroup list, empty if not modified
+     */
+    virtual void onListNewsgroupsIfModified(Status_t status,
+					    Version_t version,
+					    NewsgroupList_t& newsgroupList) = 0;
+
+    /**
+     * List articles, unless the newsgroup has not changed since a
+     * version of it was listed.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param version the version of the newsgroup, or VERSION_NONE to
+     *        always list
+     */
+    void listArticlesIfModified(int newsgroupIdentifier,
+				Version_t version);
+
+    /**
+     * List articles if modified callback.
+     *
+     * @param status the status, STATUS_NOT_MODIFIED if the newsgroup
+     *        has not changed
+     * @param version the version of the newsgroup
+     * @param articleList the article list, empty if not modified
+     */
+    virtual void onListArticlesIfModified(Status_t status,
+					  Version_t version,
+					  ArticleList_t& articleList) = 0;
+
+    /**
+     * Subscribe to a newsgroup. New and deleted articles in it are
+     * then announced with onNewArticle() and onArticleDeleted(),
+     * until unsubscribe() is called.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    void subscribe(int newsgroupIdentifier);
+
+    /**
+     * Subscribe callback.
+     *
+     * @param status the status
+     */
+    virtual void onSubscribe(Status_t status) = 0;
+
+    /**
+     * Unsubscribe from a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    void unsubscribe(int newsgroupIdentifier);
+
+    /**
+     * Unsubscribe callback.
+     *
+     * @param status the status
+     */
+    virtual void onUnsubscribe(Status_t status) = 0;
+
+    /**
+     * Get the statistics of the requests the server has handled.
+     */
+    void getStatistics(void);
+
+    /**
+     * Get statistics callback.
+     *
+     * @param report the statistics, as text
+     */
+    virtual void onStatistics(std::string& report) = 0;
+
+    /**
+     * Called when an article is created in a subscribed newsgroup.
+     * This is not a reply, and may come between any two replies.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     * @param title the article title
+     */
+    virtual void onNewArticle(int newsgroupIdentifier,
+			      int articleIdentifier,
+			      std::string& title) = 0;
+
+    /**
+     * Called when an article is deleted from a subscribed newsgroup.
+     * This is not a reply, and may come between any two replies.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     */
+    virtual void onArticleDeleted(int newsgroupIdentifier,
+				  int articleIdentifier) = 0;
+
     /**
      * Called on lost connection.
      */
@@ -180,6 +355,11 @@ namespace fusenet {
      */
     void receiveListArticles(void);
 
+    /**
+     * Receive list a page of articles answer.
+     */
+    void receiveListArticlePage(void);
+
     /**
      * Receive create article answer.
      */
@@ -195,12 +375,57 @@ namespace fusenet {
      */
     void receiveGetArticle(void);
 
+    /**
+     * Receive get several articles answer.
+     */
+    void receiveGetArticles(void);
+
+    /**
+     * Receive list newsgroups if modified answer.
+     */
+    void receiveListNewsgroupsIfModified(void);
+
+    /**
+     * Receive list articles if modified answer.
+     */
+    void receiveListArticlesIfModified(void);
+
+    /**
+     * Receive subscribe answer.
+     */
+    void receiveSubscribe(void);
+
+    /**
+     * Receive unsubscribe answer.
+     */
+    void receiveUnsubscribe(void);
+
+    /**
+     * Receive get statistics answer.
+     */
+    void receiveStatistics(void);
+
+    /**
+     * Receive new article notification.
+     */
+    void receiveNewArticle(void);
+
+    /**
+     * Receive deleted article notification.
+     */
+    void receiveArticleDeleted(void);
+
     /**
      * Called on data receival.
      *
      * @param data the data received
      */
     void onDataReceived(uint8_t data);
+
+    /**
+     * Number of requests not yet replied to.
+     */
+    int outstanding;
   };
 
 }
@@ -5,6 +5,7 @@
  */
 
 #include <cassert>
+#include <sstream>
 
 #include "client.h"
 
@@ -27,6 +28,9 @@ namespace fusenet {
     case STATUS_FAILURE_A_DOES_NOT_EXIST:
       std::cout << "Operation failed, no such article" << std::endl;
       break;
+    case STATUS_NOT_MODIFIED:
+      std::cout << "Not modified" << std::endl;
+      break;
     default:
       assert(0);
       break;
@@ -74,6 +78,28 @@ namespace fusenet {
     interact();
   }
 
+  void Client::onListArticlePage(Status_t status,
+				 ArticleList_t& articleList,
+				 int nextCursor) {
+    ArticleList_t::iterator i;
+
+    if (IS_SUCCESS(status)) {
+      for (i = articleList.begin(); i != articleList.end(); i++) {
+	std::cout << i->id << " " << i->title << " " << std::endl;
+      }
+
+      if (nextCursor == CURSOR_NONE) {
+	std::cout << "No more articles" << std::endl;
+      } else {
+	std::cout << "Next page after " << nextCursor << std::endl;
+      }
+    } else {
+      PrintStatus(status);
+    }
+
+    interact();
+  }
+
   void Client::onCreateArticle(Status_t status) {
     PrintStatus(status);
     interact();
@@ -95,7 +121,94 @@ namespace fusenet {
 
     interact();
   }
+
+  void Client::onGetArticles(Status_t status, ArticleList_t& articles,
+			     StatusList_t& statuses) {
+    size_t i;
+
+    if (IS_SUCCESS(status)) {
+      for (i = 0; i < articles.size(); i++) {
+	std::cout << "Article : " << articles[i].id << std::endl;
+
+	if (IS_SUCCESS(statuses[i])) {
+	  std::cout << "Title   : " << articles[i].title << std::endl;
+	  std::cout << "Author  : " << articles[i].author << std::endl;
+	  std::cout << std::endl << articles[i].text << std::endl;
+	} else {
+	  PrintStatus(statuses[i]);
+	}
+
+	std::cout << std::endl;
+      }
+    } else {
+      PrintStatus(status);
+    }
+
+    interact();
+  }
   
+  void Client::onListNewsgroupsIfModified(Status_t status,
+					  Version_t version,
+					  NewsgroupList_t& newsgroupList) {
+    if (IS_SUCCESS(status)) {
+      newsgroups.swap(newsgroupList);
+      newsgroupsVersion = version;
+    }
+
+    if (status == STATUS_NOT_MODIFIED) {
+      std::cout << "(unchanged)" << std::endl;
+      status = STATUS_SUCCESS;
+    }
+
+    onListNewsgroups(status, newsgroups);
+  }
+
+  void Client::onListArticlesIfModified(Status_t status,
+					Version_t version,
+					ArticleList_t& articleList) {
+    if (IS_SUCCESS(status)) {
+      articles.swap(articleList);
+      articlesNewsgroup = listingNewsgroup;
+      articlesVersion = version;
+    }
+
+    if (status == STATUS_NOT_MODIFIED) {
+      std::cout << "(unchanged)" << std::endl;
+      status = STATUS_SUCCESS;
+    }
+
+    onListArticles(status, articles);
+  }
+
+  void Client::onSubscribe(Status_t status) {
+    PrintStatus(status);
+    interact();
+  }
+
+  void Client::onUnsubscribe(Status_t status) {
+    PrintStatus(status);
+    interact();
+  }
+
+  void Client::onStatistics(std::string& report) {
+    std::cout << report;
+    interact();
+  }
+
+  void Client::onNewArticle(int newsgroupIdentifier,
+			    int articleIdentifier,
+			    std::string& title) {
+    // Not a reply, so the prompt is still up
+    std::cout << "New article " << articleIdentifier << " in newsgroup "
+	      << newsgroupIdentifier << ": " << title << std::endl;
+  }
+
+  void Client::onArticleDeleted(int newsgroupIdentifier,
+				int articleIdentifier) {
+    std::cout << "Deleted article " << articleIdentifier << " in newsgroup "
+	      << newsgroupIdentifier << std::endl;
+  }
+
   void Client::onConnectionMade(void) {
     std::cout << "Connection established" << std::endl;
     interact();
@@ -135,7 +248,12 @@ namespace fusenet {
     std::cout << "  h  this help message" << std::endl;
     std::cout << "  k  delete newsgroup" << std::endl;
     std::cout << "  l  list newsgroups" << std::endl;
+    std::cout << "  m  get several articles" << std::endl;
     std::cout << "  n  create article" << std::endl;
+    std::cout << "  p  list a page of articles, newest first" << std::endl;
+    std::cout << "  s  subscribe to newsgroup" << std::endl;
+    std::cout << "  t  show server statistics" << std::endl;
+    std::cout << "  u  unsubscribe from newsgroup" << std::endl;
     interact();
   }
   
@@ -149,7 +267,7 @@ namespace fusenet {
       
     case 'l': 
       {
-	listNewsgroups();
+	listNewsgroupsIfModified(newsgroupsVersion);
 	break;
       }
       
@@ -170,10 +288,22 @@ namespace fusenet {
     case 'a': 
       {
 	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
-	listArticles(newsgroupIdentifier);
+	listingNewsgroup = newsgroupIdentifier;
+	listArticlesIfModified(newsgroupIdentifier,
+			       newsgroupIdentifier == articlesNewsgroup ?
+			       articlesVersion : VERSION_NONE);
 	break;
       }
       
+    case 'p':
+      {
+	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
+	int cursor = askInteger("Enter article identifier to list before (-1 for newest)");
+	int maxCount = askInteger("Enter number of articles");
+	listArticlePage(newsgroupIdentifier, cursor, LIST_BACKWARD, maxCount);
+	break;
+      }
+
     case 'n': 
       {
 	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
@@ -201,6 +331,41 @@ namespace fusenet {
 	break;
       }
 
+    case 'm':
+      {
+	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
+	std::istringstream answer(askString("Enter article identifiers"));
+	IdentifierList_t articleIdentifiers;
+	int articleIdentifier;
+
+	while (answer >> articleIdentifier) {
+	  articleIdentifiers.push_back(articleIdentifier);
+	}
+
+	getArticles(newsgroupIdentifier, articleIdentifiers);
+	break;
+      }
+
+    case 's':
+      {
+	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
+	subscribe(newsgroupIdentifier);
+	break;
+      }
+
+    case 'u':
+      {
+	int newsgroupIdentifier = askInteger("Enter newsgroup identifier");
+	unsubscribe(newsgroupIdentifier);
+	break;
+      }
+
+    case 't':
+      {
+	getStatistics();
+	break;
+      }
+
     case 'q':
       {
 	exit(0);
@@ -24,7 +24,10 @@ namespace fusenet {
      *
      * @param transport the transport
      */
-    Client(Transport* const transport) : ClientProtocol(transport) { }
+    Client(Transport* const transport) :
+      ClientProtocol(transport), newsgroupsVersion(VERSION_NONE),
+      articlesNewsgroup(-1), articlesVersion(VERSION_NONE),
+      listingNewsgroup(-1) { }
 
     /**
      * Destroys an instance.
@@ -70,6 +73,17 @@ namespace fusenet {
     void onListArticles(Status_t status,
 			ArticleList_t& articleList);
 
+    /**
+     * Called on list a page of articles.
+     *
+     * @param status the status
+     * @param articleList the article list
+     * @param nextCursor the cursor of the next page
+     */
+    void onListArticlePage(Status_t status,
+			   ArticleList_t& articleList,
+			   int nextCursor);
+
     /**
      * Called on create article.
      *
@@ -93,6 +107,82 @@ namespace fusenet {
     void onGetArticle(Status_t status,
 		      Article_t& article);
 
+    /**
+     * Called on get several articles.
+     *
+     * @param status the status
+     * @param articles the articles
+     * @param statuses the status of each article
+     */
+    void onGetArticles(Status_t status,
+		       ArticleList_t& articles,
+		       StatusList_t& statuses);
+
+    /**
+     * Called on list newsgroups if modified. Remembers the list, and
+     * shows the remembered one if it has not changed.
+     *
+     * @param status the status
+     * @param version the version of the list
+     * @param newsgroupList the newsgroup list
+     */
+    void onListNewsgroupsIfModified(Status_t status,
+				    Version_t version,
+				    NewsgroupList_t& newsgroupList);
+
+    /**
+     * Called on list articles if modified. Remembers the list, and
+     * shows the remembered one if it has not changed.
+     *
+     * @param status the status
+     * @param version the version of the newsgroup
+     * @param articleList the article list
+     */
+    void onListArticlesIfModified(Status_t status,
+				  Version_t version,
+				  ArticleList_t& articleList);
+
+    /**
+     * Called on subscribe.
+     *
+     * @param status the status
+     */
+    void onSubscribe(Status_t status);
+
+    /**
+     * Called on unsubscribe.
+     *
+     * @param status the status
+     */
+    void onUnsubscribe(Status_t status);
+
+    /**
+     * Called on get statistics.
+     *
+     * @param report the statistics
+     */
+    void onStatistics(std::string& report);
+
+    /**
+     * Called on a new article in a subscribed newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     * @param title the article title
+     */
+    void onNewArticle(int newsgroupIdentifier,
+		      int articleIdentifier,
+		      std::string& title);
+
+    /**
+     * Called on a deleted article in a subscribed newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     */
+    void onArticleDeleted(int newsgroupIdentifier,
+			  int articleIdentifier);
+
     /**
      * Called on lost connection.
      */
@@ -123,6 +213,36 @@ namespace fusenet {
      * Interact with the user.
      */
     void interact(void);
+
+    /**
+     * Newsgroups last listed.
+     */
+    NewsgroupList_t newsgroups;
+
+    /**
+     * Version of the newsgroups last listed, or VERSION_NONE.
+     */
+    Version_t newsgroupsVersion;
+
+    /**
+     * Articles last listed.
+     */
+    ArticleList_t articles;
+
+    /**
+     * Newsgroup of the articles last listed, or -1.
+     */
+    int articlesNewsgroup;
+
+    /**
+     * Version of that newsgroup, or VERSION_NONE.
+     */
+    Version_t articlesVersion;
+
+    /**
+     * Newsgroup being listed.
+     */
+    int listingNewsgroup;
   };
 
 }
@@ -4,16 +4,178 @@
  * This file contains the database implementation.
  */
 
+#include <algorithm>
 #include <iostream>
 
 #include "database.h"
 
 namespace fusenet {
 
+  /**
+   * Owner of an article copied for a reference.
+   */
+  class ArticleCopy : public Shared {
+
+  public:
+
+    /**
+     * The copy.
+     */
+    Article_t article;
+  };
+
   Database::Database(void) {
     // Does nothing
   }
 
+  Status_t Database::checkNewsgroup(int newsgroupIdentifier) {
+    NewsgroupList_t newsgroupList;
+    NewsgroupList_t::iterator i;
+
+    getNewsgroupList(newsgroupList);
+
+    for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
+      if (i->id == newsgroupIdentifier) {
+	return STATUS_SUCCESS;
+      }
+    }
+
+    return STATUS_FAILURE_N_DOES_NOT_EXIST;
+  }
+
+  Status_t Database::listArticleHeaders(int newsgroupIdentifier,
+					ArticleHeaderList_t& headerList) {
+    ArticleList_t articleList;
+    ArticleList_t::iterator i;
+    Status_t status;
+
+    status = listArticles(newsgroupIdentifier, articleList);
+
+    for (i = articleList.begin(); i != articleList.end(); i++) {
+      ArticleHeader_t header;
+
+      header.id = i->id;
+      header.title = i->title;
+      header.author = i->author;
+      header.size = i->text.size();
+      headerList.push_back(header);
+    }
+
+    return status;
+  }
+
+  /**
+   * Order article headers by identifier.
+   */
+  static bool IdentifierLess(const ArticleHeader_t& a, const ArticleHeader_t& b) {
+    return a.id < b.id;
+  }
+
+  Status_t Database::listArticlePage(int newsgroupIdentifier,
+				     int cursor,
+				     ListDirection_t direction,
+				     size_t maxCount,
+				     ArticleHeaderList_t& headerList,
+				     int& nextCursor) {
+    ArticleHeaderList_t all;
+    Status_t status;
+    size_t found = 0;
+    size_t i;
+
+    nextCursor = CURSOR_NONE;
+    status = listArticleHeaders(newsgroupIdentifier, all);
+
+    if (!IS_SUCCESS(status)) {
+      return status;
+    }
+
+    std::sort(all.begin(), all.end(), IdentifierLess);
+
+    for (i = 0; i < all.size(); i++) {
+      const ArticleHeader_t& header = all[direction == LIST_FORWARD ? i : all.size() - 1 - i];
+
+      // Skip up to the cursor
+      if (cursor >= 0 &&
+	  (direction == LIST_FORWARD ? header.id <= cursor : header.id >= cursor)) {
+	continue;
+      }
+
+      if (found == maxCount) {
+	nextCursor = found > 0 ? headerList.back().id : cursor;
+	break;
+      }
+
+      headerList.push_back(header);
+      found++;
+    }
+
+    return status;
+  }
+
+  Status_t Database::getArticleRef(int newsgroupIdentifier,
+				   int articleIdentifier,
+				   ArticleRef& article) {
+    ArticleCopy* copy = new ArticleCopy();
+    Status_t status;
+
+    status = getArticle(newsgroupIdentifier, articleIdentifier, copy->article);
+
+    if (IS_SUCCESS(status)) {
+      article.set(copy, copy->article.id,
+		  copy->article.title.data(), copy->article.title.size(),
+		  copy->article.author.data(), copy->article.author.size(),
+		  copy->article.text.data(), copy->article.text.size());
+    }
+
+    copy->release();
+    return status;
+  }
+
+  Status_t Database::getArticleRefs(int newsgroupIdentifier,
+				    const IdentifierList_t& articleIdentifiers,
+				    ArticleRefList_t& articles,
+				    StatusList_t& statuses) {
+    size_t j;
+
+    articles.resize(articleIdentifiers.size());
+    statuses.resize(articleIdentifiers.size());
+
+    for (j = 0; j < articleIdentifiers.size(); j++) {
+      statuses[j] = getArticleRef(newsgroupIdentifier, articleIdentifiers[j], articles[j]);
+
+      if (statuses[j] == STATUS_FAILURE_N_DOES_NOT_EXIST) {
+	articles.clear();
+	statuses.clear();
+	return STATUS_FAILURE_N_DOES_NOT_EXIST;
+      }
+
+      if (!IS_SUCCESS(statuses[j])) {
+	articles[j].reset();
+      }
+    }
+
+    if (!articleIdentifiers.empty()) {
+      return STATUS_SUCCESS;
+    }
+
+    // Nothing was looked up, so look for the newsgroup itself
+    return checkNewsgroup(newsgroupIdentifier);
+  }
+
+  Status_t Database::getNewsgroupListVersion(Version_t& version) {
+    version = VERSION_NONE;
+    return STATUS_SUCCESS;
+  }
+
+  Status_t Database::getNewsgroupVersion(int, Version_t& version) {
+    version = VERSION_NONE;
+    return STATUS_SUCCESS;
+  }
+
+  Status_t Database::commit(void) {
+    return STATUS_SUCCESS;
+  }
+
   Database::~Database(void) {
     // Does nothing
   }
@@ -9,6 +9,7 @@
 
 #include <string>
 
+#include "article-ref.h"
 #include "fusenet-types.h"
 
 namespace fusenet {
@@ -32,6 +33,15 @@ namespace fusenet {
      */
     virtual Status_t getNewsgroupList(NewsgroupList_t& newsgroupList) = 0;
 
+    /**
+     * Check that a newsgroup exists. The default implementation looks
+     * for it in the newsgroup list, databases that can look it up
+     * directly override it.
+     *
+     * @return STATUS_SUCCESS, or STATUS_FAILURE_N_DOES_NOT_EXIST
+     */
+    virtual Status_t checkNewsgroup(int newsgroupIdentifier);
+
     /**
      * Create newsgroups.
      */
@@ -49,7 +59,40 @@ namespace fusenet {
 				  ArticleList_t& articleList) = 0;
 
     /**
-     * Create article.
+     * List article headers, without the article texts. The default
+     * implementation lists the complete articles and drops the texts,
+     * databases that can do better override it.
+     */
+    virtual Status_t listArticleHeaders(int newsgroupIdentifier,
+					ArticleHeaderList_t& headerList);
+
+    /**
+     * List a page of article headers, in identifier order. The
+     * default implementation lists all headers and picks the page,
+     * databases that keep their articles ordered override it to visit
+     * only the page.
+     *
+     * @param newsgroupIdentifier the newsgroup
+     * @param cursor list the articles after this identifier, in the
+     *        given direction, or CURSOR_NONE to start from the first
+     *        or the last article
+     * @param direction LIST_FORWARD for increasing identifiers, or
+     *        LIST_BACKWARD for decreasing ones
+     * @param maxCount the largest number of headers to list
+     * @param headerList where to add the headers
+     * @param nextCursor set to the cursor of the next page, or to
+     *        CURSOR_NONE if no articles follow
+     */
+    virtual Status_t listArticlePage(int newsgroupIdentifier,
+				     int cursor,
+				     ListDirection_t direction,
+				     size_t maxCount,
+				     ArticleHeaderList_t& headerList,
+				     int& nextCursor);
+
+    /**
+     * Create article. On success the identifier of the article is
+     * set to the one it was given.
      */
     virtual Status_t createArticle(int newsgroupIdentifier,
 				   Article_t& article) = 0;
@@ -67,6 +110,66 @@ namespace fusenet {
 				int articleIdentifier,
 				Article_t& article) = 0;
 
+    /**
+     * Get a reference to an article, which stays valid after the
+     * article is deleted. The default implementation copies the
+     * article once into storage owned by the reference, databases
+     * that keep their articles immutable override it to hand out the
+     * stored article without copying.
+     */
+    virtual Status_t getArticleRef(int newsgroupIdentifier,
+				   int articleIdentifier,
+				   ArticleRef& article);
+
+    /**
+     * Get references to several articles in one newsgroup. The
+     * default implementation gets them one at a time, databases that
+     * can look up many articles at once override it.
+     *
+     * @param newsgroupIdentifier the newsgroup
+     * @param articleIdentifiers the articles
+     * @param articles set to one reference per article, in order
+     * @param statuses set to one status per article, in order
+     * @return STATUS_SUCCESS, even if some of the articles do not
+     *         exist, or STATUS_FAILURE_N_DOES_NOT_EXIST
+     */
+    virtual Status_t getArticleRefs(int newsgroupIdentifier,
+				    const IdentifierList_t& articleIdentifiers,
+				    ArticleRefList_t& articles,
+				    StatusList_t& statuses);
+
+    /**
+     * Get the version of the newsgroup list, which changes whenever a
+     * newsgroup is created or deleted. The default implementation
+     * gives VERSION_NONE, for databases that do not keep versions.
+     */
+    virtual Status_t getNewsgroupListVersion(Version_t& version);
+
+    /**
+     * Get the version of the articles of a newsgroup, which changes
+     * whenever an article is created in it or deleted from it. The
+     * default implementation gives VERSION_NONE, for databases that
+     * do not keep versions, and leaves it to the listing to tell if
+     * the newsgroup exists.
+     *
+     * @return STATUS_SUCCESS, or STATUS_FAILURE_N_DOES_NOT_EXIST
+     */
+    virtual Status_t getNewsgroupVersion(int newsgroupIdentifier,
+					 Version_t& version);
+
+    /**
+     * Wait until the changes made so far are on stable storage. The
+     * server calls this after a successful change and before it
+     * acknowledges it, without holding any lock, so that concurrent
+     * changes can share one sync. The default implementation does
+     * nothing, for databases that are volatile or that sync as part
+     * of every change.
+     *
+     * @return STATUS_SUCCESS, or STATUS_FAILURE if the changes could
+     *         not be made durable
+     */
+    virtual Status_t commit(void);
+
     /**
      * Destroy instance.
      */
@@ -0,0 +1,49 @@
+
+/**
+ * @file
+ *
+ * This file contains the demultiplexer implementation.
+ */
+
+#include <cstddef>
+
+#include "demultiplexer.h"
+#include "epoll-demultiplexer.h"
+#include "select-demultiplexer.h"
+
+namespace fusenet {
+
+  Demultiplexer::Demultiplexer(void) {
+    // Does nothing
+  }
+
+  Demultiplexer* Demultiplexer::create(DemultiplexerType_t type) {
+    Demultiplexer* demultiplexer = NULL;
+
+    switch (type) {
+    case DEMULTIPLEXER_SELECT:
+      demultiplexer = new SelectDemultiplexer();
+      break;
+#ifdef HAVE_EPOLL
+    case DEMULTIPLEXER_EPOLL:
+      demultiplexer = new EpollDemultiplexer(false);
+      break;
+    case DEMULTIPLEXER_EPOLL_EDGE:
+      demultiplexer = new EpollDemultiplexer(true);
+      break;
+#endif
+    default:
+      break;
+    }
+
+    return demultiplexer;
+  }
+
+  bool Demultiplexer::isEdgeTriggered(void) const {
+    return false;
+  }
+
+  Demultiplexer::~Demultiplexer(void) {
+    // Does nothing
+  }
+}
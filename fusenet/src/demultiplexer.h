@@ -0,0 +1,127 @@
+#ifndef DEMULTIPLEXER_H
+#define DEMULTIPLEXER_H
+
+/**
+ * @file
+ *
+ * This file contains the demultiplexer interface.
+ *
+ * A demultiplexer waits for events on a set of descriptors and
+ * reports which of them are ready. Descriptors are registered once
+ * and stay registered until they are removed, so that the cost of a
+ * wakeup does not depend on rebuilding the descriptor set.
+ */
+
+#include <vector>
+
+namespace fusenet {
+
+  /**
+   * Event flags. These are combined into event masks, both when
+   * registering interest and when reporting ready descriptors.
+   */
+  typedef enum {
+    EVENT_READ  = 1,            //!< Descriptor is readable
+    EVENT_WRITE = 2             //!< Descriptor is writable
+  }
+  EventFlag_t;
+
+  /**
+   * Event type.
+   */
+  typedef struct {
+    int descriptor;             //!< Descriptor
+    int events;                 //!< Mask of ready events
+  } Event_t;
+
+  /**
+   * Event list.
+   */
+  typedef std::vector<Event_t> EventList_t;
+
+  /**
+   * Demultiplexer type.
+   */
+  typedef enum {
+    DEMULTIPLEXER_SELECT,       //!< Portable select() backend
+    DEMULTIPLEXER_EPOLL,        //!< Level-triggered epoll backend
+    DEMULTIPLEXER_EPOLL_EDGE    //!< Edge-triggered epoll backend
+  }
+  DemultiplexerType_t;
+
+  /**
+   * Base class for all demultiplexers.
+   */
+  class Demultiplexer {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    Demultiplexer(void);
+
+    /**
+     * Create a demultiplexer of the given type.
+     *
+     * @param type the demultiplexer type
+     * @return the demultiplexer, or NULL if the type is not
+     * available on this platform
+     */
+    static Demultiplexer* create(DemultiplexerType_t type);
+
+    /**
+     * Register a descriptor.
+     *
+     * @param descriptor the descriptor
+     * @param events the mask of events to wait for
+     * @return true on success
+     */
+    virtual bool add(int descriptor, int events) = 0;
+
+    /**
+     * Change the events to wait for on a registered descriptor.
+     *
+     * @param descriptor the descriptor
+     * @param events the new mask of events to wait for
+     * @return true on success
+     */
+    virtual bool modify(int descriptor, int events) = 0;
+
+    /**
+     * Unregister a descriptor.
+     *
+     * @param descriptor the descriptor
+     */
+    virtual void remove(int descriptor) = 0;
+
+    /**
+     * Block until at least one registered descriptor is ready.
+     *
+     * @param eventList the list to fill with ready events, it is
+     * cleared first
+     * @return false on error
+     */
+    virtual bool wait(EventList_t& eventList) = 0;
+
+    /**
+     * Is demultiplexer edge-triggered. An edge-triggered
+     * demultiplexer only reports a descriptor again once new events
+     * have happened on it, so the caller must consume everything
+     * that is ready before waiting again.
+     */
+    virtual bool isEdgeTriggered(void) const;
+
+    /**
+     * Demultiplexer name.
+     */
+    virtual const char* getName(void) const = 0;
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~Demultiplexer(void);
+  };
+}
+
+#endif
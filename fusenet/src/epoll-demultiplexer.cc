@@ -0,0 +1,126 @@
+
+/**
+ * @file
+ *
+ * This file contains the epoll demultiplexer implementation.
+ */
+
+#include "epoll-demultiplexer.h"
+
+#ifdef HAVE_EPOLL
+
+#include <unistd.h>
+
+/**
+ * Maximum number of events fetched per wakeup.
+ */
+#define MAX_EVENTS 256
+
+namespace fusenet {
+
+  EpollDemultiplexer::EpollDemultiplexer(bool edgeTriggered) {
+    this->edgeTriggered = edgeTriggered;
+    epollDescriptor = epoll_create(MAX_EVENTS);
+    readyEvents.resize(MAX_EVENTS);
+  }
+
+  uint32_t EpollDemultiplexer::translate(int events) const {
+    uint32_t flags = 0;
+
+    if (events & EVENT_READ) {
+      flags |= EPOLLIN;
+    }
+
+    if (events & EVENT_WRITE) {
+      flags |= EPOLLOUT;
+    }
+
+    if (edgeTriggered) {
+      flags |= EPOLLET;
+    }
+
+    return flags;
+  }
+
+  bool EpollDemultiplexer::add(int descriptor, int events) {
+    struct epoll_event event;
+
+    if (epollDescriptor == -1) {
+      return false;
+    }
+
+    event.events = translate(events);
+    event.data.fd = descriptor;
+
+    return epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) == 0;
+  }
+
+  bool EpollDemultiplexer::modify(int descriptor, int events) {
+    struct epoll_event event;
+
+    event.events = translate(events);
+    event.data.fd = descriptor;
+
+    // Modifying also re-arms an edge-triggered descriptor, so events
+    // that are already pending are reported again
+    return epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, descriptor, &event) == 0;
+  }
+
+  void EpollDemultiplexer::remove(int descriptor) {
+    struct epoll_event event;
+
+    // Closing a descriptor removes it implicitly, so errors are
+    // expected and ignored. The event argument is needed by old
+    // kernels.
+    epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, &event);
+  }
+
+  bool EpollDemultiplexer::wait(EventList_t& eventList) {
+    int n;
+    int i;
+
+    eventList.clear();
+    n = epoll_wait(epollDescriptor, &readyEvents[0], readyEvents.size(), -1);
+
+    if (n == -1) {
+      return false;
+    }
+
+    for (i = 0; i < n; i++) {
+      Event_t event;
+
+      event.descriptor = readyEvents[i].data.fd;
+      event.events = 0;
+
+      // Errors and hang ups are reported as readable, so that the
+      // following read discovers them
+      if (readyEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+	event.events |= EVENT_READ;
+      }
+
+      if (readyEvents[i].events & EPOLLOUT) {
+	event.events |= EVENT_WRITE;
+      }
+
+      eventList.push_back(event);
+    }
+
+    return true;
+  }
+
+  bool EpollDemultiplexer::isEdgeTriggered(void) const {
+    return edgeTriggered;
+  }
+
+  const char* EpollDemultiplexer::getName(void) const {
+    return edgeTriggered ? "epoll (edge-triggered)" : "epoll (level-triggered)";
+  }
+
+  EpollDemultiplexer::~EpollDemultiplexer(void) {
+    if (epollDescriptor != -1) {
+      close(epollDescriptor);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef EPOLL_DEMULTIPLEXER_H
+#define EPOLL_DEMULTIPLEXER_H
+
+/**
+ * @file
+ *
+ * This file contains the epoll demultiplexer interface. The epoll
+ * facility only exists on Linux, HAVE_EPOLL tells whether this
+ * backend is compiled in.
+ */
+
+#ifdef __linux__
+#define HAVE_EPOLL
+#endif
+
+#ifdef HAVE_EPOLL
+
+#include <sys/epoll.h>
+
+#include "demultiplexer.h"
+
+namespace fusenet {
+
+  /**
+   * Demultiplexer based on Linux' epoll. Descriptors are registered
+   * with the kernel once, and a wakeup only costs in proportion to
+   * the number of ready descriptors. It can run either level- or
+   * edge-triggered.
+   */
+  class EpollDemultiplexer : public Demultiplexer {
+
+  public:
+
+    /**
+     * Create instance.
+     *
+     * @param edgeTriggered true to use edge-triggered notification
+     */
+    EpollDemultiplexer(bool edgeTriggered);
+
+    /**
+     * Register a descriptor.
+     */
+    bool add(int descriptor, int events);
+
+    /**
+     * Change the events to wait for on a registered descriptor.
+     */
+    bool modify(int descriptor, int events);
+
+    /**
+     * Unregister a descriptor.
+     */
+    void remove(int descriptor);
+
+    /**
+     * Block until at least one registered descriptor is ready.
+     */
+    bool wait(EventList_t& eventList);
+
+    /**
+     * Is demultiplexer edge-triggered.
+     */
+    bool isEdgeTriggered(void) const;
+
+    /**
+     * Demultiplexer name.
+     */
+    const char* getName(void) const;
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~EpollDemultiplexer(void);
+
+  private:
+
+    /**
+     * Translate an event mask to epoll flags.
+     */
+    uint32_t translate(int events) const;
+
+    /**
+     * The epoll descriptor.
+     */
+    int epollDescriptor;
+
+    /**
+     * Use edge-triggered notification.
+     */
+    bool edgeTriggered;
+
+    /**
+     * Ready events returned by the kernel.
+     */
+    std::vector<struct epoll_event> readyEvents;
+  };
+}
+
+#endif
+
+#endif
@@ -4,19 +4,29 @@
  * This file contains the filesystem database implementation.
  */
 
-#include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 
 #include "filesystem-database.h"
+#include "log.h"
+#include "record.h"
 
 #define THIS_CANNOT_HAPPEN (0 == "This cannot happen")
 
@@ -37,6 +47,16 @@ namespace fusenet {
    */
   const std::string lastFilename = "last";
 
+  /**
+   * Index filename for the sorted article identifiers of a newsgroup.
+   */
+  const std::string indexFilename = "index";
+
+  /**
+   * Filename a new index is written to before it replaces the old.
+   */
+  const std::string newIndexFilename = "index.new";
+
   /**
    * Standard directory mode.
    */
@@ -47,6 +67,27 @@ namespace fusenet {
    */
   const int fileMode = 0644;
 
+  /**
+   * Article files at least this large are mapped rather than read.
+   */
+  const size_t mapThreshold = 64 * 1024;
+
+  /**
+   * Number of bytes read to find the lines in front of a text that is
+   * left in its file.
+   */
+  const size_t headerBlockSize = 4096;
+
+  /**
+   * Number of identifiers read from an index at a time.
+   */
+  const size_t indexBlockSize = 512;
+
+  /**
+   * Article identifiers as stored in an index, in increasing order.
+   */
+  typedef std::vector<int32_t> Index_t;
+
   /**
    * Base class for visitors.
    */
@@ -96,75 +137,337 @@ namespace fusenet {
     return baseDirectory + numberString.str() + "/";
   }
 
+  /**
+   * Get article filename, relative to its newsgroup.
+   */
+  std::string GetArticleFilename(int articleIdentifier) {
+    std::ostringstream numberString;
+    numberString << articleIdentifier;
+    return numberString.str();
+  }
+
   /**
    * Get article path.
    */
   std::string GetArticlePath(int newsgroupIdentifier,
 			     int articleIdentifier) {
-    std::ostringstream numberString;
-    numberString << articleIdentifier;
-    return GetNewsgroupPath(newsgroupIdentifier) + numberString.str();
+    return GetNewsgroupPath(newsgroupIdentifier) + GetArticleFilename(articleIdentifier);
+  }
+
+  /**
+   * Check if a file in a newsgroup directory is an article.
+   */
+  bool IsArticleFilename(const std::string& filename) {
+    return filename != metaFilename && filename != lastFilename &&
+      filename != indexFilename && filename != newIndexFilename;
+  }
+
+  /**
+   * Parse the lines in front of the text of an article file. The
+   * file holds the title and the author on a line each, then the size
+   * of the text on a line of its own, then the text.
+   *
+   * @param data the start of the file
+   * @param size the number of bytes at data
+   * @param fileSize the size of the whole file
+   * @param article where to store the title and author
+   * @param textOffset where to store where the text starts
+   * @param textSize where to store the size of the text
+   * @return false if the file is malformed, or if data does not hold
+   * all of the lines
+   */
+  bool ParseArticleHeader(const char* data, size_t size, size_t fileSize,
+			  Article_t& article, size_t& textOffset, size_t& textSize) {
+    const char* end = data + size;
+    const char* titleEnd;
+    const char* authorEnd;
+    const char* sizeEnd;
+    unsigned long n;
+    char* parsed;
+
+    titleEnd = static_cast<const char*>(memchr(data, '\n', end - data));
+
+    if (titleEnd == NULL) {
+      return false;
+    }
+
+    authorEnd = static_cast<const char*>(memchr(titleEnd + 1, '\n', end - titleEnd - 1));
+
+    if (authorEnd == NULL) {
+      return false;
+    }
+
+    sizeEnd = static_cast<const char*>(memchr(authorEnd + 1, '\n', end - authorEnd - 1));
+
+    if (sizeEnd == NULL) {
+      return false;
+    }
+
+    n = strtoul(authorEnd + 1, &parsed, 10);
+    textOffset = sizeEnd + 1 - data;
+
+    if (parsed != sizeEnd || n > fileSize - textOffset) {
+      return false;
+    }
+
+    article.title.assign(data, titleEnd - data);
+    article.author.assign(titleEnd + 1, authorEnd - titleEnd - 1);
+    textSize = n;
+    return true;
+  }
+
+  /**
+   * Parse an article file held in memory.
+   */
+  bool ParseArticle(const char* data, size_t size, Article_t& article) {
+    size_t textOffset;
+    size_t textSize;
+
+    if (!ParseArticleHeader(data, size, size, article, textOffset, textSize)) {
+      return false;
+    }
+
+    article.text.assign(data + textOffset, textSize);
+    return true;
+  }
+
+  /**
+   * Owner of an article whose text is left in its file. Keeps the
+   * title and author, and the file open. Also owns articles read
+   * into memory, with no file kept open.
+   */
+  class ArticleFile : public Shared {
+
+  public:
+
+    /**
+     * Create instance, taking over an open file.
+     */
+    ArticleFile(int descriptor) {
+      this->descriptor = descriptor;
+    }
+
+    /**
+     * The title and author.
+     */
+    Article_t article;
+
+    /**
+     * The file, or -1.
+     */
+    int descriptor;
+
+  protected:
+
+    /**
+     * Close the file.
+     */
+    ~ArticleFile(void) {
+      if (descriptor != -1) {
+	close(descriptor);
+      }
+    }
+  };
+
+  /**
+   * Read article from an open file of a given size. Small files are
+   * read with a single read, large ones are mapped, so that the text
+   * is copied once straight into the article.
+   */
+  bool ReadArticleFile(int fd, size_t size, Article_t& article) {
+    bool parsed = false;
+    void* mapping;
+
+    if (size < mapThreshold) {
+      char buffer[mapThreshold];
+
+      if (ReadFully(fd, buffer, size, 0)) {
+	parsed = ParseArticle(buffer, size, article);
+      }
+    } else {
+      mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (mapping != MAP_FAILED) {
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	parsed = ParseArticle(static_cast<const char*>(mapping), size, article);
+	munmap(mapping, size);
+      }
+    }
+
+    return parsed;
   }
 
   /**
    * Read article from path.
    */
   bool ReadArticle(std::string& path, Article_t& article) {
-    std::ifstream articleStream;
-    char byte;
-    int i;
-    int n;
+    struct stat status;
+    bool parsed = false;
+    int fd;
 
-    articleStream.open(path.c_str());
-    assert(articleStream);
+    fd = open(path.c_str(), O_RDONLY);
 
-    // Read title and author
-    getline(articleStream, article.title);
-    getline(articleStream, article.author);
+    if (fd < 0) {
+      return false;
+    }
 
-    // Read number of bytes
-    articleStream >> n;
+    if (fstat(fd, &status) == 0) {
+      parsed = ReadArticleFile(fd, status.st_size, article);
+    }
 
-    // Skip white space trick
-    articleStream >> byte;
-    article.text = byte;
-    articleStream >> std::noskipws;
+    close(fd);
+    return parsed;
+  }
 
-    // Read n - 1 bytes
-    for (i = 1; i < n; i++) {
-      articleStream.get(byte);
-      article.text += byte;
+  /**
+   * Refer to an article in an open file, which the reference takes
+   * over. Texts of at least threshold bytes are left in the file,
+   * unless threshold is zero, and smaller ones are read into memory.
+   *
+   * @return false if the file could not be read
+   */
+  bool ReferArticleFile(int fd, int articleIdentifier, size_t threshold,
+			ArticleRef& article) {
+    ArticleFile* file = new ArticleFile(fd);
+    char block[headerBlockSize];
+    struct stat status;
+    size_t textOffset;
+    size_t textSize;
+    bool found = false;
+    ssize_t n;
+
+    file->article.id = articleIdentifier;
+
+    if (fstat(fd, &status) != 0) {
+      file->release();
+      return false;
     }
 
-    articleStream.close();
-    return true;
+    if (threshold > 0 && static_cast<size_t>(status.st_size) >= threshold) {
+      n = pread(fd, block, sizeof(block), 0);
+
+      // Headers too long for the block are read along with the text
+      if (n > 0 && ParseArticleHeader(block, n, status.st_size, file->article,
+				      textOffset, textSize)) {
+	article.setFile(file, articleIdentifier,
+			file->article.title.data(), file->article.title.size(),
+			file->article.author.data(), file->article.author.size(),
+			fd, textOffset, textSize);
+	found = true;
+      }
+    }
+
+    if (!found && ReadArticleFile(fd, status.st_size, file->article)) {
+      // The text is in memory, so the file is not needed any more
+      close(fd);
+      file->descriptor = -1;
+      article.set(file, articleIdentifier,
+		  file->article.title.data(), file->article.title.size(),
+		  file->article.author.data(), file->article.author.size(),
+		  file->article.text.data(), file->article.text.size());
+      found = true;
+    }
+
+    file->release();
+    return found;
   }
 
   /**
-   * Write article from path.
+   * Read the header of an article in an open newsgroup directory.
+   *
+   * @return false if there is no such article, or it can not be
+   * parsed
    */
-  bool WriteArticle(std::string& path, Article_t& article) {
-    std::ofstream articleStream;
-    int i;
-    int n;
+  bool ReadArticleHeaderAt(int directory, int articleIdentifier,
+			   ArticleHeader_t& header) {
+    char block[headerBlockSize];
+    struct stat status;
+    Article_t article;
+    size_t textOffset;
+    size_t textSize;
+    bool found = false;
+    ssize_t n;
+    int fd;
+
+    fd = openat(directory, GetArticleFilename(articleIdentifier).c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return false;
+    }
 
-    articleStream.open(path.c_str());
-    assert(articleStream);
+    if (fstat(fd, &status) == 0) {
+      n = pread(fd, block, sizeof(block), 0);
 
-    // Write title and author
-    articleStream << article.title << std::endl;
-    articleStream << article.author << std::endl;
+      if (n > 0 && ParseArticleHeader(block, n, status.st_size, article,
+				      textOffset, textSize)) {
+	found = true;
+      } else if (ReadArticleFile(fd, status.st_size, article)) {
+	// Headers too long for the block
+	textSize = article.text.size();
+	found = true;
+      }
+    }
 
-    // Write text
-    n = article.text.length();
-    articleStream << n << std::endl;
+    close(fd);
 
-    for (i = 0; i < n; i++) {
-      articleStream << article.text[i];
+    if (found) {
+      header.id = articleIdentifier;
+      header.title.swap(article.title);
+      header.author.swap(article.author);
+      header.size = textSize;
     }
 
-    articleStream.close();
-    return true;
+    return found;
+  }
+
+  /**
+   * Write article to path. The lines in front of the text are
+   * formatted on their own and written along with the text in a
+   * single call, without copying the text.
+   */
+  bool WriteArticle(std::string& path, Article_t& article) {
+    std::ostringstream headerStream;
+    std::string header;
+    struct iovec parts[2];
+    ssize_t written;
+    size_t total;
+    bool complete;
+    int fd;
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, fileMode);
+
+    if (fd < 0) {
+      return false;
+    }
+
+    // Title, author and number of bytes
+    headerStream << article.title << '\n'
+		 << article.author << '\n'
+		 << article.text.length() << '\n';
+    header = headerStream.str();
+
+    parts[0].iov_base = const_cast<char*>(header.data());
+    parts[0].iov_len = header.size();
+    parts[1].iov_base = const_cast<char*>(article.text.data());
+    parts[1].iov_len = article.text.size();
+    total = header.size() + article.text.size();
+    written = writev(fd, parts, 2);
+
+    if (written < 0) {
+      complete = false;
+    } else if (static_cast<size_t>(written) == total) {
+      complete = true;
+    } else if (static_cast<size_t>(written) < header.size()) {
+      // Short write, finish the rest the slow way
+      complete = WriteFully(fd, header.data() + written, header.size() - written) &&
+	WriteFully(fd, article.text.data(), article.text.size());
+    } else {
+      written -= header.size();
+      complete = WriteFully(fd, article.text.data() + written, article.text.size() - written);
+    }
+
+    close(fd);
+    return complete;
   }
 
   /**
@@ -244,6 +547,31 @@ namespace fusenet {
     return next;
   }
 
+  /**
+   * Get the last filename number handed out in a directory, or -1 if
+   * none has been.
+   */
+  int GetLastNumber(const std::string& directory) {
+    std::ifstream lastStream((directory + lastFilename).c_str());
+    int last = -1;
+
+    if (lastStream) {
+      lastStream >> last;
+    }
+
+    return last;
+  }
+
+  /**
+   * Get the version of a directory of numbered entries. Every number
+   * handed out counts once for the entry created and once more if it
+   * is gone, so the version follows from the last number and the
+   * number of entries left, both of which are already on disk.
+   */
+  Version_t GetVersion(int last, size_t count) {
+    return 2 * (last + 1) - count + 1;
+  }
+
   /**
    * Fetches all newsgroups.
    */
@@ -289,7 +617,7 @@ namespace fusenet {
       Article_t article;
       std::string path = directory + filename;
       
-      if (filename != metaFilename && filename != lastFilename) {
+      if (IsArticleFilename(filename)) {
 	if (ReadArticle(path, article)) {
 	  article.id = atoi(filename.c_str());
 	  articleList->push_back(article);
@@ -298,6 +626,31 @@ namespace fusenet {
     }
   };
 
+  /**
+   * Fetches all article headers.
+   */
+  class ArticleHeaderListVisitor : public Visitor {
+  private:
+    ArticleHeaderList_t* headerList;
+    int descriptor;
+  public:
+    ArticleHeaderListVisitor(ArticleHeaderList_t& headerList, int descriptor) {
+      this->headerList = &headerList;
+      this->descriptor = descriptor;
+    }
+    
+    void visit(const std::string& /* directory */,
+	       const std::string& filename) {
+      ArticleHeader_t header;
+      
+      if (IsArticleFilename(filename)) {
+	if (ReadArticleHeaderAt(descriptor, atoi(filename.c_str()), header)) {
+	  headerList->push_back(header);
+	}
+      }
+    }
+  };
+
   /**
    * Clearing visitor.
    */
@@ -319,10 +672,367 @@ namespace fusenet {
     }
   };
 
+  /**
+   * Collects the identifiers of all articles.
+   */
+  class IndexVisitor : public Visitor {
+  private:
+    Index_t* index;
+  public:
+    IndexVisitor(Index_t& index) {
+      this->index = &index;
+    }
+
+    void visit(const std::string&,
+	       const std::string& filename) {
+      if (IsArticleFilename(filename)) {
+	index->push_back(atoi(filename.c_str()));
+      }
+    }
+  };
+
+  /**
+   * Read the whole index of a newsgroup.
+   */
+  bool ReadIndex(const std::string& newsgroupPath, Index_t& index) {
+    struct stat status;
+    bool complete = false;
+    int fd;
+
+    fd = open((newsgroupPath + indexFilename).c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return false;
+    }
+
+    if (fstat(fd, &status) == 0) {
+      index.resize(status.st_size / sizeof(int32_t));
+      complete = index.empty() ||
+	ReadFully(fd, reinterpret_cast<char*>(&index[0]),
+		  index.size() * sizeof(int32_t), 0);
+    }
+
+    close(fd);
+    return complete;
+  }
+
+  /**
+   * Replace the index of a newsgroup. The new index is written next
+   * to the old one and renamed over it, so that readers see either.
+   */
+  bool WriteIndex(const std::string& newsgroupPath, const Index_t& index) {
+    std::string path = newsgroupPath + newIndexFilename;
+    bool complete;
+    int fd;
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, fileMode);
+
+    if (fd < 0) {
+      return false;
+    }
+
+    complete = index.empty() ||
+      WriteFully(fd, reinterpret_cast<const char*>(&index[0]),
+		 index.size() * sizeof(int32_t));
+    close(fd);
+
+    return complete && rename(path.c_str(), (newsgroupPath + indexFilename).c_str()) == 0;
+  }
+
+  /**
+   * Add a new article to the index of a newsgroup. New articles have
+   * the largest identifiers, so appending keeps the index sorted.
+   */
+  bool AppendIndex(const std::string& newsgroupPath, int articleIdentifier) {
+    int32_t entry = articleIdentifier;
+    bool complete;
+    int fd;
+
+    fd = open((newsgroupPath + indexFilename).c_str(), O_WRONLY | O_APPEND);
+
+    if (fd < 0) {
+      return false;
+    }
+
+    complete = WriteFully(fd, reinterpret_cast<const char*>(&entry), sizeof(entry));
+    close(fd);
+    return complete;
+  }
+
+  /**
+   * Remove a deleted article from the index of a newsgroup.
+   */
+  bool RemoveIndex(const std::string& newsgroupPath, int articleIdentifier) {
+    Index_t::iterator i;
+    Index_t index;
+
+    if (!ReadIndex(newsgroupPath, index)) {
+      return false;
+    }
+
+    i = std::lower_bound(index.begin(), index.end(), articleIdentifier);
+
+    if (i == index.end() || *i != articleIdentifier) {
+      return true;
+    }
+
+    index.erase(i);
+    return WriteIndex(newsgroupPath, index);
+  }
+
+  /**
+   * Make sure a newsgroup has an index that covers all its articles.
+   * Newsgroups made before there were indexes get one built from the
+   * directory. An article whose creation was cut short before it got
+   * into the index can only be the last one, so that is the only one
+   * checked for.
+   */
+  bool RepairIndex(const std::string& newsgroupPath) {
+    std::ifstream lastStream;
+    Index_t index;
+    int last = -1;
+
+    if (!ReadIndex(newsgroupPath, index)) {
+      IndexVisitor indexVisitor(index);
+
+      index.clear();
+
+      if (!Walk(newsgroupPath, indexVisitor)) {
+	return false;
+      }
+
+      std::sort(index.begin(), index.end());
+      return WriteIndex(newsgroupPath, index);
+    }
+
+    lastStream.open((newsgroupPath + lastFilename).c_str());
+    lastStream >> last;
+
+    if (last >= 0 && (index.empty() || index.back() < last) &&
+	PathAvailable(newsgroupPath + GetArticleFilename(last))) {
+      return AppendIndex(newsgroupPath, last);
+    }
+
+    return true;
+  }
+
+  /**
+   * Reads the identifiers of an open index, a block at a time.
+   */
+  class IndexReader {
+  public:
+    IndexReader(int fd, size_t count) :
+      fd(fd), count(count), blockStart(0), blockSize(0) { }
+
+    /**
+     * Number of identifiers in the index.
+     */
+    size_t size(void) const {
+      return count;
+    }
+
+    /**
+     * Read the identifier at a position, less than size().
+     */
+    bool read(size_t position, int& articleIdentifier) {
+      if (position < blockStart || position >= blockStart + blockSize) {
+	ssize_t n;
+
+	blockStart = position - position % indexBlockSize;
+	n = pread(fd, block, sizeof(block), blockStart * sizeof(int32_t));
+	blockSize = n > 0 ? n / sizeof(int32_t) : 0;
+
+	if (position >= blockStart + blockSize) {
+	  return false;
+	}
+      }
+
+      articleIdentifier = block[position - blockStart];
+      return true;
+    }
+
+    /**
+     * Number of identifiers of at most a given one, found by binary
+     * search.
+     */
+    size_t upperBound(int articleIdentifier) {
+      size_t low = 0;
+      size_t high = count;
+      int found;
+
+      while (low < high) {
+	size_t middle = low + (high - low) / 2;
+
+	if (!read(middle, found)) {
+	  return count;
+	}
+
+	if (found <= articleIdentifier) {
+	  low = middle + 1;
+	} else {
+	  high = middle;
+	}
+      }
+
+      return low;
+    }
+
+  private:
+    int fd;
+    size_t count;
+    int32_t block[indexBlockSize];
+    size_t blockStart;
+    size_t blockSize;
+  };
+
+  /**
+   * Sync a file or directory to disk. A path that no longer exists
+   * counts as synced, since it was removed by a later change whose
+   * directory is synced instead.
+   */
+  bool SyncPath(const std::string& path) {
+    int fd;
+    bool synced;
+
+    fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return errno == ENOENT;
+    }
+
+    synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+  }
 
   FilesystemDatabase::FilesystemDatabase(void) {
+    initialize(SYNC_NONE, 0);
+  }
+
+  FilesystemDatabase::FilesystemDatabase(SyncPolicy_t policy, int window) {
+    initialize(policy, window);
+  }
+
+  void FilesystemDatabase::initialize(SyncPolicy_t policy, int window) {
+    fileThreshold = 0;
+    this->policy = policy;
+    this->window = window;
+    pthread_mutex_init(&commitMutex, NULL);
+    pthread_cond_init(&committed, NULL);
+    changes = 0;
+    durable = 0;
+    broken = ULONG_MAX;
+    committing = false;
+
     // Ignore error code, we cannot do anything anyway
     mkdir(baseDirectory.c_str(), directoryMode);
+    loadNewsgroups();
+  }
+
+  void FilesystemDatabase::changed(const PathSet_t& paths) {
+    if (policy == SYNC_NONE) {
+      return;
+    }
+
+    pthread_mutex_lock(&commitMutex);
+    pending.insert(paths.begin(), paths.end());
+    changes++;
+    pthread_mutex_unlock(&commitMutex);
+  }
+
+  Status_t FilesystemDatabase::commit(void) {
+    Status_t status = STATUS_SUCCESS;
+    unsigned long target;
+
+    if (policy == SYNC_NONE) {
+      return STATUS_SUCCESS;
+    }
+
+    pthread_mutex_lock(&commitMutex);
+    target = changes;
+
+    while (durable < target) {
+      PathSet_t batch;
+      PathSet_t::iterator i;
+      unsigned long end;
+      bool synced = true;
+
+      if (broken < target) {
+	status = STATUS_FAILURE;
+	break;
+      }
+
+      // Someone else is syncing, see if that covers our changes
+      if (committing) {
+	pthread_cond_wait(&committed, &commitMutex);
+	continue;
+      }
+
+      committing = true;
+
+      // Give concurrent changes a chance to join this round
+      if (policy == SYNC_INTERVAL) {
+	struct timespec delay;
+
+	delay.tv_sec = window / 1000;
+	delay.tv_nsec = (window % 1000) * 1000000L;
+	pthread_mutex_unlock(&commitMutex);
+	nanosleep(&delay, NULL);
+	pthread_mutex_lock(&commitMutex);
+      }
+
+      batch.swap(pending);
+      end = changes;
+      pthread_mutex_unlock(&commitMutex);
+
+      for (i = batch.begin(); i != batch.end(); i++) {
+	if (!SyncPath(*i)) {
+	  LOG(LOG_LEVEL_ERROR) << "[FilesystemDatabase] Failed to sync " << *i
+			       << ": " << strerror(errno);
+	  synced = false;
+	}
+      }
+
+      pthread_mutex_lock(&commitMutex);
+
+      if (synced) {
+	durable = end;
+      } else if (broken == ULONG_MAX) {
+	broken = durable;
+      }
+
+      committing = false;
+      pthread_cond_broadcast(&committed);
+    }
+
+    pthread_mutex_unlock(&commitMutex);
+    return status;
+  }
+
+  void FilesystemDatabase::loadNewsgroups(void) {
+    NewsgroupList_t newsgroupList;
+    NewsgroupListVisitor listVisitor(newsgroupList);
+    NewsgroupList_t::iterator i;
+
+    newsgroupNames.clear();
+    newsgroupIdentifiers.clear();
+    Walk(baseDirectory, listVisitor);
+
+    for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
+      newsgroupNames[i->id] = i->name;
+      newsgroupIdentifiers[i->name] = i->id;
+
+      if (!RepairIndex(GetNewsgroupPath(i->id))) {
+	LOG(LOG_LEVEL_ERROR) << "[FilesystemDatabase] Failed to index newsgroup "
+			     << i->id;
+      }
+    }
+
+    listVersion = GetVersion(GetLastNumber(baseDirectory), newsgroupNames.size());
+  }
+
+  bool FilesystemDatabase::newsgroupExists(int newsgroupIdentifier) const {
+    return newsgroupNames.find(newsgroupIdentifier) != newsgroupNames.end();
   }
 
   Status_t FilesystemDatabase::clear(void) {
@@ -333,37 +1043,83 @@ namespace fusenet {
       status = STATUS_SUCCESS;
     }
 
+    loadNewsgroups();
     return status;
   }
 
   Status_t FilesystemDatabase::getNewsgroupList(NewsgroupList_t& newsgroupList) {
-    Status_t status = STATUS_FAILURE;
-    NewsgroupListVisitor listVisitor(newsgroupList);
+    NameMap_t::iterator i;
 
-    if (Walk(baseDirectory, listVisitor)) {
-      status = STATUS_SUCCESS;
+    for (i = newsgroupNames.begin(); i != newsgroupNames.end(); i++) {
+      Newsgroup_t newsgroup;
+
+      newsgroup.id = i->first;
+      newsgroup.name = i->second;
+      newsgroupList.push_back(newsgroup);
     }
 
-    return status;
+    return STATUS_SUCCESS;
+  }
+
+  Status_t FilesystemDatabase::checkNewsgroup(int newsgroupIdentifier) {
+    if (!newsgroupExists(newsgroupIdentifier)) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    return STATUS_SUCCESS;
   }
   
+  Status_t FilesystemDatabase::getNewsgroupListVersion(Version_t& version) {
+    version = listVersion;
+    return STATUS_SUCCESS;
+  }
+
+  Status_t FilesystemDatabase::getNewsgroupVersion(int newsgroupIdentifier,
+						   Version_t& version) {
+    std::string newsgroupPath;
+    struct stat status;
+
+    if (!newsgroupExists(newsgroupIdentifier)) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    newsgroupPath = GetNewsgroupPath(newsgroupIdentifier);
+
+    // The index holds one identifier per article
+    if (stat((newsgroupPath + indexFilename).c_str(), &status) != 0) {
+      version = VERSION_NONE;
+    } else {
+      version = GetVersion(GetLastNumber(newsgroupPath),
+			   status.st_size / sizeof(int32_t));
+    }
+
+    return STATUS_SUCCESS;
+  }
+
   Status_t FilesystemDatabase::createNewsgroup(std::string& newsgroupName) {
     Status_t status = STATUS_FAILURE;
-    NewsgroupList_t newsgroupList;
-    NewsgroupList_t::iterator i;
+    PathSet_t touched;
     std::string path;
+    int newsgroupIdentifier;
     
-    if (IS_SUCCESS(getNewsgroupList(newsgroupList))) {
-      for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
-	if (newsgroupName == (*i).name) {
-	  return STATUS_FAILURE_ALREADY_EXISTS;
-	}
-      }
+    if (newsgroupIdentifiers.find(newsgroupName) != newsgroupIdentifiers.end()) {
+      return STATUS_FAILURE_ALREADY_EXISTS;
     }
     
-    path = GetNewsgroupPath(GetNextNumber(baseDirectory));
+    newsgroupIdentifier = GetNextNumber(baseDirectory);
+    path = GetNewsgroupPath(newsgroupIdentifier);
     assert(mkdir(path.c_str(), directoryMode) == 0);
     WriteNewsgroupName(path, newsgroupName);
+    WriteIndex(path, Index_t());
+    newsgroupNames[newsgroupIdentifier] = newsgroupName;
+    newsgroupIdentifiers[newsgroupName] = newsgroupIdentifier;
+    touched.insert(path + metaFilename);
+    touched.insert(path + indexFilename);
+    touched.insert(path);
+    touched.insert(baseDirectory + lastFilename);
+    touched.insert(baseDirectory);
+    changed(touched);
+    listVersion++;
     status = STATUS_SUCCESS;
 
     return status;
@@ -371,14 +1127,20 @@ namespace fusenet {
 
   Status_t FilesystemDatabase::deleteNewsgroup(int newsgroupIdentifier) {
     Status_t status = STATUS_FAILURE;
+    PathSet_t touched;
     std::string newsgroupPath;
     ClearVisitor clearVisitor;
 
     newsgroupPath = GetNewsgroupPath(newsgroupIdentifier);
 
-    if (PathAvailable(newsgroupPath)) {
+    if (newsgroupExists(newsgroupIdentifier)) {
       if (Walk(newsgroupPath, clearVisitor)) {
 	assert(rmdir(newsgroupPath.c_str()) == 0);
+	newsgroupIdentifiers.erase(newsgroupNames[newsgroupIdentifier]);
+	newsgroupNames.erase(newsgroupIdentifier);
+	touched.insert(baseDirectory);
+	changed(touched);
+	listVersion++;
 	status = STATUS_SUCCESS;
       }
     } else {
@@ -396,7 +1158,7 @@ namespace fusenet {
 
     newsgroupPath = GetNewsgroupPath(newsgroupIdentifier);
 
-    if (PathAvailable(newsgroupPath)) {
+    if (newsgroupExists(newsgroupIdentifier)) {
       if (Walk(GetNewsgroupPath(newsgroupIdentifier), listVisitor)) {
 	status = STATUS_SUCCESS;
       }
@@ -407,21 +1169,139 @@ namespace fusenet {
     return status;
   }
 
+  Status_t FilesystemDatabase::listArticleHeaders(int newsgroupIdentifier,
+						  ArticleHeaderList_t& headerList) {
+    Status_t status = STATUS_FAILURE;
+    std::string newsgroupPath;
+    int directory;
+
+    newsgroupPath = GetNewsgroupPath(newsgroupIdentifier);
+
+    if (newsgroupExists(newsgroupIdentifier)) {
+      directory = open(newsgroupPath.c_str(), O_RDONLY | O_DIRECTORY);
+
+      if (directory >= 0) {
+	ArticleHeaderListVisitor listVisitor(headerList, directory);
+
+	if (Walk(newsgroupPath, listVisitor)) {
+	  status = STATUS_SUCCESS;
+	}
+
+	close(directory);
+      }
+    } else {
+      status = STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    return status;
+  }
+
+  Status_t FilesystemDatabase::listArticlePage(int newsgroupIdentifier,
+					       int cursor,
+					       ListDirection_t direction,
+					       size_t maxCount,
+					       ArticleHeaderList_t& headerList,
+					       int& nextCursor) {
+    struct stat status;
+    size_t found = 0;
+    long position;
+    long count;
+    long step;
+    int directory;
+    int index;
+
+    nextCursor = CURSOR_NONE;
+
+    if (!newsgroupExists(newsgroupIdentifier)) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    directory = open(GetNewsgroupPath(newsgroupIdentifier).c_str(),
+		     O_RDONLY | O_DIRECTORY);
+
+    if (directory < 0) {
+      return STATUS_FAILURE;
+    }
+
+    index = openat(directory, indexFilename.c_str(), O_RDONLY);
+
+    if (index < 0 || fstat(index, &status) != 0) {
+      if (index >= 0) {
+	close(index);
+      }
+
+      close(directory);
+      return Database::listArticlePage(newsgroupIdentifier, cursor, direction,
+				       maxCount, headerList, nextCursor);
+    }
+
+    IndexReader reader(index, status.st_size / sizeof(int32_t));
+
+    // The page starts right next to the cursor
+    count = static_cast<long>(reader.size());
+
+    if (direction == LIST_FORWARD) {
+      position = cursor < 0 ? 0 : reader.upperBound(cursor);
+      step = 1;
+    } else {
+      position = (cursor < 0 ? count : reader.upperBound(cursor - 1)) - 1;
+      step = -1;
+    }
+
+    for (; position >= 0 && position < count; position += step) {
+      ArticleHeader_t header;
+      int articleIdentifier;
+
+      if (!reader.read(position, articleIdentifier)) {
+	break;
+      }
+
+      // Entries of articles that are gone are skipped
+      if (found == maxCount) {
+	if (faccessat(directory, GetArticleFilename(articleIdentifier).c_str(), F_OK, 0) == 0) {
+	  nextCursor = found > 0 ? headerList.back().id : cursor;
+	  break;
+	}
+      } else if (ReadArticleHeaderAt(directory, articleIdentifier, header)) {
+	headerList.push_back(header);
+	found++;
+      }
+    }
+
+    close(index);
+    close(directory);
+    return STATUS_SUCCESS;
+  }
+
   Status_t FilesystemDatabase::createArticle(int newsgroupIdentifier,
 					     Article_t& article) {
     Status_t status = STATUS_FAILURE;
+    PathSet_t touched;
+    std::string newsgroupPath;
     std::string path;
+    int articleIdentifier;
 
-    path = GetNewsgroupPath(newsgroupIdentifier);
+    newsgroupPath = GetNewsgroupPath(newsgroupIdentifier);
     
-    if (PathAvailable(path)) {
-      path = GetArticlePath(newsgroupIdentifier, GetNextNumber(path));
+    if (newsgroupExists(newsgroupIdentifier)) {
+      articleIdentifier = GetNextNumber(newsgroupPath);
+      path = GetArticlePath(newsgroupIdentifier, articleIdentifier);
 
       if (!PathAvailable(path)) {
-	if (WriteArticle(path, article)) {
-	  status = STATUS_SUCCESS;
-	} else {
+	if (!WriteArticle(path, article)) {
 	  status = STATUS_FAILURE;
+	} else if (!AppendIndex(newsgroupPath, articleIdentifier)) {
+	  // An article missing from the index would not be listed
+	  unlink(path.c_str());
+	  status = STATUS_FAILURE;
+	} else {
+	  touched.insert(path);
+	  touched.insert(newsgroupPath + lastFilename);
+	  touched.insert(newsgroupPath + indexFilename);
+	  touched.insert(newsgroupPath);
+	  changed(touched);
+	  article.id = articleIdentifier;
+	  status = STATUS_SUCCESS;
 	}
       } else {
 	status = STATUS_FAILURE_ALREADY_EXISTS;
@@ -436,18 +1316,26 @@ namespace fusenet {
   Status_t FilesystemDatabase::deleteArticle(int newsgroupIdentifier,
 					     int articleIdentifier) {
     Status_t status = STATUS_FAILURE;
+    PathSet_t touched;
     std::string path;
 
     path = GetNewsgroupPath(newsgroupIdentifier);
     
-    if (PathAvailable(path)) {
+    if (newsgroupExists(newsgroupIdentifier)) {
+      touched.insert(path);
+      touched.insert(path + indexFilename);
       path = GetArticlePath(newsgroupIdentifier, articleIdentifier);
 
-      if (PathAvailable(path)) {
+      if (!PathAvailable(path)) {
+	status = STATUS_FAILURE_A_DOES_NOT_EXIST;
+      } else if (!RemoveIndex(GetNewsgroupPath(newsgroupIdentifier), articleIdentifier)) {
+	// The version follows the index, so the article stays until
+	// the index has changed with it
+	status = STATUS_FAILURE;
+      } else {
 	assert(unlink(path.c_str()) == 0);
+	changed(touched);
 	status = STATUS_SUCCESS;
-      } else {
-	status = STATUS_FAILURE_A_DOES_NOT_EXIST;
       }
     } else {
       status = STATUS_FAILURE_N_DOES_NOT_EXIST;
@@ -464,7 +1352,7 @@ namespace fusenet {
 
     path = GetNewsgroupPath(newsgroupIdentifier);
     
-    if (PathAvailable(path)) {
+    if (newsgroupExists(newsgroupIdentifier)) {
       path = GetArticlePath(newsgroupIdentifier, articleIdentifier);
 
       if (PathAvailable(path)) {
@@ -483,7 +1371,99 @@ namespace fusenet {
     return status;
   }
 
+  Status_t FilesystemDatabase::getArticleRef(int newsgroupIdentifier,
+					     int articleIdentifier,
+					     ArticleRef& article) {
+    char block[headerBlockSize];
+    struct stat status;
+    ArticleFile* file;
+    std::string path;
+    size_t textOffset;
+    size_t textSize;
+    ssize_t n;
+    int fd;
+
+    if (fileThreshold == 0 || !newsgroupExists(newsgroupIdentifier)) {
+      return Database::getArticleRef(newsgroupIdentifier, articleIdentifier, article);
+    }
+
+    path = GetArticlePath(newsgroupIdentifier, articleIdentifier);
+    fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return STATUS_FAILURE_A_DOES_NOT_EXIST;
+    }
+
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < fileThreshold) {
+      close(fd);
+      return Database::getArticleRef(newsgroupIdentifier, articleIdentifier, article);
+    }
+
+    file = new ArticleFile(fd);
+    n = pread(fd, block, sizeof(block), 0);
+
+    // Headers too long for the block take the slow path
+    if (n <= 0 || !ParseArticleHeader(block, n, status.st_size, file->article,
+				      textOffset, textSize)) {
+      file->release();
+      return Database::getArticleRef(newsgroupIdentifier, articleIdentifier, article);
+    }
+
+    file->article.id = articleIdentifier;
+    article.setFile(file, articleIdentifier,
+		    file->article.title.data(), file->article.title.size(),
+		    file->article.author.data(), file->article.author.size(),
+		    fd, textOffset, textSize);
+    file->release();
+    return STATUS_SUCCESS;
+  }
+
+  Status_t FilesystemDatabase::getArticleRefs(int newsgroupIdentifier,
+					      const IdentifierList_t& articleIdentifiers,
+					      ArticleRefList_t& articles,
+					      StatusList_t& statuses) {
+    int directory;
+    size_t i;
+
+    if (!newsgroupExists(newsgroupIdentifier)) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    // Open the newsgroup once, and the articles relative to it
+    directory = open(GetNewsgroupPath(newsgroupIdentifier).c_str(),
+		     O_RDONLY | O_DIRECTORY);
+
+    if (directory < 0) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    articles.resize(articleIdentifiers.size());
+    statuses.resize(articleIdentifiers.size());
+
+    for (i = 0; i < articleIdentifiers.size(); i++) {
+      int fd;
+
+      fd = openat(directory, GetArticleFilename(articleIdentifiers[i]).c_str(), O_RDONLY);
+      statuses[i] = STATUS_FAILURE_A_DOES_NOT_EXIST;
+
+      if (fd >= 0 && ReferArticleFile(fd, articleIdentifiers[i], fileThreshold,
+				      articles[i])) {
+	statuses[i] = STATUS_SUCCESS;
+      } else {
+	articles[i].reset();
+      }
+    }
+
+    close(directory);
+    return STATUS_SUCCESS;
+  }
+
+  void FilesystemDatabase::setFileThreshold(size_t threshold) {
+    fileThreshold = threshold;
+  }
+
   FilesystemDatabase::~FilesystemDatabase(void) {
-    // Does nothing
+    pthread_cond_destroy(&committed);
+    pthread_mutex_destroy(&commitMutex);
   }
 }
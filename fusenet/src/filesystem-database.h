@@ -9,9 +9,14 @@
 
 #include "fusenet-types.h"
 #include "database.h"
+#include "journal.h"
 
+#include <map>
+#include <set>
 #include <string>
 
+#include <pthread.h>
+
 namespace fusenet {
 
   /**
@@ -22,6 +27,8 @@ namespace fusenet {
    * <pre>
    *   db/ --+-- 1/ ---+--- meta
    *         |         |
+   *         |         +--- index
+   *         |         |
    *         |         +--- 1
    *         |         |
    *         |         +--- 2
@@ -35,7 +42,31 @@ namespace fusenet {
    * current working directory. Inside the db directory, there exists
    * one directory per newsgroup. Each group has one meta file
    * containing the name of the group, and each article is one plain
-   * text file in this directory.
+   * text file in this directory. The index file holds the
+   * identifiers of the articles in increasing order, so that a page
+   * of articles can be listed by binary search instead of by reading
+   * the whole directory. New articles are appended to it, deleted
+   * ones are removed by rewriting it, and a newsgroup without one
+   * gets one when the database is created.
+   *
+   * The newsgroup names are also kept in memory, loaded when the
+   * database is created and updated along with the directories, so
+   * that listing newsgroups and checking names and identifiers does
+   * not touch the disk. The directories remain the master copy.
+   *
+   * Versions are not stored. Each article number handed out counts
+   * once when the article is created and once more when it is
+   * deleted, so the version of a newsgroup follows from its last
+   * number and the size of its index, and the version of the
+   * newsgroup list likewise.
+   *
+   * Changes can be made durable with group commit. Each change
+   * remembers the files and directories it touched, and commit()
+   * waits until they have been synced. The first thread to commit
+   * syncs everything touched so far on behalf of all waiting
+   * threads, optionally after waiting a short window for more
+   * changes to join, so that many concurrent changes share the cost
+   * of one round of syncs.
    */
   class FilesystemDatabase : public Database {
 
@@ -46,6 +77,16 @@ namespace fusenet {
      */
     FilesystemDatabase(void);
 
+    /**
+     * Create instance with changes made durable on commit.
+     *
+     * @param policy SYNC_ALWAYS to sync as soon as a change commits,
+     *        SYNC_INTERVAL to wait for other changes to join first,
+     *        or SYNC_NONE to never sync
+     * @param window milliseconds to wait with SYNC_INTERVAL
+     */
+    FilesystemDatabase(SyncPolicy_t policy, int window);
+
     /**
      * Clear the database.
      */
@@ -56,6 +97,11 @@ namespace fusenet {
      */
     Status_t getNewsgroupList(NewsgroupList_t& newsgroupList);
 
+    /**
+     * Check that a newsgroup exists.
+     */
+    Status_t checkNewsgroup(int newsgroupIdentifier);
+
     /**
      * Create newsgroups.
      */
@@ -72,6 +118,23 @@ namespace fusenet {
     Status_t listArticles(int newsgroupIdentifier,
 			  ArticleList_t& articleList);
 
+    /**
+     * List article headers.
+     */
+    Status_t listArticleHeaders(int newsgroupIdentifier,
+				ArticleHeaderList_t& headerList);
+
+    /**
+     * List a page of article headers. Only the articles on the page
+     * are read, found by binary search in the index.
+     */
+    Status_t listArticlePage(int newsgroupIdentifier,
+			     int cursor,
+			     ListDirection_t direction,
+			     size_t maxCount,
+			     ArticleHeaderList_t& headerList,
+			     int& nextCursor);
+
     /**
      * Create article.
      */
@@ -91,6 +154,48 @@ namespace fusenet {
 			int articleIdentifier,
 			Article_t& article);
 
+    /**
+     * Get a reference to an article. Texts of at least the file
+     * threshold are left in the article file, which the reference
+     * keeps open, so that they can be sent straight from the file.
+     */
+    Status_t getArticleRef(int newsgroupIdentifier,
+			   int articleIdentifier,
+			   ArticleRef& article);
+
+    /**
+     * Get references to several articles, opening the newsgroup
+     * directory once and each article file relative to it.
+     */
+    Status_t getArticleRefs(int newsgroupIdentifier,
+			    const IdentifierList_t& articleIdentifiers,
+			    ArticleRefList_t& articles,
+			    StatusList_t& statuses);
+
+    /**
+     * Set the size from which texts are left in their files by
+     * getArticleRef(). Zero, the default, always reads them.
+     *
+     * @param threshold the size in bytes
+     */
+    void setFileThreshold(size_t threshold);
+
+    /**
+     * Wait until the changes made so far are synced.
+     */
+    Status_t commit(void);
+
+    /**
+     * Get the version of the newsgroup list.
+     */
+    Status_t getNewsgroupListVersion(Version_t& version);
+
+    /**
+     * Get the version of a newsgroup.
+     */
+    Status_t getNewsgroupVersion(int newsgroupIdentifier,
+				 Version_t& version);
+
     /**
      * Destroy instance.
      */
@@ -98,6 +203,98 @@ namespace fusenet {
 
   private:
 
+    typedef std::map<int, std::string> NameMap_t;
+    typedef std::map<std::string, int> IdentifierMap_t;
+    typedef std::set<std::string> PathSet_t;
+
+    /**
+     * Set up the database, shared by the constructors.
+     */
+    void initialize(SyncPolicy_t policy, int window);
+
+    /**
+     * Record a change that has been made, along with the files and
+     * directories it touched, which must be synced before the change
+     * is committed.
+     */
+    void changed(const PathSet_t& paths);
+
+    /**
+     * Load the newsgroup names from disk.
+     */
+    void loadNewsgroups(void);
+
+    /**
+     * Check if a newsgroup exists.
+     */
+    bool newsgroupExists(int newsgroupIdentifier) const;
+
+    /**
+     * Newsgroup names by identifier.
+     */
+    NameMap_t newsgroupNames;
+
+    /**
+     * Newsgroup identifiers by name.
+     */
+    IdentifierMap_t newsgroupIdentifiers;
+
+    /**
+     * Version of the newsgroup list, worked out when the names are
+     * loaded.
+     */
+    Version_t listVersion;
+
+    /**
+     * Size from which texts are left in their files, or zero.
+     */
+    size_t fileThreshold;
+
+    /**
+     * When changes are synced.
+     */
+    SyncPolicy_t policy;
+
+    /**
+     * Milliseconds to wait for more changes before syncing.
+     */
+    int window;
+
+    /**
+     * Protects the commit state below.
+     */
+    pthread_mutex_t commitMutex;
+
+    /**
+     * Signalled when a round of syncs is done.
+     */
+    pthread_cond_t committed;
+
+    /**
+     * Paths touched since the last round of syncs started.
+     */
+    PathSet_t pending;
+
+    /**
+     * Number of changes made.
+     */
+    unsigned long changes;
+
+    /**
+     * Number of changes synced.
+     */
+    unsigned long durable;
+
+    /**
+     * Number of changes synced when a sync first failed, or
+     * ULONG_MAX. No change after that is ever reported durable.
+     */
+    unsigned long broken;
+
+    /**
+     * Whether a thread is syncing on behalf of the others.
+     */
+    bool committing;
   };
 }
 
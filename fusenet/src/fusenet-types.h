@@ -38,6 +38,17 @@ namespace fusenet {
     std::string text;   //!< Text
   } Article_t;
 
+  /**
+   * Article header type. Everything about an article but its text,
+   * which is what a listing needs.
+   */
+  typedef struct {
+    int id;             //!< Identifier
+    std::string title;  //!< Title
+    std::string author; //!< Author
+    size_t size;        //!< Text size in bytes
+  } ArticleHeader_t;
+
   /**
    * Newsgroup list.
    */
@@ -48,6 +59,11 @@ namespace fusenet {
    */
   typedef std::vector<Article_t> ArticleList_t;
 
+  /**
+   * Article header list.
+   */
+  typedef std::vector<ArticleHeader_t> ArticleHeaderList_t;
+
   /**
    * Status type.
    */
@@ -56,9 +72,48 @@ namespace fusenet {
     STATUS_FAILURE,
     STATUS_FAILURE_ALREADY_EXISTS,
     STATUS_FAILURE_N_DOES_NOT_EXIST,
-    STATUS_FAILURE_A_DOES_NOT_EXIST
+    STATUS_FAILURE_A_DOES_NOT_EXIST,
+    STATUS_NOT_MODIFIED
   }
   Status_t;
+
+  /**
+   * Identifier list.
+   */
+  typedef std::vector<int> IdentifierList_t;
+
+  /**
+   * Status list, one status per item of some other list.
+   */
+  typedef std::vector<Status_t> StatusList_t;
+
+  /**
+   * Direction of a paged article listing.
+   */
+  typedef enum {
+    LIST_FORWARD  = 0,  //!< Oldest first, identifiers increasing
+    LIST_BACKWARD = 1   //!< Newest first, identifiers decreasing
+  }
+  ListDirection_t;
+
+  /**
+   * Cursor of a paged article listing that has not started, or that
+   * has nothing more to list.
+   */
+  const int CURSOR_NONE = -1;
+
+  /**
+   * Version stamp of the newsgroup list or of the articles of a
+   * newsgroup. It changes with every change to what it stamps, and
+   * never goes back to an earlier value, so a client that has seen a
+   * version can ask whether anything has changed since.
+   */
+  typedef uint32_t Version_t;
+
+  /**
+   * Version of something that is not versioned, which never matches.
+   */
+  const Version_t VERSION_NONE = 0;
 }
 
 #endif
@@ -0,0 +1,26 @@
+/**
+ * @file
+ *
+ * This file contains the job implementation.
+ */
+
+#include "job.h"
+
+namespace fusenet {
+
+  Job::Job(Transport* transport) {
+    this->transport = transport;
+  }
+
+  void Job::cancel(void) {
+    transport = NULL;
+  }
+
+  Transport* Job::getTransport(void) {
+    return transport;
+  }
+
+  Job::~Job(void) {
+    // Does nothing
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef JOB_H
+#define JOB_H
+
+/**
+ * @file
+ *
+ * This file contains the job interface.
+ */
+
+#include "transport.h"
+
+namespace fusenet {
+
+  /**
+   * A unit of work that is executed on a worker thread and then
+   * completed on the reactor thread that owns its connection. This is
+   * what lets slow database calls run without stalling the event
+   * loop: execute() must only touch data owned by the job, while
+   * complete() may use the connection.
+   */
+  class Job {
+
+  public:
+
+    /**
+     * Create instance.
+     *
+     * @param transport the connection the job belongs to
+     */
+    Job(Transport* transport);
+
+    /**
+     * Do the work. Called on a worker thread.
+     */
+    virtual void execute(void) = 0;
+
+    /**
+     * Deliver the result. Called on the reactor thread, unless the
+     * job has been cancelled.
+     */
+    virtual void complete(void) = 0;
+
+    /**
+     * Cancel the job, because its connection is gone. Must be called
+     * on the reactor thread.
+     */
+    void cancel(void);
+
+    /**
+     * Get the connection the job belongs to.
+     *
+     * @return the transport, or NULL if the job is cancelled
+     */
+    Transport* getTransport(void);
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~Job(void);
+
+  private:
+
+    /**
+     * The connection, or NULL.
+     */
+    Transport* transport;
+  };
+}
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * @file
+ *
+ * This file contains the journal implementation.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "journal.h"
+#include "log.h"
+#include "record.h"
+
+#define PREFIX "[Journal] "
+
+namespace fusenet {
+
+  /**
+   * Snapshot file prefix.
+   */
+  const char* const snapshotPrefix = "snapshot";
+
+  /**
+   * Log file prefix.
+   */
+  const char* const logPrefix = "log";
+
+  /**
+   * Standard file mode.
+   */
+  const int journalFileMode = 0644;
+
+  /**
+   * Parse the generation of a journal file.
+   *
+   * @return false if the name is not prefix.N
+   */
+  static bool ParseGeneration(const char* name, const char* prefix,
+			      unsigned int& generation) {
+    size_t length = strlen(prefix);
+    char* end;
+
+    if (strncmp(name, prefix, length) != 0 || name[length] != '.' ||
+	name[length + 1] < '0' || name[length + 1] > '9') {
+      return false;
+    }
+
+    generation = strtoul(name + length + 1, &end, 10);
+    return *end == '\0';
+  }
+
+  Journal::Journal(const std::string& directory, SyncPolicy_t policy,
+		   int interval, size_t snapshotSize) {
+    std::vector<std::string> stale;
+    struct dirent* entry;
+    unsigned int found;
+    DIR* dir;
+    size_t i;
+
+    this->directory = directory;
+    if (this->directory.empty() || this->directory[this->directory.size() - 1] != '/') {
+      this->directory += '/';
+    }
+
+    this->policy = policy;
+    this->interval = (interval > 0) ? interval : 1;
+    this->snapshotSize = snapshotSize;
+    snapshotAt = snapshotSize;
+    generation = 0;
+    snapshotDescriptor = -1;
+    logDescriptor = -1;
+    logSize = 0;
+    broken = false;
+    running = false;
+    dirty = false;
+    syncing = false;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+
+    // Ignore error code, opendir fails anyway if it matters
+    mkdir(this->directory.c_str(), 0755);
+
+    dir = opendir(this->directory.c_str());
+
+    if (dir == NULL) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to open " << this->directory;
+      return;
+    }
+
+    // The newest snapshot decides the generation
+    while ((entry = readdir(dir)) != NULL) {
+      if (ParseGeneration(entry->d_name, snapshotPrefix, found) && found > generation) {
+	generation = found;
+      }
+    }
+
+    rewinddir(dir);
+
+    // Anything older is left over from a crash during a snapshot
+    while ((entry = readdir(dir)) != NULL) {
+      if ((ParseGeneration(entry->d_name, snapshotPrefix, found) ||
+	   ParseGeneration(entry->d_name, logPrefix, found)) && found < generation) {
+	stale.push_back(entry->d_name);
+      } else if (strcmp(entry->d_name, "snapshot.tmp") == 0) {
+	stale.push_back(entry->d_name);
+      }
+    }
+
+    closedir(dir);
+
+    for (i = 0; i < stale.size(); i++) {
+      unlink((this->directory + stale[i]).c_str());
+    }
+
+    if (generation > 0) {
+      snapshotDescriptor = open(getPath(snapshotPrefix, generation).c_str(), O_RDONLY);
+    }
+
+    logDescriptor = open(getPath(logPrefix, generation).c_str(),
+			 O_RDWR | O_CREAT | O_APPEND, journalFileMode);
+
+    if (logDescriptor == -1) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to open "
+			   << getPath(logPrefix, generation);
+    }
+  }
+
+  int Journal::getSnapshot(void) {
+    return snapshotDescriptor;
+  }
+
+  int Journal::getLog(void) {
+    return logDescriptor;
+  }
+
+  bool Journal::start(off_t length) {
+    struct stat status;
+
+    if (snapshotDescriptor != -1) {
+      close(snapshotDescriptor);
+      snapshotDescriptor = -1;
+    }
+
+    if (logDescriptor == -1 || fstat(logDescriptor, &status) == -1) {
+      return false;
+    }
+
+    if (status.st_size > length) {
+      LOG(LOG_LEVEL_WARNING) << PREFIX << "Discarding " << status.st_size - length
+			     << " bytes at end of log";
+
+      if (ftruncate(logDescriptor, length) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate log";
+	return false;
+      }
+    }
+
+    logSize = length;
+
+    if (policy == SYNC_INTERVAL) {
+      running = true;
+
+      if (pthread_create(&thread, NULL, run, this) != 0) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to start sync thread, "
+			     << "syncing every record";
+	running = false;
+	policy = SYNC_ALWAYS;
+      }
+    }
+
+    return true;
+  }
+
+  bool Journal::append(const std::string& record) {
+    if (logDescriptor == -1 || broken) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to append to log";
+      return false;
+    }
+
+    if (!WriteFully(logDescriptor, record.data(), record.size())) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to append to log";
+      discardAppend();
+      return false;
+    }
+
+    if (policy == SYNC_ALWAYS) {
+      // The change is reported as failed, so it must not come back
+      // on replay
+      if (fdatasync(logDescriptor) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to sync log";
+	discardAppend();
+	return false;
+      }
+    } else if (policy == SYNC_INTERVAL) {
+      pthread_mutex_lock(&mutex);
+      dirty = true;
+      pthread_mutex_unlock(&mutex);
+    }
+
+    logSize += record.size();
+    return true;
+  }
+
+  void Journal::discardAppend(void) {
+    // Records appended after a torn one would be lost on recovery
+    if (ftruncate(logDescriptor, logSize) == -1 ||
+	lseek(logDescriptor, logSize, SEEK_SET) == -1) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate log, "
+			   << "no more changes are logged";
+      broken = true;
+    }
+  }
+
+  bool Journal::isSnapshotDue(void) const {
+    return logSize > snapshotAt;
+  }
+
+  int Journal::beginSnapshot(void) {
+    return open((directory + "snapshot.tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+		journalFileMode);
+  }
+
+  bool Journal::commitSnapshot(int descriptor, bool complete) {
+    std::string temporary = directory + "snapshot.tmp";
+    std::string snapshot = getPath(snapshotPrefix, generation + 1);
+    std::string log = getPath(logPrefix, generation + 1);
+    int newLog;
+    int oldLog;
+
+    // Retry later rather than on every change if this fails
+    snapshotAt = logSize + snapshotSize;
+
+    // The snapshot must be on disk before the log it replaces goes
+    if (!complete || fsync(descriptor) == -1) {
+      close(descriptor);
+      unlink(temporary.c_str());
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to write snapshot";
+      return false;
+    }
+
+    close(descriptor);
+    newLog = open(log.c_str(), O_RDWR | O_CREAT | O_APPEND | O_TRUNC, journalFileMode);
+
+    if (newLog == -1 || rename(temporary.c_str(), snapshot.c_str()) == -1) {
+      if (newLog != -1) {
+	close(newLog);
+	unlink(log.c_str());
+      }
+
+      unlink(temporary.c_str());
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to install snapshot";
+      return false;
+    }
+
+    syncDirectory();
+
+    // Wait out a sync in progress before closing the log under it
+    pthread_mutex_lock(&mutex);
+
+    while (syncing) {
+      pthread_cond_wait(&changed, &mutex);
+    }
+
+    oldLog = logDescriptor;
+    logDescriptor = newLog;
+    dirty = false;
+    pthread_mutex_unlock(&mutex);
+
+    close(oldLog);
+    unlink(getPath(logPrefix, generation).c_str());
+
+    if (generation > 0) {
+      unlink(getPath(snapshotPrefix, generation).c_str());
+    }
+
+    generation++;
+    logSize = 0;
+    snapshotAt = snapshotSize;
+    return true;
+  }
+
+  std::string Journal::getPath(const char* name, unsigned int generation) const {
+    std::ostringstream path;
+    path << directory << name << "." << generation;
+    return path.str();
+  }
+
+  void Journal::syncDirectory(void) {
+    int descriptor = open(directory.c_str(), O_RDONLY);
+
+    if (descriptor != -1) {
+      fsync(descriptor);
+      close(descriptor);
+    }
+  }
+
+  void* Journal::run(void* argument) {
+    static_cast<Journal*>(argument)->sync();
+    return NULL;
+  }
+
+  void Journal::sync(void) {
+    pthread_mutex_lock(&mutex);
+
+    while (running) {
+      struct timeval now;
+      struct timespec deadline;
+      int descriptor;
+
+      gettimeofday(&now, NULL);
+      deadline.tv_sec = now.tv_sec + interval / 1000;
+      deadline.tv_nsec = now.tv_usec * 1000 + (interval % 1000) * 1000000;
+
+      if (deadline.tv_nsec >= 1000000000) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000;
+      }
+
+      pthread_cond_timedwait(&changed, &mutex, &deadline);
+
+      if (dirty) {
+	descriptor = logDescriptor;
+	dirty = false;
+	syncing = true;
+	pthread_mutex_unlock(&mutex);
+
+	if (fdatasync(descriptor) == -1) {
+	  LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to sync log";
+	}
+
+	pthread_mutex_lock(&mutex);
+	syncing = false;
+	pthread_cond_broadcast(&changed);
+      }
+    }
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  Journal::~Journal(void) {
+    if (running) {
+      pthread_mutex_lock(&mutex);
+      running = false;
+      pthread_cond_broadcast(&changed);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(thread, NULL);
+    }
+
+    if (snapshotDescriptor != -1) {
+      close(snapshotDescriptor);
+    }
+
+    if (logDescriptor != -1) {
+      if (policy != SYNC_NONE) {
+	fdatasync(logDescriptor);
+      }
+
+      close(logDescriptor);
+    }
+
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+  }
+}
@@ -0,0 +1,246 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/**
+ * @file
+ *
+ * This file contains the journal interface.
+ */
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <string>
+
+namespace fusenet {
+
+  /**
+   * When appended records are forced to disk.
+   */
+  typedef enum {
+    SYNC_ALWAYS,    //!< After every record, before it is acknowledged
+    SYNC_INTERVAL,  //!< By a background thread, at a fixed interval
+    SYNC_NONE       //!< Whenever the operating system gets to it
+  } SyncPolicy_t;
+
+  /**
+   * Journal. Manages the files that make an in-memory database
+   * durable: a snapshot of the whole database, and a log of every
+   * change made since the snapshot was taken. The directory of a
+   * working journal looks like this:
+   *
+   * <pre>
+   *   DIR/ --+-- snapshot.N
+   *          |
+   *          +-- log.N
+   * </pre>
+   *
+   * Taking a snapshot writes snapshot.tmp, renames it to the next
+   * generation and starts a new, empty log for that generation, and
+   * only then removes the files of the previous generation. After a
+   * crash, the newest complete snapshot and its log are therefore
+   * always enough to recover every acknowledged change.
+   *
+   * The journal does not know what is in the files; it hands out
+   * descriptors for reading them on startup, and takes finished
+   * records for appending.
+   */
+  class Journal {
+
+  public:
+
+    /**
+     * Create instance, and open the newest generation in a directory,
+     * which is created if needed.
+     *
+     * @param directory the directory
+     * @param policy when to force the log to disk
+     * @param interval milliseconds between syncs with SYNC_INTERVAL
+     * @param snapshotSize log size at which a snapshot is due
+     */
+    Journal(const std::string& directory, SyncPolicy_t policy,
+	    int interval, size_t snapshotSize);
+
+    /**
+     * Get the snapshot to recover from. Only valid until start().
+     *
+     * @return a descriptor positioned at the start of the snapshot,
+     *	       or -1 if there is none
+     */
+    int getSnapshot(void);
+
+    /**
+     * Get the log to replay after the snapshot. Only valid until
+     * start().
+     *
+     * @return a descriptor positioned at the start of the log, or -1
+     *	       if the journal could not be opened
+     */
+    int getLog(void);
+
+    /**
+     * Start appending to the log, once recovery is done.
+     *
+     * @param length the length of the valid part of the log, anything
+     *	      after it is a torn write and is cut off
+     * @return false if the log can not be written
+     */
+    bool start(off_t length);
+
+    /**
+     * Append a record to the log, and sync it according to the
+     * policy.
+     *
+     * @param record the record
+     * @return false if the record could not be written, in which case
+     *	       it is not in the log either
+     */
+    bool append(const std::string& record);
+
+    /**
+     * Check if the log has grown enough that a snapshot should be
+     * taken.
+     */
+    bool isSnapshotDue(void) const;
+
+    /**
+     * Begin writing a snapshot.
+     *
+     * @return a descriptor to write the snapshot to, or -1
+     */
+    int beginSnapshot(void);
+
+    /**
+     * Finish writing a snapshot, and switch to a new log. On failure
+     * the snapshot is thrown away and the current log is kept.
+     *
+     * @param descriptor the descriptor from beginSnapshot()
+     * @param complete false to throw the snapshot away
+     * @return true if the snapshot was made durable
+     */
+    bool commitSnapshot(int descriptor, bool complete);
+
+    /**
+     * Destroy instance. Syncs the log unless the policy is
+     * SYNC_NONE.
+     */
+    ~Journal(void);
+
+  private:
+
+    /**
+     * Get the path of a file in the directory.
+     */
+    std::string getPath(const char* name, unsigned int generation) const;
+
+    /**
+     * Sync the directory, so that renamed and created files survive
+     * a crash.
+     */
+    void syncDirectory(void);
+
+    /**
+     * Cut a record that could not be written or synced off the end of
+     * the log, or give up on the log if that fails.
+     */
+    void discardAppend(void);
+
+    /**
+     * Sync thread entry point.
+     */
+    static void* run(void* argument);
+
+    /**
+     * Sync the log at the interval until stopped.
+     */
+    void sync(void);
+
+    /**
+     * The directory, ending with a slash.
+     */
+    std::string directory;
+
+    /**
+     * When to sync the log.
+     */
+    SyncPolicy_t policy;
+
+    /**
+     * Milliseconds between syncs.
+     */
+    int interval;
+
+    /**
+     * Log growth between snapshots.
+     */
+    size_t snapshotSize;
+
+    /**
+     * Log size at which the next snapshot is due. Pushed further out
+     * when a snapshot fails, so that it is not retried on every
+     * change.
+     */
+    off_t snapshotAt;
+
+    /**
+     * Current generation.
+     */
+    unsigned int generation;
+
+    /**
+     * Snapshot to recover from, or -1.
+     */
+    int snapshotDescriptor;
+
+    /**
+     * Current log, or -1.
+     */
+    int logDescriptor;
+
+    /**
+     * Bytes in the current log.
+     */
+    off_t logSize;
+
+    /**
+     * True if the log may end in a record that failed, so nothing can
+     * safely be appended after it.
+     */
+    bool broken;
+
+    /**
+     * Sync thread, if started.
+     */
+    pthread_t thread;
+
+    /**
+     * True while the sync thread runs.
+     */
+    bool running;
+
+    /**
+     * True if the log has been appended to since the last sync.
+     */
+    bool dirty;
+
+    /**
+     * True while the sync thread syncs the log outside the mutex.
+     */
+    bool syncing;
+
+    /**
+     * Protects the flags and the log descriptor against the sync
+     * thread.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * Signalled when the sync thread should stop, or has finished a
+     * sync.
+     */
+    pthread_cond_t changed;
+  };
+}
+
+#endif
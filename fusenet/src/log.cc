@@ -0,0 +1,365 @@
+/**
+ * @file
+ *
+ * This file contains the log implementation.
+ */
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+/**
+ * Number of slots in the ring, a power of two.
+ */
+#define RING_SIZE 8192
+
+/**
+ * Milliseconds the background thread sleeps when there is nothing to
+ * write.
+ */
+#define DRAIN_INTERVAL 10
+
+/**
+ * Argument tags.
+ */
+#define TAG_TEXT 's'
+#define TAG_SIGNED 'i'
+#define TAG_UNSIGNED 'u'
+#define TAG_REAL 'f'
+
+namespace fusenet {
+
+  volatile int Log::threshold = LOG_LEVEL_INFO;
+  LogSlot_t* volatile Log::ring = NULL;
+  volatile unsigned long Log::head = 0;
+  unsigned long Log::tail = 0;
+  volatile unsigned long Log::dropped = 0;
+  pthread_t Log::thread;
+  bool Log::running = false;
+  pthread_mutex_t Log::mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t Log::stopped = PTHREAD_COND_INITIALIZER;
+
+  void Log::setLevel(LogLevel_t level) {
+    threshold = level;
+  }
+
+  bool Log::parseLevel(const char* name, LogLevel_t& level) {
+    if (strcmp(name, "error") == 0) {
+      level = LOG_LEVEL_ERROR;
+    } else if (strcmp(name, "warning") == 0) {
+      level = LOG_LEVEL_WARNING;
+    } else if (strcmp(name, "info") == 0) {
+      level = LOG_LEVEL_INFO;
+    } else if (strcmp(name, "debug") == 0) {
+      level = LOG_LEVEL_DEBUG;
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+  bool Log::start(void) {
+    LogSlot_t* slots;
+    unsigned long i;
+
+    if (running) {
+      return true;
+    }
+
+    // The ring is never freed, since a record being put together when
+    // the log is stopped may still use it
+    slots = new LogSlot_t[RING_SIZE];
+
+    for (i = 0; i < RING_SIZE; i++) {
+      slots[i].sequence = head + i;
+    }
+
+    tail = head;
+    running = true;
+
+    if (pthread_create(&thread, NULL, run, slots) != 0) {
+      running = false;
+      delete[] slots;
+      return false;
+    }
+
+    __sync_synchronize();
+    ring = slots;
+    return true;
+  }
+
+  void Log::stop(void) {
+    if (!running) {
+      return;
+    }
+
+    // New records are written out right away from now on
+    ring = NULL;
+
+    pthread_mutex_lock(&mutex);
+    running = false;
+    pthread_cond_broadcast(&stopped);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+  }
+
+  LogSlot_t* Log::reserve(void) {
+    LogSlot_t* slots = ring;
+    unsigned long position;
+
+    if (slots == NULL) {
+      return NULL;
+    }
+
+    // A slot is free for position p when its sequence is p, and holds
+    // a record for the background thread when it is p + 1
+    position = head;
+
+    for (;;) {
+      LogSlot_t* slot = &slots[position & (RING_SIZE - 1)];
+      long difference = static_cast<long>(slot->sequence - position);
+
+      if (difference == 0) {
+	if (__sync_bool_compare_and_swap(&head, position, position + 1)) {
+	  return slot;
+	}
+      } else if (difference < 0) {
+	__sync_add_and_fetch(&dropped, 1);
+	return NULL;
+      }
+
+      position = head;
+    }
+  }
+
+  void Log::publish(LogSlot_t* slot) {
+    __sync_synchronize();
+    slot->sequence = slot->sequence + 1;
+  }
+
+  void Log::format(const LogSlot_t* slot, std::string& output, std::string& error) {
+    std::string& text = (slot->level <= LOG_LEVEL_WARNING) ? error : output;
+    const char* data = slot->data;
+    const char* end = data + slot->length;
+    char number[24];
+
+    while (data < end) {
+      char tag = *data++;
+
+      if (tag == TAG_TEXT) {
+	unsigned short length;
+
+	memcpy(&length, data, sizeof(length));
+	data += sizeof(length);
+	text.append(data, length);
+	data += length;
+      } else if (tag == TAG_SIGNED) {
+	long value;
+
+	memcpy(&value, data, sizeof(value));
+	data += sizeof(value);
+	snprintf(number, sizeof(number), "%ld", value);
+	text += number;
+      } else if (tag == TAG_UNSIGNED) {
+	unsigned long value;
+
+	memcpy(&value, data, sizeof(value));
+	data += sizeof(value);
+	snprintf(number, sizeof(number), "%lu", value);
+	text += number;
+      } else {
+	double value;
+
+	memcpy(&value, data, sizeof(value));
+	data += sizeof(value);
+	snprintf(number, sizeof(number), "%g", value);
+	text += number;
+      }
+    }
+
+    if (slot->truncated) {
+      text += "...";
+    }
+
+    text += '\n';
+  }
+
+  void Log::flush(int descriptor, std::string& text) {
+    size_t offset = 0;
+
+    while (offset < text.size()) {
+      ssize_t n = ::write(descriptor, text.data() + offset, text.size() - offset);
+
+      if (n <= 0) {
+	break;
+      }
+
+      offset += n;
+    }
+
+    text.clear();
+  }
+
+  void* Log::run(void* argument) {
+    drain(static_cast<LogSlot_t*>(argument));
+    return NULL;
+  }
+
+  void Log::drain(LogSlot_t* slots) {
+    std::string output;
+    std::string error;
+    unsigned long count = 0;
+    bool last = false;
+
+    while (!last) {
+      unsigned long lost;
+
+      // Only sleep when the last round found nothing, so a busy
+      // server is kept up with
+      if (count == 0) {
+	struct timeval now;
+	struct timespec deadline;
+
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec;
+	deadline.tv_nsec = now.tv_usec * 1000 + DRAIN_INTERVAL * 1000000;
+
+	if (deadline.tv_nsec >= 1000000000) {
+	  deadline.tv_sec++;
+	  deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	if (running) {
+	  pthread_cond_timedwait(&stopped, &mutex, &deadline);
+	}
+
+	pthread_mutex_unlock(&mutex);
+      }
+
+      pthread_mutex_lock(&mutex);
+      last = !running;
+      pthread_mutex_unlock(&mutex);
+
+      for (count = 0; count < RING_SIZE; count++) {
+	LogSlot_t* slot = &slots[tail & (RING_SIZE - 1)];
+
+	if (slot->sequence != tail + 1) {
+	  break;
+	}
+
+	__sync_synchronize();
+	format(slot, output, error);
+	__sync_synchronize();
+	slot->sequence = tail + RING_SIZE;
+	tail++;
+      }
+
+      lost = __sync_fetch_and_and(&dropped, 0);
+
+      if (lost > 0) {
+	char message[64];
+
+	snprintf(message, sizeof(message), "[Log] Dropped %lu records\n", lost);
+	error += message;
+      }
+
+      flush(STDOUT_FILENO, output);
+      flush(STDERR_FILENO, error);
+    }
+  }
+
+  LogRecord::LogRecord(LogLevel_t level) {
+    slot = Log::reserve();
+
+    if (slot == NULL) {
+      slot = &local;
+    }
+
+    slot->level = level;
+    slot->length = 0;
+    slot->truncated = false;
+  }
+
+  void LogRecord::append(char tag, const void* data, size_t size) {
+    if (slot->truncated || slot->length + 1 + size > LOG_RECORD_SIZE) {
+      slot->truncated = true;
+      return;
+    }
+
+    slot->data[slot->length] = tag;
+    memcpy(slot->data + slot->length + 1, data, size);
+    slot->length += 1 + size;
+  }
+
+  LogRecord& LogRecord::operator<<(const char* text) {
+    size_t length = strlen(text);
+    size_t room;
+    unsigned short n;
+
+    if (slot->truncated || slot->length + 1 + sizeof(n) >= LOG_RECORD_SIZE) {
+      slot->truncated = true;
+      return *this;
+    }
+
+    room = LOG_RECORD_SIZE - slot->length - 1 - sizeof(n);
+
+    if (length > room) {
+      length = room;
+      slot->truncated = true;
+    }
+
+    n = length;
+    slot->data[slot->length] = TAG_TEXT;
+    memcpy(slot->data + slot->length + 1, &n, sizeof(n));
+    memcpy(slot->data + slot->length + 1 + sizeof(n), text, length);
+    slot->length += 1 + sizeof(n) + length;
+    return *this;
+  }
+
+  LogRecord& LogRecord::operator<<(const std::string& text) {
+    return *this << text.c_str();
+  }
+
+  LogRecord& LogRecord::operator<<(int value) {
+    return *this << static_cast<long>(value);
+  }
+
+  LogRecord& LogRecord::operator<<(unsigned int value) {
+    return *this << static_cast<unsigned long>(value);
+  }
+
+  LogRecord& LogRecord::operator<<(long value) {
+    append(TAG_SIGNED, &value, sizeof(value));
+    return *this;
+  }
+
+  LogRecord& LogRecord::operator<<(unsigned long value) {
+    append(TAG_UNSIGNED, &value, sizeof(value));
+    return *this;
+  }
+
+  LogRecord& LogRecord::operator<<(double value) {
+    append(TAG_REAL, &value, sizeof(value));
+    return *this;
+  }
+
+  LogRecord::~LogRecord(void) {
+    if (slot != &local) {
+      Log::publish(slot);
+    } else if (Log::ring == NULL) {
+      std::string output;
+      std::string error;
+
+      Log::format(slot, output, error);
+      Log::flush(STDOUT_FILENO, output);
+      Log::flush(STDERR_FILENO, error);
+    }
+  }
+}
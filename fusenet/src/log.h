@@ -0,0 +1,272 @@
+#ifndef LOG_H
+#define LOG_H
+
+/**
+ * @file
+ *
+ * This file contains the log interface.
+ */
+
+#include <pthread.h>
+
+#include <string>
+
+/**
+ * Log a message at the given level, as in
+ *
+ *   LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting article " << id;
+ *
+ * Nothing after LOG() is evaluated unless the level is enabled. A line
+ * break is added at the end.
+ */
+#define LOG(level) \
+  if (!fusenet::Log::isEnabled(level)) {} else fusenet::LogRecord(level)
+
+namespace fusenet {
+
+  /**
+   * Log levels, most important first.
+   */
+  typedef enum {
+    LOG_LEVEL_ERROR,    //!< Something failed
+    LOG_LEVEL_WARNING,  //!< Something is wrong, but handled
+    LOG_LEVEL_INFO,     //!< Connections and other rare events
+    LOG_LEVEL_DEBUG     //!< Every request and every read
+  } LogLevel_t;
+
+  /**
+   * Size of the arguments of one log record, longer messages are cut
+   * short.
+   */
+  const size_t LOG_RECORD_SIZE = 240;
+
+  /**
+   * One log record, holding its arguments as they were given rather
+   * than as text.
+   */
+  typedef struct {
+    volatile unsigned long sequence;  //!< Ring position it may be used at
+    LogLevel_t level;                 //!< Level
+    size_t length;                    //!< Bytes used in data
+    bool truncated;                   //!< Arguments did not fit
+    char data[LOG_RECORD_SIZE];       //!< Tagged arguments
+  } LogSlot_t;
+
+  /**
+   * The log. Records are placed in a ring buffer without taking any
+   * lock, and turned into text and written out by a background thread,
+   * so logging costs little more than copying the arguments. Errors and
+   * warnings go to standard error, the rest to standard output. If the
+   * ring is full the record is dropped and counted. Until start() is
+   * called, and after stop(), records are written out right away.
+   */
+  class Log {
+
+  public:
+
+    /**
+     * Set the most verbose level to log. LOG_LEVEL_INFO by default.
+     *
+     * @param level the level
+     */
+    static void setLevel(LogLevel_t level);
+
+    /**
+     * Parse a level name.
+     *
+     * @param name one of "error", "warning", "info" and "debug"
+     * @param level the level
+     * @return false if the name is unknown
+     */
+    static bool parseLevel(const char* name, LogLevel_t& level);
+
+    /**
+     * Check if a level is logged.
+     *
+     * @param level the level
+     * @return true if it is
+     */
+    static bool isEnabled(LogLevel_t level) {
+      return level <= threshold;
+    }
+
+    /**
+     * Start the background thread.
+     *
+     * @return false if it could not be started
+     */
+    static bool start(void);
+
+    /**
+     * Write out what is queued and stop the background thread.
+     */
+    static void stop(void);
+
+  private:
+
+    friend class LogRecord;
+
+    /**
+     * Claim the next free slot in the ring.
+     *
+     * @return the slot, or NULL if the ring is full or not started
+     */
+    static LogSlot_t* reserve(void);
+
+    /**
+     * Hand a claimed slot to the background thread.
+     *
+     * @param slot the slot
+     */
+    static void publish(LogSlot_t* slot);
+
+    /**
+     * Format a record and add it to the text for its stream.
+     *
+     * @param slot the record
+     * @param output text for standard output
+     * @param error text for standard error
+     */
+    static void format(const LogSlot_t* slot, std::string& output, std::string& error);
+
+    /**
+     * Write out text and clear it.
+     *
+     * @param descriptor the file descriptor to write to
+     * @param text the text
+     */
+    static void flush(int descriptor, std::string& text);
+
+    /**
+     * Thread entry point.
+     */
+    static void* run(void* argument);
+
+    /**
+     * Write out published records until stopped.
+     *
+     * @param slots the ring
+     */
+    static void drain(LogSlot_t* slots);
+
+    /**
+     * Most verbose level logged.
+     */
+    static volatile int threshold;
+
+    /**
+     * The ring, NULL unless started.
+     */
+    static LogSlot_t* volatile ring;
+
+    /**
+     * Next position to claim, only ever increased.
+     */
+    static volatile unsigned long head;
+
+    /**
+     * Next position to write out, only used by the background thread.
+     */
+    static unsigned long tail;
+
+    /**
+     * Records dropped because the ring was full.
+     */
+    static volatile unsigned long dropped;
+
+    /**
+     * Background thread.
+     */
+    static pthread_t thread;
+
+    /**
+     * True while the background thread runs.
+     */
+    static bool running;
+
+    /**
+     * Protects running.
+     */
+    static pthread_mutex_t mutex;
+
+    /**
+     * Signalled when the background thread should stop.
+     */
+    static pthread_cond_t stopped;
+  };
+
+  /**
+   * A log record being put together, sent when it goes out of scope.
+   * Only use through LOG().
+   */
+  class LogRecord {
+
+  public:
+
+    /**
+     * Create instance.
+     *
+     * @param level the level
+     */
+    LogRecord(LogLevel_t level);
+
+    /**
+     * Add text.
+     */
+    LogRecord& operator<<(const char* text);
+
+    /**
+     * Add text.
+     */
+    LogRecord& operator<<(const std::string& text);
+
+    /**
+     * Add a number.
+     */
+    LogRecord& operator<<(int value);
+
+    /**
+     * Add a number.
+     */
+    LogRecord& operator<<(unsigned int value);
+
+    /**
+     * Add a number.
+     */
+    LogRecord& operator<<(long value);
+
+    /**
+     * Add a number.
+     */
+    LogRecord& operator<<(unsigned long value);
+
+    /**
+     * Add a number.
+     */
+    LogRecord& operator<<(double value);
+
+    /**
+     * Send the record.
+     */
+    ~LogRecord(void);
+
+  private:
+
+    /**
+     * Add a tagged argument.
+     */
+    void append(char tag, const void* data, size_t size);
+
+    /**
+     * Slot in the ring, or local if there was none.
+     */
+    LogSlot_t* slot;
+
+    /**
+     * Used when the ring is full or not started.
+     */
+    LogSlot_t local;
+  };
+}
+
+#endif
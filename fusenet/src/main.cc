@@ -7,32 +7,215 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <pthread.h>
 
 #include "client-creator.h"
 #include "client.h"
+#include "demultiplexer.h"
+#include "epoll-demultiplexer.h"
 #include "filesystem-database.h"
+#include "journal.h"
+#include "log.h"
 #include "memory-database.h"
 #include "network-reactor.h"
 #include "protocol.h"
+#include "segment-database.h"
 #include "server-creator.h"
 #include "server.h"
+#include "statistics.h"
+#include "subscriber-registry.h"
+#include "synchronized-database.h"
+#include "worker-pool.h"
 #include "transport.h"
 
-static void serverBehaviour(int port, bool useMemoryBackend) {
+/**
+ * Database backends.
+ */
+typedef enum {
+  BACKEND_MEMORY,      //!< MemoryDatabase
+  BACKEND_FILESYSTEM,  //!< FilesystemDatabase
+  BACKEND_SEGMENT      //!< SegmentDatabase
+} Backend_t;
+
+/**
+ * Server options.
+ */
+typedef struct {
+  int port;                                        //!< Port number
+  Backend_t backend;                               //!< Database backend
+  fusenet::DemultiplexerType_t demultiplexerType;  //!< Event demultiplexer
+  size_t lowWatermark;                             //!< Resume reading, or 0
+  size_t highWatermark;                            //!< Pause reading, or 0
+  int threads;                                     //!< Reactor threads
+  int workers;                                     //!< Database workers, or 0
+  size_t queueDepth;                               //!< Worker queue depth
+  const char* journalDirectory;                    //!< Journal directory, or NULL
+  fusenet::SyncPolicy_t syncPolicy;                //!< Journal or commit sync policy
+  int syncInterval;                                //!< Sync interval or commit window in ms
+  size_t snapshotSize;                             //!< Log size between snapshots
+  size_t sendfileThreshold;                        //!< Texts sent from file, or 0
+  fusenet::LogLevel_t logLevel;                    //!< Most verbose level logged
+  bool collectStatistics;                          //!< Time and count requests
+  const char* statisticsFile;                      //!< Statistics dump file, or NULL
+  int statisticsInterval;                          //!< Seconds between dumps
+} ServerOptions_t;
+
+/**
+ * Arguments to a reactor thread.
+ */
+typedef struct {
+  const ServerOptions_t* options;         //!< Server options
+  fusenet::Database* database;            //!< Shared database
+  fusenet::NewsgroupListCache* cache;     //!< Shared newsgroup list cache
+  fusenet::SubscriberRegistry* registry;  //!< Shared subscriber registry
+  fusenet::Statistics* statistics;        //!< Shared request statistics, or NULL
+  fusenet::WorkerPool* workerPool;        //!< Shared worker pool, or NULL
+} ReactorThread_t;
+
+static void serveReactor(const ServerOptions_t& options,
+			 fusenet::Database* database,
+			 fusenet::NewsgroupListCache* cache,
+			 fusenet::SubscriberRegistry* registry,
+			 fusenet::Statistics* statistics,
+			 fusenet::WorkerPool* workerPool) {
+  fusenet::Demultiplexer* demultiplexer;
+
+  demultiplexer = fusenet::Demultiplexer::create(options.demultiplexerType);
+
+  if (demultiplexer == NULL) {
+    std::cout << "Demultiplexer not available, falling back to select" << std::endl;
+    demultiplexer = fusenet::Demultiplexer::create(fusenet::DEMULTIPLEXER_SELECT);
+  }
+
+  fusenet::NetworkReactor networkReactor(demultiplexer);
+
+  if (options.highWatermark > 0) {
+    networkReactor.setWatermarks(options.lowWatermark, options.highWatermark);
+  }
+
+  if (options.threads > 1 && !networkReactor.setReusePort(true)) {
+    std::cerr << "Port sharing not supported, use a single thread" << std::endl;
+    return;
+  }
+
+  // Completed requests are posted back to the reactor that owns the
+  // connection, so each reactor has its own creator
+  fusenet::ServerCreator creator(database, cache, registry, statistics, workerPool,
+				 &networkReactor);
+  networkReactor.serve(options.port, &creator);
+}
+
+static void* reactorThread(void* argument) {
+  ReactorThread_t* reactorThread = static_cast<ReactorThread_t*>(argument);
+  serveReactor(*reactorThread->options, reactorThread->database,
+	       reactorThread->cache, reactorThread->registry,
+	       reactorThread->statistics, reactorThread->workerPool);
+  return NULL;
+}
+
+static void serveDatabase(const ServerOptions_t& options, fusenet::Database* database) {
+  // Each reactor owns its connections, so the database, the
+  // newsgroup list cache, the subscriber registry and the statistics
+  // are the only things shared between threads
+  fusenet::SynchronizedDatabase synchronizedDatabase(database);
+  fusenet::NewsgroupListCache cache;
+  fusenet::SubscriberRegistry registry;
+  fusenet::Statistics statistics;
+  fusenet::WorkerPool workerPool(options.workers, options.queueDepth);
+  ReactorThread_t argument = { &options, database, &cache, &registry, &statistics, NULL };
+  std::vector<pthread_t> threads;
+  int i;
+
+  if (options.threads > 1 || options.workers > 0) {
+    argument.database = &synchronizedDatabase;
+  }
+
+  // Timing requests costs a few clock reads each, so only pay for it
+  // when asked
+  if (!options.collectStatistics) {
+    argument.statistics = NULL;
+  }
+
+  if (options.workers > 0 && workerPool.start()) {
+    argument.workerPool = &workerPool;
+  }
+
+  if (options.statisticsFile != NULL &&
+      !statistics.startDump(options.statisticsFile, options.statisticsInterval)) {
+    std::cerr << "Unable to start statistics thread" << std::endl;
+  }
+
+  for (i = 1; i < options.threads; i++) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, reactorThread, &argument) != 0) {
+      std::cerr << "Unable to start reactor thread" << std::endl;
+      break;
+    }
+
+    threads.push_back(thread);
+  }
+
+  std::cout << "Serving with " << threads.size() + 1 << " reactor thread(s)" << std::endl;
+  serveReactor(options, argument.database, argument.cache, argument.registry,
+	       argument.statistics, argument.workerPool);
+
+  for (i = 0; i < static_cast<int>(threads.size()); i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static bool serverBehaviour(const ServerOptions_t& options) {
+  bool served = true;
+
   std::cout << "Fusenet server started" << std::endl;
-  fusenet::NetworkReactor networkReactor;
 
-  if (useMemoryBackend) {
+  // Log records are written out by a thread of their own, so that
+  // serving requests never waits for the terminal
+  fusenet::Log::setLevel(options.logLevel);
+
+  if (!fusenet::Log::start()) {
+    std::cerr << "Unable to start log thread, logging synchronously" << std::endl;
+  }
+
+  if (options.backend == BACKEND_MEMORY && options.journalDirectory != NULL) {
+    std::cout << "Memory backend selected, journal in "
+	      << options.journalDirectory << std::endl;
+    fusenet::MemoryDatabase database(new fusenet::Journal(options.journalDirectory,
+							  options.syncPolicy,
+							  options.syncInterval,
+							  options.snapshotSize));
+
+    // Serving without the journal would acknowledge changes that
+    // are lost on the next restart
+    if (database.isRecovered()) {
+      serveDatabase(options, &database);
+    } else {
+      std::cerr << "Unable to recover the journal in " << options.journalDirectory
+		<< ", not serving" << std::endl;
+      served = false;
+    }
+  } else if (options.backend == BACKEND_MEMORY) {
     std::cout << "Memory backend selected" << std::endl;
     fusenet::MemoryDatabase database;
-    fusenet::ServerCreator creator(&database);
-    networkReactor.serve(port, &creator);
+    serveDatabase(options, &database);
+  } else if (options.backend == BACKEND_SEGMENT) {
+    std::cout << "Segment backend selected" << std::endl;
+    fusenet::SegmentDatabase database;
+    serveDatabase(options, &database);
   } else {
     std::cout << "File system backend selected" << std::endl;
-    fusenet::FilesystemDatabase database;
-    fusenet::ServerCreator creator(&database);
-    networkReactor.serve(port, &creator);
+    fusenet::FilesystemDatabase database(options.syncPolicy, options.syncInterval);
+    database.setFileThreshold(options.sendfileThreshold);
+    serveDatabase(options, &database);
   }
+
+  fusenet::Log::stop();
+  return served;
 }
 
 static void clientBehaviour(const char* const host, int port) {
@@ -43,7 +226,146 @@ static void clientBehaviour(const char* const host, int port) {
 }
 
 static void printUsage(void) {
-  std::cerr << "usage: fusenet [ --client HOST PORT | --server PORT ( mem | fs ) ]" << std::endl;
+  std::cerr << "usage: fusenet [ --client HOST PORT | --server PORT ( mem | fs | seg ) [ OPTIONS ] ]" << std::endl;
+  std::cerr << "server options:" << std::endl;
+  std::cerr << "  --demultiplexer ( select | epoll | epoll-et )" << std::endl;
+  std::cerr << "  --watermarks LOW HIGH" << std::endl;
+  std::cerr << "  --threads N" << std::endl;
+  std::cerr << "  --workers N [ --queue-depth N ]" << std::endl;
+  std::cerr << "  --log-level ( error | warning | info | debug )" << std::endl;
+  std::cerr << "  --stats-collect | --stats FILE [ --stats-interval SECONDS ]" << std::endl;
+  std::cerr << "memory backend options:" << std::endl;
+  std::cerr << "  --journal DIR [ --sync ( always | none | MS ) ] [ --snapshot-size BYTES ]" << std::endl;
+  std::cerr << "file system backend options:" << std::endl;
+  std::cerr << "  [ --sync ( always | none | MS ) ] [ --sendfile BYTES ]" << std::endl;
+}
+
+static bool parseServerOptions(int argc, char* argv[], ServerOptions_t& options) {
+  int i;
+
+  options.port = atoi(argv[2]);
+  if (strcmp(argv[3], "mem") == 0) {
+    options.backend = BACKEND_MEMORY;
+  } else if (strcmp(argv[3], "seg") == 0) {
+    options.backend = BACKEND_SEGMENT;
+  } else {
+    options.backend = BACKEND_FILESYSTEM;
+  }
+
+#ifdef HAVE_EPOLL
+  options.demultiplexerType = fusenet::DEMULTIPLEXER_EPOLL;
+#else
+  options.demultiplexerType = fusenet::DEMULTIPLEXER_SELECT;
+#endif
+  options.lowWatermark = 0;
+  options.highWatermark = 0;
+  options.threads = 1;
+  options.workers = 0;
+  options.queueDepth = 1024;
+  options.journalDirectory = NULL;
+  options.syncInterval = 0;
+
+  // The file system backend has never synced, keep it that way unless asked
+  if (options.backend == BACKEND_FILESYSTEM) {
+    options.syncPolicy = fusenet::SYNC_NONE;
+  } else {
+    options.syncPolicy = fusenet::SYNC_ALWAYS;
+  }
+  options.snapshotSize = 64 * 1024 * 1024;
+  options.sendfileThreshold = 64 * 1024;
+  options.logLevel = fusenet::LOG_LEVEL_INFO;
+  options.collectStatistics = false;
+  options.statisticsFile = NULL;
+  options.statisticsInterval = 10;
+
+  for (i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "--demultiplexer") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "select") == 0) {
+	options.demultiplexerType = fusenet::DEMULTIPLEXER_SELECT;
+      } else if (strcmp(argv[i], "epoll") == 0) {
+	options.demultiplexerType = fusenet::DEMULTIPLEXER_EPOLL;
+      } else if (strcmp(argv[i], "epoll-et") == 0) {
+	options.demultiplexerType = fusenet::DEMULTIPLEXER_EPOLL_EDGE;
+      } else {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--watermarks") == 0 && i + 2 < argc) {
+      options.lowWatermark = strtoul(argv[i + 1], NULL, 10);
+      options.highWatermark = strtoul(argv[i + 2], NULL, 10);
+      i += 2;
+
+      if (options.highWatermark == 0 || options.lowWatermark > options.highWatermark) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threads = atoi(argv[++i]);
+
+      if (options.threads < 1) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      options.workers = atoi(argv[++i]);
+
+      if (options.workers < 0) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+      options.queueDepth = strtoul(argv[++i], NULL, 10);
+
+      if (options.queueDepth == 0) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+      if (!fusenet::Log::parseLevel(argv[++i], options.logLevel)) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--stats-collect") == 0) {
+      options.collectStatistics = true;
+    } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+      options.collectStatistics = true;
+      options.statisticsFile = argv[++i];
+    } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+      options.statisticsInterval = atoi(argv[++i]);
+
+      if (options.statisticsInterval <= 0) {
+	return false;
+      }
+    } else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+      options.journalDirectory = argv[++i];
+    } else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "always") == 0) {
+	options.syncPolicy = fusenet::SYNC_ALWAYS;
+      } else if (strcmp(argv[i], "none") == 0) {
+	options.syncPolicy = fusenet::SYNC_NONE;
+      } else {
+	options.syncPolicy = fusenet::SYNC_INTERVAL;
+	options.syncInterval = atoi(argv[i]);
+
+	if (options.syncInterval <= 0) {
+	  return false;
+	}
+      }
+    } else if (strcmp(argv[i], "--sendfile") == 0 && i + 1 < argc) {
+      options.sendfileThreshold = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--snapshot-size") == 0 && i + 1 < argc) {
+      options.snapshotSize = strtoul(argv[++i], NULL, 10);
+
+      if (options.snapshotSize == 0) {
+	return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  // Only the memory backend needs a journal to be durable
+  if (options.journalDirectory != NULL && options.backend != BACKEND_MEMORY) {
+    return false;
+  }
+
+  return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -54,8 +376,14 @@ int main(int argc, char* argv[]) {
 
   if (argc == 4 && strcmp(argv[1], "--client") == 0) {
     clientBehaviour(argv[2], atoi(argv[3]));
-  } else if (argc == 4 && strcmp(argv[1], "--server") == 0) {
-    serverBehaviour(atoi(argv[2]), strcmp(argv[3], "mem") == 0);
+  } else if (argc >= 4 && strcmp(argv[1], "--server") == 0) {
+    ServerOptions_t options;
+
+    if (!parseServerOptions(argc, argv, options)) {
+      printUsage();
+    } else if (!serverBehaviour(options)) {
+      return 1;
+    }
   } else {
     printUsage();
   }
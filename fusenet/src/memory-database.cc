@@ -4,52 +4,119 @@
  * This file contains the memory database implementation.
  */
 
-#include <iostream>
+#include <sys/time.h>
+
 #include <cassert>
+#include <cstring>
 
+#include "log.h"
 #include "memory-database.h"
+#include "record.h"
+
+/** Arena space wasted by deleted articles before it is reclaimed */
+#define COMPACT_THRESHOLD (64 * 1024)
 
-/* Macros to see if a newsgroup or article id is invalid */
-#define INVALID_NID(x) ((static_cast<size_t>(x) >= mapping.size()) || (mapping[x] == NULL))
-#define INVALID_AID(x, y) (mapping[y]->second == NULL || \
-		((static_cast<size_t>(x) >= mapping[y]->second->size()) || \
-		 (mapping[y]->second->at(x) == NULL)))
+/** Bytes of snapshot collected before they are written */
+#define SNAPSHOT_BLOCK_SIZE (1024 * 1024)
 
 namespace fusenet {
 
+  /**
+   * Journal record types.
+   */
+  typedef enum {
+    JOURNAL_CREATE_NEWSGROUP = 1,  //!< Log: identifier, name
+    JOURNAL_DELETE_NEWSGROUP = 2,  //!< Log: identifier
+    JOURNAL_CREATE_ARTICLE = 3,    //!< Log: newsgroup, identifier, title, author, text
+    JOURNAL_DELETE_ARTICLE = 4,    //!< Log: newsgroup, identifier
+    SNAPSHOT_NEWSGROUP = 5,        //!< Snapshot: identifier, next article, name
+    SNAPSHOT_ARTICLE = 6,          //!< Snapshot: identifier, title, author, text
+    SNAPSHOT_END = 7               //!< Snapshot: next newsgroup
+  } JournalRecordType_t;
+
+  /**
+   * Current time in milliseconds.
+   */
+  static double Milliseconds(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+  }
+
   MemoryDatabase::MemoryDatabase(void) {
-    // Does nothing
+    struct timeval tv;
+
+    // Nothing survives a restart, so the versions start from the
+    // clock, lest a client match a version it saw before it
+    gettimeofday(&tv, NULL);
+    epoch = static_cast<Version_t>(tv.tv_sec * 1000000 + tv.tv_usec);
+    journal = NULL;
+    failed = false;
+  }
+
+  MemoryDatabase::MemoryDatabase(Journal* journal) {
+    // The versions are kept by the journal along with the identifiers
+    epoch = 0;
+
+    // Nothing is logged while the journal is replayed
+    this->journal = NULL;
+    failed = false;
+    recover(journal);
+  }
+
+  bool MemoryDatabase::isRecovered(void) const {
+    return !failed;
   }
 
   /**
    * Get a list of newsgroups that are in the memory database.
    */
   Status_t MemoryDatabase::getNewsgroupList(NewsgroupList_t& newsgroupList) {
-    for (size_t i = 0; i < mapping.size(); ++i) {
-      if (mapping[i]) {
-	newsgroupList.push_back(mapping[i]->first);
+    for (size_t i = 0; i < groups.slots(); ++i) {
+      if (groups.at(i)) {
+	newsgroupList.push_back(groups.at(i)->newsgroup);
       }
     }
     return STATUS_SUCCESS;
   }
+
+  Status_t MemoryDatabase::checkNewsgroup(int newsgroupIdentifier) {
+    if (!groups.find(newsgroupIdentifier))
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    return STATUS_SUCCESS;
+  }
   
   /**
    * Create a new newsgroup.
    */
   Status_t MemoryDatabase::createNewsgroup(std::string& newsgroupName) {
-    for (size_t i = 0; i < idmap.size(); ++i) {
-      if (idmap[i] && !idmap[i]->compare(newsgroupName)) {
-	return STATUS_FAILURE_ALREADY_EXISTS;
+    if (failed) {
+      return STATUS_FAILURE;
+    }
+
+    if (names.find(newsgroupName) != names.end()) {
+      return STATUS_FAILURE_ALREADY_EXISTS;
+    }
+
+    if (journal) {
+      std::string payload;
+      PutNumber(payload, groups.next());
+      PutString(payload, newsgroupName);
+
+      if (!journal->append(MakeRecord(JOURNAL_CREATE_NEWSGROUP, payload))) {
+	return STATUS_FAILURE;
       }
     }
 
     /* create and init a new newsgroup entry */
-    Newsgroup_t ng = {idmap.size(), newsgroupName};
-    pair_t *tmp = new pair_t;
-    tmp->first = ng;
-    tmp->second = NULL;
-    idmap.push_back(new std::string(newsgroupName));
-    mapping.push_back(tmp);
+    Group_t *group = new Group_t;
+    group->arena = new Arena();
+    group->garbage = 0;
+    group->newsgroup.id = groups.insert(group);
+    group->newsgroup.name = newsgroupName;
+    names[newsgroupName] = group->newsgroup.id;
+    checkpoint();
 
     return STATUS_SUCCESS;
   }
@@ -58,21 +125,30 @@ namespace fusenet {
    * Delete newsgroup.
    */
   Status_t MemoryDatabase::deleteNewsgroup(int newsgroupIdentifier) {
-    if (INVALID_NID(newsgroupIdentifier)) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (failed) {
+      return STATUS_FAILURE;
+    }
+
+    if (!group) {
       return STATUS_FAILURE_N_DOES_NOT_EXIST;
     }
 
-    if (mapping[newsgroupIdentifier]->second) {
-      for (size_t i = 0; i < mapping[newsgroupIdentifier]->second->size(); ++i) {
-	delete mapping[newsgroupIdentifier]->second->at(i);
+    if (journal) {
+      std::string payload;
+      PutNumber(payload, newsgroupIdentifier);
+
+      if (!journal->append(MakeRecord(JOURNAL_DELETE_NEWSGROUP, payload))) {
+	return STATUS_FAILURE;
       }
     }
 
-    delete mapping[newsgroupIdentifier]->second;
-    delete idmap[newsgroupIdentifier];
-    delete mapping[newsgroupIdentifier];
-    idmap[newsgroupIdentifier] = NULL;
-    mapping[newsgroupIdentifier] = NULL;
+    names.erase(group->newsgroup.name);
+    groups.erase(newsgroupIdentifier);
+    group->arena->release();
+    delete group;
+    checkpoint();
 
     return STATUS_SUCCESS;
   }
@@ -82,15 +158,87 @@ namespace fusenet {
    */
   Status_t MemoryDatabase::listArticles(int newsgroupIdentifier,
 					ArticleList_t& articleList) {
-    if (INVALID_NID(newsgroupIdentifier))
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (!group)
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    for (size_t i = 0; i < group->articles.slots(); ++i) {
+      if (group->articles.at(i)) {
+	articleList.push_back(Article_t());
+	loadArticle(group->articles.at(i), articleList.back());
+      }
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  /**
+   * List article headers in a newsgroup.
+   */
+  Status_t MemoryDatabase::listArticleHeaders(int newsgroupIdentifier,
+					      ArticleHeaderList_t& headerList) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (!group)
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    for (size_t i = 0; i < group->articles.slots(); ++i) {
+      Record_t* record = group->articles.at(i);
+
+      if (record) {
+	headerList.push_back(ArticleHeader_t());
+	loadHeader(record, headerList.back());
+      }
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t MemoryDatabase::listArticlePage(int newsgroupIdentifier,
+					   int cursor,
+					   ListDirection_t direction,
+					   size_t maxCount,
+					   ArticleHeaderList_t& headerList,
+					   int& nextCursor) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+    long slots;
+    long slot;
+    long step;
+    size_t found = 0;
+
+    nextCursor = CURSOR_NONE;
+
+    if (!group)
       return STATUS_FAILURE_N_DOES_NOT_EXIST;
 
-    if (!mapping[newsgroupIdentifier]->second)
-      return STATUS_SUCCESS;
+    // The slots are in identifier order, so the page starts right
+    // next to the cursor
+    slots = static_cast<long>(group->articles.slots());
 
-    for (size_t i = 0; i < mapping[newsgroupIdentifier]->second->size(); ++i) {
-      if (mapping[newsgroupIdentifier]->second->at(i))
-	articleList.push_back(*(mapping[newsgroupIdentifier]->second->at(i)));
+    if (direction == LIST_FORWARD) {
+      slot = cursor < 0 ? 0 : group->articles.upperBound(cursor);
+      step = 1;
+    } else {
+      slot = (cursor < 0 ? slots : group->articles.upperBound(cursor - 1)) - 1;
+      step = -1;
+    }
+
+    for (; slot >= 0 && slot < slots; slot += step) {
+      Record_t* record = group->articles.at(slot);
+
+      if (!record) {
+	continue;
+      }
+
+      if (found == maxCount) {
+	nextCursor = found > 0 ? headerList.back().id : cursor;
+	break;
+      }
+
+      headerList.push_back(ArticleHeader_t());
+      loadHeader(record, headerList.back());
+      found++;
     }
 
     return STATUS_SUCCESS;
@@ -101,14 +249,31 @@ namespace fusenet {
    */
   Status_t MemoryDatabase::createArticle(int newsgroupIdentifier,
                                          Article_t& article) {
-    if (INVALID_NID(newsgroupIdentifier))
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (failed)
+      return STATUS_FAILURE;
+
+    if (!group)
       return STATUS_FAILURE_N_DOES_NOT_EXIST;
 
-    if (mapping[newsgroupIdentifier]->second == NULL)
-      mapping[newsgroupIdentifier]->second = new std::vector<Article_t *>;
+    if (journal) {
+      std::string payload;
+      payload.reserve(24 + article.title.size() + article.author.size() +
+		      article.text.size());
+      PutNumber(payload, newsgroupIdentifier);
+      PutNumber(payload, group->articles.next());
+      PutString(payload, article.title);
+      PutString(payload, article.author);
+      PutString(payload, article.text);
 
-    article.id = mapping[newsgroupIdentifier]->second->size();
-    mapping[newsgroupIdentifier]->second->push_back(new Article_t(article));
+      if (!journal->append(MakeRecord(JOURNAL_CREATE_ARTICLE, payload)))
+	return STATUS_FAILURE;
+    }
+
+    Record_t *record = storeRecord(*group->arena, article);
+    article.id = record->id = group->articles.insert(record);
+    checkpoint();
     return STATUS_SUCCESS;
   }
 
@@ -117,14 +282,34 @@ namespace fusenet {
    */
   Status_t MemoryDatabase::deleteArticle(int newsgroupIdentifier,
 					 int articleIdentifier) {
-    if (INVALID_NID(newsgroupIdentifier))
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (failed)
+      return STATUS_FAILURE;
+
+    if (!group)
       return STATUS_FAILURE_N_DOES_NOT_EXIST;
 
-    if (INVALID_AID(articleIdentifier, newsgroupIdentifier))
+    if (!group->articles.find(articleIdentifier))
       return STATUS_FAILURE_A_DOES_NOT_EXIST;
 
-    delete mapping[newsgroupIdentifier]->second->at(articleIdentifier);
-    mapping[newsgroupIdentifier]->second->at(articleIdentifier) = NULL;
+    if (journal) {
+      std::string payload;
+      PutNumber(payload, newsgroupIdentifier);
+      PutNumber(payload, articleIdentifier);
+
+      if (!journal->append(MakeRecord(JOURNAL_DELETE_ARTICLE, payload)))
+	return STATUS_FAILURE;
+    }
+
+    Record_t *record = group->articles.erase(articleIdentifier);
+    group->garbage += recordSize(record);
+
+    if (group->garbage > COMPACT_THRESHOLD &&
+	group->garbage > group->arena->allocated() / 2)
+      compactGroup(group);
+
+    checkpoint();
     return STATUS_SUCCESS;
   }
 
@@ -134,27 +319,397 @@ namespace fusenet {
   Status_t MemoryDatabase::getArticle(int newsgroupIdentifier,
 				      int articleIdentifier,
 				      Article_t& article) {
-    if (INVALID_NID(newsgroupIdentifier))
+    Group_t *group = groups.find(newsgroupIdentifier);
+    Record_t *record;
+
+    if (!group)
       return STATUS_FAILURE_N_DOES_NOT_EXIST;
 
-    if (INVALID_AID(articleIdentifier, newsgroupIdentifier))
+    record = group->articles.find(articleIdentifier);
+
+    if (!record)
       return STATUS_FAILURE_A_DOES_NOT_EXIST;
 
-    article = *(mapping[newsgroupIdentifier]->second->at(articleIdentifier));
+    loadArticle(record, article);
+    return STATUS_SUCCESS;
+  }
+
+  /**
+   * Get a reference to an article in a newsgroup
+   */
+  Status_t MemoryDatabase::getArticleRef(int newsgroupIdentifier,
+					 int articleIdentifier,
+					 ArticleRef& article) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+    Record_t *record;
+
+    if (!group)
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    record = group->articles.find(articleIdentifier);
+
+    if (!record)
+      return STATUS_FAILURE_A_DOES_NOT_EXIST;
+
+    referArticle(group->arena, record, article);
+    return STATUS_SUCCESS;
+  }
+
+  /**
+   * Get references to several articles in a newsgroup
+   */
+  Status_t MemoryDatabase::getArticleRefs(int newsgroupIdentifier,
+					  const IdentifierList_t& articleIdentifiers,
+					  ArticleRefList_t& articles,
+					  StatusList_t& statuses) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+    Record_t *record;
+    size_t i;
+
+    if (!group)
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    articles.resize(articleIdentifiers.size());
+    statuses.resize(articleIdentifiers.size());
+
+    for (i = 0; i < articleIdentifiers.size(); i++) {
+      record = group->articles.find(articleIdentifiers[i]);
+
+      if (record) {
+	referArticle(group->arena, record, articles[i]);
+	statuses[i] = STATUS_SUCCESS;
+      } else {
+	articles[i].reset();
+	statuses[i] = STATUS_FAILURE_A_DOES_NOT_EXIST;
+      }
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  /**
+   * Get the version of the newsgroup list
+   */
+  Status_t MemoryDatabase::getNewsgroupListVersion(Version_t& version) {
+    version = epoch + groups.changes() + 1;
     return STATUS_SUCCESS;
   }
+
+  /**
+   * Get the version of a newsgroup
+   */
+  Status_t MemoryDatabase::getNewsgroupVersion(int newsgroupIdentifier,
+					       Version_t& version) {
+    Group_t *group = groups.find(newsgroupIdentifier);
+
+    if (!group)
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+
+    version = epoch + group->articles.changes() + 1;
+    return STATUS_SUCCESS;
+  }
+
+  size_t MemoryDatabase::recordSize(const Record_t* record) {
+    return sizeof(Record_t) + record->titleSize + record->authorSize +
+      record->textSize;
+  }
+
+  MemoryDatabase::Record_t* MemoryDatabase::storeRecord(Arena& arena,
+							const Article_t& article) {
+    Record_t header;
+    Record_t* record;
+    char* data;
+
+    header.id = 0;
+    header.titleSize = article.title.size();
+    header.authorSize = article.author.size();
+    header.textSize = article.text.size();
+
+    record = static_cast<Record_t*>(arena.allocate(recordSize(&header)));
+    *record = header;
+    data = reinterpret_cast<char*>(record + 1);
+    memcpy(data, article.title.data(), header.titleSize);
+    data += header.titleSize;
+    memcpy(data, article.author.data(), header.authorSize);
+    data += header.authorSize;
+    memcpy(data, article.text.data(), header.textSize);
+
+    return record;
+  }
+
+  void MemoryDatabase::loadHeader(const Record_t* record,
+				  ArticleHeader_t& header) {
+    const char* data = reinterpret_cast<const char*>(record + 1);
+
+    header.id = record->id;
+    header.title.assign(data, record->titleSize);
+    header.author.assign(data + record->titleSize, record->authorSize);
+    header.size = record->textSize;
+  }
+
+  void MemoryDatabase::loadArticle(const Record_t* record,
+				   Article_t& article) {
+    const char* data = reinterpret_cast<const char*>(record + 1);
+
+    article.id = record->id;
+    article.title.assign(data, record->titleSize);
+    data += record->titleSize;
+    article.author.assign(data, record->authorSize);
+    data += record->authorSize;
+    article.text.assign(data, record->textSize);
+  }
+
+  void MemoryDatabase::referArticle(Arena* arena, const Record_t* record,
+				    ArticleRef& article) {
+    const char* data = reinterpret_cast<const char*>(record + 1);
+
+    article.set(arena, record->id,
+		data, record->titleSize,
+		data + record->titleSize, record->authorSize,
+		data + record->titleSize + record->authorSize, record->textSize);
+  }
+
+  void MemoryDatabase::compactGroup(Group_t* group) {
+    Arena* arena = new Arena();
+
+    for (size_t i = 0; i < group->articles.slots(); ++i) {
+      Record_t* record = group->articles.at(i);
+
+      if (record) {
+	size_t size = recordSize(record);
+	void* copy = arena->allocate(size);
+
+	memcpy(copy, record, size);
+	group->articles.replace(i, static_cast<Record_t*>(copy));
+      }
+    }
+
+    // References into the old arena keep it alive until released
+    group->arena->release();
+    group->arena = arena;
+    group->garbage = 0;
+  }
   
-  MemoryDatabase::~MemoryDatabase(void) {
-    for (size_t i = 0; i < mapping.size(); ++i) {
-      if (mapping[i] && mapping[i]->second) {
-	for (size_t j = 0; j < mapping[i]->second->size(); ++j) {
-	  delete mapping[i]->second->at(j);
+  void MemoryDatabase::recover(Journal* journal) {
+    RecordReader reader(journal->getLog());
+    double start = Milliseconds();
+    std::string record;
+    size_t articles = 0;
+    size_t changes = 0;
+    bool intact = true;
+
+    if (journal->getLog() == -1) {
+      intact = false;
+    } else if (journal->getSnapshot() != -1 && !loadSnapshot(journal->getSnapshot())) {
+      LOG(LOG_LEVEL_ERROR) << "[MemoryDatabase] Snapshot is damaged";
+      intact = false;
+    }
+
+    while (intact && reader.next(record)) {
+      if (!replay(record)) {
+	LOG(LOG_LEVEL_ERROR) << "[MemoryDatabase] Log does not match snapshot at offset "
+			     << reader.getOffset() - record.size();
+	intact = false;
+      }
+
+      changes++;
+    }
+
+    // Never write over a journal that could not be read back, the
+    // data in it would be lost for good. Neither serve what was read
+    // of it, nor take changes that could not be saved.
+    if (!intact || !journal->start(reader.getOffset())) {
+      LOG(LOG_LEVEL_ERROR) << "[MemoryDatabase] Unable to recover journal";
+      delete journal;
+      unload();
+      failed = true;
+      return;
+    }
+
+    for (size_t i = 0; i < groups.slots(); ++i) {
+      if (groups.at(i)) {
+	articles += groups.at(i)->articles.size();
+      }
+    }
+
+    LOG(LOG_LEVEL_INFO) << "[MemoryDatabase] Recovered " << groups.size() << " newsgroup(s) and "
+			<< articles << " article(s), replaying " << changes << " change(s), in "
+			<< Milliseconds() - start << " ms";
+    this->journal = journal;
+  }
+
+  bool MemoryDatabase::replay(const std::string& record) {
+    size_t position = RECORD_HEADER_SIZE;
+    uint32_t newsgroupIdentifier;
+    uint32_t articleIdentifier;
+    std::string newsgroupName;
+    Article_t article;
+    Group_t* group;
+
+    if (!GetNumber(record, position, newsgroupIdentifier)) {
+      return false;
+    }
+
+    switch (record[0]) {
+    case JOURNAL_CREATE_NEWSGROUP:
+      return GetString(record, position, newsgroupName) &&
+	static_cast<int>(newsgroupIdentifier) == groups.next() &&
+	IS_SUCCESS(createNewsgroup(newsgroupName));
+    case JOURNAL_DELETE_NEWSGROUP:
+      return IS_SUCCESS(deleteNewsgroup(newsgroupIdentifier));
+    case JOURNAL_CREATE_ARTICLE:
+      group = groups.find(newsgroupIdentifier);
+      return group && GetNumber(record, position, articleIdentifier) &&
+	static_cast<int>(articleIdentifier) == group->articles.next() &&
+	GetString(record, position, article.title) &&
+	GetString(record, position, article.author) &&
+	GetString(record, position, article.text) &&
+	IS_SUCCESS(createArticle(newsgroupIdentifier, article));
+    case JOURNAL_DELETE_ARTICLE:
+      return GetNumber(record, position, articleIdentifier) &&
+	IS_SUCCESS(deleteArticle(newsgroupIdentifier, articleIdentifier));
+    default:
+      return false;
+    }
+  }
+
+  bool MemoryDatabase::loadSnapshot(int descriptor) {
+    RecordReader reader(descriptor);
+    Group_t* group = NULL;
+    std::string record;
+    Article_t article;
+
+    while (reader.next(record)) {
+      size_t position = RECORD_HEADER_SIZE;
+      uint32_t identifier;
+      uint32_t next;
+
+      if (!GetNumber(record, position, identifier)) {
+	return false;
+      }
+
+      if (record[0] == SNAPSHOT_NEWSGROUP) {
+	std::string name;
+
+	if (!GetNumber(record, position, next) ||
+	    !GetString(record, position, name)) {
+	  return false;
 	}
-	delete mapping[i]->second;
+
+	group = new Group_t;
+	group->arena = new Arena();
+	group->garbage = 0;
+	group->newsgroup.id = identifier;
+	group->newsgroup.name = name;
+	group->articles.skip(next);
+	groups.restore(identifier, group);
+	names[name] = identifier;
+      } else if (record[0] == SNAPSHOT_ARTICLE && group) {
+	Record_t* stored;
+
+	if (!GetString(record, position, article.title) ||
+	    !GetString(record, position, article.author) ||
+	    !GetString(record, position, article.text)) {
+	  return false;
+	}
+
+	stored = storeRecord(*group->arena, article);
+	stored->id = identifier;
+	group->articles.restore(identifier, stored);
+      } else if (record[0] == SNAPSHOT_END) {
+	groups.skip(identifier);
+	return true;
+      } else {
+	return false;
       }
-      delete mapping[i];
-      delete idmap[i];
     }
+
+    // A snapshot without an end was cut short
+    return false;
   }
-}
 
+  bool MemoryDatabase::saveSnapshot(int descriptor) {
+    std::string buffer;
+    std::string payload;
+
+    for (size_t i = 0; i < groups.slots(); ++i) {
+      Group_t* group = groups.at(i);
+
+      if (!group) {
+	continue;
+      }
+
+      payload.clear();
+      PutNumber(payload, group->newsgroup.id);
+      PutNumber(payload, group->articles.next());
+      PutString(payload, group->newsgroup.name);
+      buffer += MakeRecord(SNAPSHOT_NEWSGROUP, payload);
+
+      for (size_t j = 0; j < group->articles.slots(); ++j) {
+	Record_t* record = group->articles.at(j);
+	const char* data;
+
+	if (!record) {
+	  continue;
+	}
+
+	data = reinterpret_cast<const char*>(record + 1);
+	payload.clear();
+	PutNumber(payload, record->id);
+	PutString(payload, data, record->titleSize);
+	PutString(payload, data + record->titleSize, record->authorSize);
+	PutString(payload, data + record->titleSize + record->authorSize,
+		  record->textSize);
+	buffer += MakeRecord(SNAPSHOT_ARTICLE, payload);
+
+	if (buffer.size() >= SNAPSHOT_BLOCK_SIZE) {
+	  if (!WriteFully(descriptor, buffer.data(), buffer.size())) {
+	    return false;
+	  }
+
+	  buffer.clear();
+	}
+      }
+    }
+
+    payload.clear();
+    PutNumber(payload, groups.next());
+    buffer += MakeRecord(SNAPSHOT_END, payload);
+    return WriteFully(descriptor, buffer.data(), buffer.size());
+  }
+
+  void MemoryDatabase::checkpoint(void) {
+    double start;
+    int descriptor;
+
+    if (!journal || !journal->isSnapshotDue()) {
+      return;
+    }
+
+    start = Milliseconds();
+    descriptor = journal->beginSnapshot();
+
+    if (journal->commitSnapshot(descriptor,
+				descriptor != -1 && saveSnapshot(descriptor))) {
+      LOG(LOG_LEVEL_INFO) << "[MemoryDatabase] Snapshot written in "
+			  << Milliseconds() - start << " ms";
+    }
+  }
+
+  void MemoryDatabase::unload(void) {
+    for (size_t i = 0; i < groups.slots(); ++i) {
+      if (groups.at(i)) {
+	groups.at(i)->arena->release();
+	delete groups.at(i);
+      }
+    }
+
+    groups = GroupTable_t();
+    names.clear();
+  }
+
+  MemoryDatabase::~MemoryDatabase(void) {
+    delete journal;
+    unload();
+  }
+}
@@ -7,18 +7,48 @@
  * This file contains the memory database interface.
  */
 
+#include <stdint.h>
+
+#include <string>
+#include <tr1/unordered_map>
+
+#include "arena.h"
 #include "fusenet-types.h"
 #include "database.h"
+#include "journal.h"
+#include "slot-table.h"
 
 namespace fusenet {
 
   /**
    * Memory database.
    *
-   * The database is based on vectors to keep it all in memory and
-   * also to keep the article identifier and newsgroup identifier
-   * unique. This wastes memory (4 bytes per removed node) but it's a
-   * loss we can take.
+   * Newsgroups and the articles of each newsgroup are kept in slot
+   * tables, which keep the identifiers unique while lookups take
+   * constant time and listings only visit live entries. Newsgroup
+   * names are hashed to find duplicates without a scan.
+   *
+   * Each newsgroup stores its articles in an arena, one record per
+   * article holding the header and the text back to back. Deleting a
+   * newsgroup frees its arena chunk by chunk instead of article by
+   * article. Deleted articles are left in the arena until they make
+   * up more than half of it, at which point the live records are
+   * copied to a fresh arena.
+   *
+   * Records are never changed once stored, so getArticleRef() hands
+   * out references straight into the arena. A reference keeps its
+   * arena alive, even if the newsgroup is deleted or compacted.
+   *
+   * The database is volatile unless it is given a journal. Every
+   * change is then appended to the journal log before it is
+   * acknowledged, and once the log has grown large enough the whole
+   * database is written to a snapshot and the log starts over. On
+   * startup the snapshot is loaded and the log replayed on top of
+   * it.
+   *
+   * The versions of the newsgroup list and of each newsgroup count
+   * the changes to their slot tables, which needs no bookkeeping of
+   * its own and is restored along with the identifiers.
    */
   class MemoryDatabase : public Database {
 
@@ -29,11 +59,31 @@ namespace fusenet {
      */
     MemoryDatabase(void);
 
+    /**
+     * Create instance, recovering the database from a journal and
+     * recording every change in it from then on.
+     *
+     * @param journal the journal, which is owned by the database
+     */
+    MemoryDatabase(Journal* journal);
+
+    /**
+     * Check if the journal given to the constructor was recovered. If
+     * it was not, the database is empty and refuses every change, as
+     * none of them could be saved.
+     */
+    bool isRecovered(void) const;
+
     /**
      * Get all newsgroups.
      */
     Status_t getNewsgroupList(NewsgroupList_t& newsgroupList);
 
+    /**
+     * Check that a newsgroup exists.
+     */
+    Status_t checkNewsgroup(int newsgroupIdentifier);
+
     /**
      * Create newsgroups.
      */
@@ -50,6 +100,23 @@ namespace fusenet {
     Status_t listArticles(int newsgroupIdentifier,
 			  ArticleList_t& articleList);
 
+    /**
+     * List article headers.
+     */
+    Status_t listArticleHeaders(int newsgroupIdentifier,
+				ArticleHeaderList_t& headerList);
+
+    /**
+     * List a page of article headers, starting next to the cursor
+     * found by binary search.
+     */
+    Status_t listArticlePage(int newsgroupIdentifier,
+			     int cursor,
+			     ListDirection_t direction,
+			     size_t maxCount,
+			     ArticleHeaderList_t& headerList,
+			     int& nextCursor);
+
     /**
      * Create article.
      */
@@ -69,6 +136,34 @@ namespace fusenet {
 			int articleIdentifier,
 			Article_t& article);
 
+    /**
+     * Get a reference to an article.
+     */
+    Status_t getArticleRef(int newsgroupIdentifier,
+			   int articleIdentifier,
+			   ArticleRef& article);
+
+    /**
+     * Get references to several articles, looking up the newsgroup
+     * once.
+     */
+    Status_t getArticleRefs(int newsgroupIdentifier,
+			    const IdentifierList_t& articleIdentifiers,
+			    ArticleRefList_t& articles,
+			    StatusList_t& statuses);
+
+    /**
+     * Get the version of the newsgroup list, derived from the
+     * newsgroup table.
+     */
+    Status_t getNewsgroupListVersion(Version_t& version);
+
+    /**
+     * Get the version of a newsgroup, derived from its article table.
+     */
+    Status_t getNewsgroupVersion(int newsgroupIdentifier,
+				 Version_t& version);
+
     /**
      * Destroy instance.
      */
@@ -77,18 +172,122 @@ namespace fusenet {
   private:
 
     /**
-     * Pair type.
+     * Article record type. The title, author and text follow the
+     * record in the arena, in that order.
      */
     typedef struct {
-      fusenet::Newsgroup_t first;
-      std::vector<fusenet::Article_t*> *second;
-    } pair_t;
+      int id;                //!< Identifier
+      uint32_t titleSize;    //!< Title length
+      uint32_t authorSize;   //!< Author length
+      uint32_t textSize;     //!< Text length
+    } Record_t;
+
+    typedef SlotTable<Record_t> RecordTable_t;
+
+    /**
+     * Newsgroup type.
+     */
+    typedef struct {
+      Newsgroup_t newsgroup;    //!< Identifier and name
+      RecordTable_t articles;   //!< Articles
+      Arena* arena;             //!< Storage of the article records
+      size_t garbage;           //!< Bytes of deleted records in the arena
+    } Group_t;
+
+    typedef SlotTable<Group_t> GroupTable_t;
+    typedef std::tr1::unordered_map<std::string, int> NameMap_t;
+
+    /**
+     * Get the size of a record, title, author and text included.
+     */
+    static size_t recordSize(const Record_t* record);
+
+    /**
+     * Store an article as a record in an arena.
+     *
+     * @return the record, with its identifier not yet set
+     */
+    static Record_t* storeRecord(Arena& arena, const Article_t& article);
+
+    /**
+     * Read the header of an article from its record.
+     */
+    static void loadHeader(const Record_t* record, ArticleHeader_t& header);
+
+    /**
+     * Read an article from its record.
+     */
+    static void loadArticle(const Record_t* record, Article_t& article);
+
+    /**
+     * Refer to an article in its record, which is kept alive by the
+     * arena of its newsgroup.
+     */
+    static void referArticle(Arena* arena, const Record_t* record, ArticleRef& article);
+
+    /**
+     * Copy the records of a newsgroup to a fresh arena, leaving the
+     * deleted ones behind.
+     */
+    static void compactGroup(Group_t* group);
+
+    /**
+     * Load the snapshot and replay the log of a journal.
+     */
+    void recover(Journal* journal);
+
+    /**
+     * Drop all newsgroups and articles.
+     */
+    void unload(void);
+
+    /**
+     * Apply a change read from the log.
+     *
+     * @return false if the record does not match the database
+     */
+    bool replay(const std::string& record);
 
-    typedef std::vector<std::string*> idmap_t;
-    typedef std::vector<pair_t*> mapping_t;
+    /**
+     * Load a snapshot into the empty database.
+     */
+    bool loadSnapshot(int descriptor);
+
+    /**
+     * Write the database to a snapshot.
+     */
+    bool saveSnapshot(int descriptor);
+
+    /**
+     * Take a snapshot, if one is due.
+     */
+    void checkpoint(void);
+
+    /**
+     * Newsgroups.
+     */
+    GroupTable_t groups;
 
-    idmap_t idmap;
-    mapping_t mapping;
+    /**
+     * Newsgroup identifiers by name.
+     */
+    NameMap_t names;
+
+    /**
+     * Journal, or NULL if the database is volatile.
+     */
+    Journal* journal;
+
+    /**
+     * True if a journal could not be recovered.
+     */
+    bool failed;
+
+    /**
+     * Added to every version, so that a volatile database does not
+     * hand out the versions of an earlier run.
+     */
+    Version_t epoch;
   };
 }
 
@@ -0,0 +1,33 @@
+/**
+ * @file
+ *
+ * This file contains the message builder implementation.
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include "message-builder.h"
+
+namespace fusenet {
+
+  MessageBuilder::MessageBuilder(Transport* transport, size_t size) {
+    position = transport->extend(size);
+    end = position + size;
+  }
+
+  MessageBuilder::MessageBuilder(uint8_t* buffer, size_t size) {
+    position = buffer;
+    end = position + size;
+  }
+
+  void MessageBuilder::addString(const char* data, size_t length) {
+    addStringHeader(length);
+    memcpy(position, data, length);
+    position += length;
+  }
+
+  MessageBuilder::~MessageBuilder(void) {
+    assert(position == end);
+  }
+}
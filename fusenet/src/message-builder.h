@@ -0,0 +1,139 @@
+#ifndef MESSAGE_BUILDER_H
+#define MESSAGE_BUILDER_H
+
+/**
+ * @file
+ *
+ * This file contains the message builder interface.
+ */
+
+#include <string>
+
+#include "fusenet-types.h"
+#include "message-identifiers.h"
+#include "transport.h"
+
+namespace fusenet {
+
+  /**
+   * Message builder. Encodes a whole message straight into the send
+   * buffer of a transport. The size of the message is worked out up
+   * front from the sizes of its parts, so that the buffer grows once
+   * per message and every part is written with a few plain stores,
+   * instead of growing the buffer a part or a byte at a time.
+   *
+   * The parts added must add up to exactly the size given when the
+   * builder was created.
+   */
+  class MessageBuilder {
+
+  public:
+
+    /**
+     * Size of a command.
+     */
+    static size_t commandSize(void) {
+      return 1;
+    }
+
+    /**
+     * Size of a number parameter.
+     */
+    static size_t numberSize(void) {
+      return 5;
+    }
+
+    /**
+     * Size of a string parameter.
+     *
+     * @param length the length of the string
+     */
+    static size_t stringSize(size_t length) {
+      return 5 + length;
+    }
+
+    /**
+     * Start a message at the end of the send buffer of a transport.
+     * Nothing else may be sent on the transport until the message is
+     * complete.
+     *
+     * @param transport the transport
+     * @param size the size of the message in bytes
+     */
+    MessageBuilder(Transport* transport, size_t size);
+
+    /**
+     * Start a message in a buffer of its own, to be sent later.
+     *
+     * @param buffer the buffer
+     * @param size the size of the message in bytes
+     */
+    MessageBuilder(uint8_t* buffer, size_t size);
+
+    /**
+     * Add a command.
+     */
+    void addCommand(MessageIdentifier_t command) {
+      *position++ = command;
+    }
+
+    /**
+     * Add a number parameter.
+     */
+    void addNumber(uint32_t number) {
+      position[0] = PAR_NUM;
+      putLength(number);
+    }
+
+    /**
+     * Add a string parameter.
+     */
+    void addString(const char* data, size_t length);
+
+    /**
+     * Add a string parameter.
+     */
+    void addString(const std::string& parameter) {
+      addString(parameter.data(), parameter.size());
+    }
+
+    /**
+     * Add the type and length of a string parameter, whose bytes
+     * are sent some other way.
+     */
+    void addStringHeader(size_t length) {
+      position[0] = PAR_STRING;
+      putLength(length);
+    }
+
+    /**
+     * Check that the message is complete.
+     */
+    ~MessageBuilder(void);
+
+  private:
+
+    /**
+     * Store four bytes in network order after the type byte.
+     */
+    void putLength(uint32_t number) {
+      position[1] = (number >> 24) & 0xff;
+      position[2] = (number >> 16) & 0xff;
+      position[3] = (number >>  8) & 0xff;
+      position[4] = (number >>  0) & 0xff;
+      position += 5;
+    }
+
+    /**
+     * Where the next part goes.
+     */
+    uint8_t* position;
+
+    /**
+     * End of the message.
+     */
+    uint8_t* end;
+  };
+}
+
+#endif
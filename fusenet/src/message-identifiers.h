@@ -14,6 +14,10 @@ namespace fusenet {
    * protocol between the server and the client. The code has more or
    * less been taken from the protocol.h header file by Per Holm and
    * friends.
+   *
+   * Our own extensions use commands from 9 to 19, answers from 30 to
+   * 39 and errors from 53 up, which the original protocol leaves
+   * unused.
    */
 
   typedef enum {
@@ -26,6 +30,13 @@ namespace fusenet {
     COM_DELETE_ART = 6,           //!< Delete article
     COM_GET_ART    = 7,           //!< Get article
     COM_END        = 8,           //!< Command end (not really a command)
+    COM_GET_ARTS   = 9,           //!< Get several articles
+    COM_LIST_ART_PAGE = 10,       //!< List a page of articles
+    COM_SUBSCRIBE  = 11,          //!< Subscribe to a newsgroup
+    COM_UNSUBSCRIBE = 12,         //!< Unsubscribe from a newsgroup
+    COM_LIST_NG_IF = 13,          //!< List newsgroups if modified
+    COM_LIST_ART_IF = 14,         //!< List articles if modified
+    COM_STATS      = 15,          //!< Get server statistics
     
     // Answer identifiers
     ANS_LIST_NG    = 20,          //!< Answer list newsgroups
@@ -38,6 +49,15 @@ namespace fusenet {
     ANS_END        = 27,          //!< Answer end
     ANS_ACK        = 28,          //!< Acknowledge (not really answers)
     ANS_NAK        = 29,          //!< Negative acknowledge (not really answers)
+    ANS_GET_ARTS   = 30,          //!< Answer get several articles
+    ANS_LIST_ART_PAGE = 31,       //!< Answer list a page of articles
+    ANS_SUBSCRIBE  = 32,          //!< Answer subscribe
+    ANS_UNSUBSCRIBE = 33,         //!< Answer unsubscribe
+    ANS_NEW_ART    = 34,          //!< New article (sent unasked)
+    ANS_ART_DELETED = 35,         //!< Deleted article (sent unasked)
+    ANS_LIST_NG_IF = 36,          //!< Answer list newsgroups if modified
+    ANS_LIST_ART_IF = 37,         //!< Answer list articles if modified
+    ANS_STATS      = 38,          //!< Answer get server statistics
 
     // Parameter identifiers
     PAR_STRING     = 40,          //!< String
@@ -46,7 +66,8 @@ namespace fusenet {
     // Error code identifiers
     ERR_NG_ALREADY_EXISTS  = 50,  //!< Newsgroup already exists
     ERR_NG_DOES_NOT_EXIST  = 51,  //!< Newsgroup does not exist
-    ERR_ART_DOES_NOT_EXIST = 52   //!< Article does not exist
+    ERR_ART_DOES_NOT_EXIST = 52,  //!< Article does not exist
+    ERR_NOT_MODIFIED       = 53   //!< Nothing changed since the version given
   }
   MessageIdentifier_t;
 }
@@ -4,6 +4,7 @@
  * This file contains the message protocol implementation.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include "message-protocol.h"
@@ -19,31 +20,38 @@ namespace fusenet {
   }
 
   void MessageProtocol::sendParameter(const std::string& parameter) {
-    uint8_t number[4];
-    size_t i;
+    sendParameter(parameter.data(), parameter.length());
+  }
 
-    unpack(parameter.length(), number);
-    transport->send(PAR_STRING);
-    
-    for (i = 0; i < 4; i++) {
-      transport->send(number[i]);
-    }
+  void MessageProtocol::sendParameter(const char* data, size_t length) {
+    uint8_t header[5];
 
-    for (i = 0; i < parameter.length(); i++) {
-      transport->send(parameter[i]);
-    }
+    header[0] = PAR_STRING;
+    unpack(length, header + 1);
+    transport->send(header, sizeof(header));
+    transport->send(reinterpret_cast<const uint8_t*>(data), length);
+  }
+
+  void MessageProtocol::sendParameter(Shared* owner, int descriptor,
+				      off_t offset, size_t length) {
+    uint8_t header[5];
+
+    header[0] = PAR_STRING;
+    unpack(length, header + 1);
+    transport->send(header, sizeof(header));
+    transport->sendFile(owner, descriptor, offset, length);
   }
 
   void MessageProtocol::sendParameter(int parameter) {
-    uint8_t number[4];
-    size_t i;
+    uint8_t header[5];
 
-    unpack(parameter, number);
-    transport->send(PAR_NUM);
+    header[0] = PAR_NUM;
+    unpack(parameter, header + 1);
+    transport->send(header, sizeof(header));
+  }
 
-    for (i = 0; i < 4; i++) {
-      transport->send(number[i]);
-    }
+  void MessageProtocol::flush(void) {
+    transport->flush();
   }
 
   MessageIdentifier_t MessageProtocol::receiveCommand(void) {
@@ -52,35 +60,51 @@ namespace fusenet {
 
   void MessageProtocol::receiveParameter(std::string& parameter) {
     uint8_t number[4];
-    size_t i;
+    uint8_t block[4096];
     size_t n;
 
     expectCommand(PAR_STRING);
-
-    for (i = 0; i < 4; i++) {
-      number[i] = transport->receive();
-    }
-
+    receiveBlock(number, sizeof(number));
     pack(number, &n);
 
     parameter.clear();
+    parameter.reserve(n);
 
-    for (i = 0; i < n; i++) {
-      parameter += transport->receive();
+    while (n > 0 && !transport->isClosed()) {
+      size_t length = n < sizeof(block) ? n : sizeof(block);
+      receiveBlock(block, length);
+      parameter.append(reinterpret_cast<char*>(block), length);
+      n -= length;
     }
   }
 
   void MessageProtocol::receiveParameter(int* const parameter) {
     uint8_t number[4];
-    size_t i;
+    size_t n;
 
     expectCommand(PAR_NUM);
+    receiveBlock(number, sizeof(number));
 
-    for (i = 0; i < 4; i++) {
-      number[i] = transport->receive();
-    }
+    // Pack into a size_t first, it is wider than an int on 64-bit
+    // platforms
+    pack(number, &n);
+    *parameter = static_cast<int>(n);
+  }
+
+  void MessageProtocol::receiveBlock(uint8_t* const data, size_t length) {
+    size_t n = 0;
+
+    while (n < length) {
+      size_t received = transport->receive(data + n, length - n);
 
-    pack(number, reinterpret_cast<size_t*>(parameter));
+      if (received == 0) {
+	// Closed, leave the rest zeroed
+	std::fill(data + n, data + length, 0);
+	break;
+      }
+
+      n += received;
+    }
   }
 
   void MessageProtocol::onConnectionLost(void) {
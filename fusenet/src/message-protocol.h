@@ -53,6 +53,25 @@ namespace fusenet {
      */
     void sendParameter(const std::string& parameter);
 
+    /**
+     * Send a string parameter from a buffer.
+     *
+     * @param data the string
+     * @param length the length of the string
+     */
+    void sendParameter(const char* data, size_t length);
+
+    /**
+     * Send a string parameter that is stored in a file. The string
+     * is sent straight from the file when the message is flushed.
+     *
+     * @param owner the object that keeps the file open
+     * @param descriptor the file
+     * @param offset where the string starts in the file
+     * @param length the length of the string
+     */
+    void sendParameter(Shared* owner, int descriptor, off_t offset, size_t length);
+
     /**
      * Send a number parameter.
      *
@@ -60,6 +79,11 @@ namespace fusenet {
      */
     void sendParameter(int parameter);
 
+    /**
+     * Flush sent data. Call this at the end of each message.
+     */
+    void flush(void);
+
     /**
      * Receive an command.
      *
@@ -93,7 +117,7 @@ namespace fusenet {
      */
     virtual void onConnectionLost(void);
 
-  private:
+  protected:
 
     /**
      * Unpack to a byte array.
@@ -110,6 +134,17 @@ namespace fusenet {
      * @param integer the packed integer
      */
     void pack(const uint8_t* const array, size_t* const integer);
+
+  private:
+
+    /**
+     * Receive a block of data. Blocks until all of it has arrived or
+     * the transport closes.
+     *
+     * @param data where to store the data
+     * @param length the number of bytes
+     */
+    void receiveBlock(uint8_t* const data, size_t length);
   };
 
 }
@@ -9,45 +9,210 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <cassert>
+#include <cstring>
 #include <sstream>
 #include <csignal>
 
+#include "log.h"
 #include "network-reactor.h"
 
 #define BACKLOG 8
+#define RECEIVE_SIZE 16384
+#define DEFAULT_LOW_WATERMARK (256 * 1024)
+#define DEFAULT_HIGH_WATERMARK (1024 * 1024)
 #define PREFIX "[NetworkReactor] "
 
-#define MAX(x, y) (((x) > (y)) ? (x) : (y))
-
 namespace fusenet {
 
   NetworkReactor::NetworkReactor(void) {
+    initialize(Demultiplexer::create(DEMULTIPLEXER_SELECT));
+  }
+
+  NetworkReactor::NetworkReactor(Demultiplexer* demultiplexer) {
+    initialize(demultiplexer);
+  }
+
+  void NetworkReactor::initialize(Demultiplexer* demultiplexer) {
     // Disable broken pipe signal
     signal(SIGPIPE, SIG_IGN);
+    this->demultiplexer = demultiplexer;
+    lowWatermark = DEFAULT_LOW_WATERMARK;
+    highWatermark = DEFAULT_HIGH_WATERMARK;
+    reusePort = false;
+    wakeupDescriptors[0] = -1;
+    wakeupDescriptors[1] = -1;
+    wakeupPending = false;
+    pthread_mutex_init(&completedMutex, NULL);
+  }
+
+  void NetworkReactor::setWatermarks(size_t low, size_t high) {
+    lowWatermark = low;
+    highWatermark = (high < low) ? low : high;
+  }
+
+  bool NetworkReactor::setReusePort(bool reusePort) {
+#ifdef SO_REUSEPORT
+    this->reusePort = reusePort;
+    return true;
+#else
+    return !reusePort;
+#endif
   }
 
-  void NetworkReactor::handleIncomingData(SocketTransport* transport) {
-    Protocol* protocol = table[transport];
-    uint8_t data = static_cast<uint8_t>(transport->receive());
+  void NetworkReactor::handleIncomingData(int descriptor) {
+    SocketTransport* transport = table[descriptor].transport;
+    Protocol* protocol = table[descriptor].protocol;
+    uint8_t data[RECEIVE_SIZE];
+    size_t n;
+
+    // An edge-triggered demultiplexer will not report data that is
+    // already waiting again, so keep going until the socket is
+    // drained, or until the connection has to be paused
+    do {
+      n = transport->receive(data, sizeof(data));
+
+      if (n > 0) {
+	LOG(LOG_LEVEL_DEBUG) << TRANSPORT_PREFIX(transport) << "Receiving data";
+
+	// All requests in the block are handled before the replies
+	// are flushed, so that they leave together
+	transport->cork();
+	protocol->onDataReceived(data, n);
+	transport->uncork();
+      }
+    } while (n > 0 && !transport->isClosed() &&
+	     transport->pending() <= highWatermark &&
+	     (transport->available() > 0 || demultiplexer->isEdgeTriggered()));
 
-    if (!transport->isClosed()) {
-      std::cout << TRANSPORT_PREFIX(transport) << "Receiving data" << std::endl;
-      protocol->onDataReceived(data);
+    if (transport->isClosed()) {
+      handleLostConnection(descriptor);
+    } else {
+      updateInterest(descriptor);
     }
+  }
+
+  void NetworkReactor::handleOutgoingData(int descriptor) {
+    SocketTransport* transport = table[descriptor].transport;
+
+    transport->flush();
 
     if (transport->isClosed()) {
-      handleLostConnection(transport);
+      handleLostConnection(descriptor);
+    } else {
+      updateInterest(descriptor);
+    }
+  }
+
+  void NetworkReactor::updateInterest(int descriptor) {
+    Connection_t& connection = table[descriptor];
+    size_t queued = connection.transport->pending();
+    int events;
+
+    if (!connection.paused && queued > highWatermark) {
+      connection.paused = true;
+      LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(connection.transport) << "Pausing, "
+			 << queued << " bytes queued";
+      connection.protocol->onPaused();
+    } else if (connection.paused && queued <= lowWatermark) {
+      connection.paused = false;
+      LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(connection.transport) << "Resuming, "
+			 << queued << " bytes queued";
+      connection.protocol->onResumed();
+    }
+
+    events = connection.paused ? 0 : EVENT_READ;
+
+    if (queued > 0) {
+      events |= EVENT_WRITE;
+    }
+
+    if (events != connection.events) {
+      if ((events & EVENT_WRITE) && !(connection.events & EVENT_WRITE)) {
+	LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(connection.transport) << "Send queue backed up, "
+			   << queued << " bytes queued";
+      }
+
+      demultiplexer->modify(descriptor, events);
+      connection.events = events;
+    }
+  }
+
+  void NetworkReactor::post(Job* job) {
+    bool wakeup;
+    char byte = 0;
+
+    pthread_mutex_lock(&completedMutex);
+    completedJobs.push_back(job);
+    wakeup = !wakeupPending;
+    wakeupPending = true;
+    pthread_mutex_unlock(&completedMutex);
+
+    // One byte in the pipe is enough to wake the reactor, however
+    // many jobs are posted before it gets around to them
+    if (wakeup && write(wakeupDescriptors[1], &byte, 1) == -1) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to wake up reactor";
+    }
+  }
+
+  void NetworkReactor::handleCompletedJobs(void) {
+    std::vector<Job*> jobs;
+    std::vector<Job*>::iterator i;
+    char data[64];
+
+    while (read(wakeupDescriptors[0], data, sizeof(data)) > 0) {
+      // Drain the pipe
+    }
+
+    pthread_mutex_lock(&completedMutex);
+    jobs.swap(completedJobs);
+    wakeupPending = false;
+    pthread_mutex_unlock(&completedMutex);
+
+    for (i = jobs.begin(); i != jobs.end(); i++) {
+      SocketTransport* transport = static_cast<SocketTransport*>((*i)->getTransport());
+
+      if (transport != NULL) {
+	int descriptor = transport->getDescriptor();
+
+	transport->cork();
+	(*i)->complete();
+	transport->uncork();
+
+	// Completing usually sends a reply, which may not have been
+	// written out in full
+	if (table[descriptor].transport == transport) {
+	  if (transport->isClosed()) {
+	    handleLostConnection(descriptor);
+	  } else {
+	    updateInterest(descriptor);
+	  }
+	}
+      }
+
+      delete *i;
     }
   }
 
-  void NetworkReactor::handleLostConnection(SocketTransport* transport) {
-    Protocol* protocol = table[transport];
+  void NetworkReactor::handleLostConnection(int descriptor) {
+    SocketTransport* transport = table[descriptor].transport;
+    Protocol* protocol = table[descriptor].protocol;
+
+    demultiplexer->remove(descriptor);
     protocol->onConnectionLost();
-    table.erase(transport);
+    table[descriptor].transport = NULL;
+    table[descriptor].protocol = NULL;
 
-    std::cout << TRANSPORT_PREFIX(transport) << "Lost connection" << std::endl;
+    if (transport->pending() > 0) {
+      LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(transport) << "Lost connection, "
+			 << transport->pending() << " bytes unsent";
+    } else {
+      LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(transport) << "Lost connection";
+    }
 
     delete protocol;
     delete transport;
@@ -56,6 +221,7 @@ namespace fusenet {
   int NetworkReactor::handleNewConnection(int acceptDescriptor) {
     std::string transportName;
     std::ostringstream port;
+    char address[INET_ADDRSTRLEN];
     struct sockaddr_in remote;
     SocketTransport* transport;
     Protocol* protocol;
@@ -65,34 +231,57 @@ namespace fusenet {
     descriptor = accept(acceptDescriptor, reinterpret_cast<struct sockaddr*>(&remote), &remoteLength);
 
     if (descriptor == -1) {
-      std::cerr << PREFIX "Unable to accept new connection, aborting" << std::endl;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to accept new connection, aborting";
+      }
       return -1;
     }
 
     port << remote.sin_port;
-    transportName = inet_ntoa(remote.sin_addr);
+    transportName = inet_ntop(AF_INET, &remote.sin_addr, address, sizeof(address));
     transportName += ":";
     transportName += port.str();
 
     transport = new SocketTransport(descriptor, transportName);
 
     if (transport == NULL) {
-      std::cerr << PREFIX "Unable to create transport, aborting" << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create transport, aborting";
+      return -1;
+    }
+
+    if (!transport->setNonBlocking()) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to make connection non-blocking, aborting";
+      delete transport;
+      return -1;
+    }
+
+    if (!demultiplexer->add(descriptor, EVENT_READ)) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to watch new connection, aborting";
+      delete transport;
       return -1;
     }
 
     protocol = protocolCreator->create(transport);
 
     if (protocol == NULL) {
-      std::cerr << PREFIX "Unable to create protocol, aborting" << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create protocol, aborting";
+      demultiplexer->remove(descriptor);
       delete transport;
       return -1;
     }
 
-    table[transport] = protocol;
+    if (table.size() <= static_cast<size_t>(descriptor)) {
+      Connection_t unused = { NULL, NULL, 0, false };
+      table.resize(descriptor + 1, unused);
+    }
+
+    table[descriptor].transport = transport;
+    table[descriptor].protocol = protocol;
+    table[descriptor].events = EVENT_READ;
+    table[descriptor].paused = false;
     protocol->onConnectionMade();
 
-    std::cout << TRANSPORT_PREFIX(transport) << "Connection established" << std::endl;
+    LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(transport) << "Connection established";
     return descriptor;
   }
 
@@ -114,6 +303,18 @@ namespace fusenet {
       return -1;
     }
 
+#ifdef SO_REUSEPORT
+    // Lets several reactors listen on the same port, the kernel then
+    // spreads new connections between them
+    if (reusePort) {
+      status = setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int));
+
+      if (status == -1) {
+	return -1;
+      }
+    }
+#endif
+
     remote.sin_family = AF_INET;
     remote.sin_addr.s_addr = htonl(INADDR_ANY);
     remote.sin_port = htons(portNumber);
@@ -137,49 +338,89 @@ namespace fusenet {
 			     const ProtocolCreator* protocolCreator) {
     bool done = false;
     int acceptDescriptor;
-    std::map<SocketTransport*, Protocol*>::iterator i;
-    int status;
-    int largestSocket = -1;
+    EventList_t eventList;
+    EventList_t::iterator i;
 
     this->protocolCreator = protocolCreator;
-    largestSocket = acceptDescriptor = createAcceptSocket(portNumber);
+
+    if (demultiplexer == NULL) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "No demultiplexer available, aborting";
+      return;
+    }
+
+    acceptDescriptor = createAcceptSocket(portNumber);
     
     if (acceptDescriptor == -1) {
-      std::cerr << PREFIX "Unable to create socket, aborting" << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create socket, aborting";
       return;
     }
 
-    while (!done) {
-      fd_set read_set;
-      
-      // Clear sets
-      FD_ZERO(&read_set);
+    // With edge-triggered notification all pending connections are
+    // accepted in one go, which requires a non-blocking accept socket
+    if (demultiplexer->isEdgeTriggered()) {
+      fcntl(acceptDescriptor, F_SETFL, fcntl(acceptDescriptor, F_GETFL) | O_NONBLOCK);
+    }
 
-      // Add accept socket
-      FD_SET(acceptDescriptor, &read_set);
+    if (!demultiplexer->add(acceptDescriptor, EVENT_READ)) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to watch socket, aborting";
+      close(acceptDescriptor);
+      return;
+    }
+
+    // Worker threads wake the reactor through a pipe when they post
+    // completed jobs
+    if (pipe(wakeupDescriptors) == -1) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create wakeup pipe, aborting";
+      close(acceptDescriptor);
+      return;
+    }
+
+    fcntl(wakeupDescriptors[0], F_SETFL, fcntl(wakeupDescriptors[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeupDescriptors[1], F_SETFL, fcntl(wakeupDescriptors[1], F_GETFL) | O_NONBLOCK);
+
+    if (!demultiplexer->add(wakeupDescriptors[0], EVENT_READ)) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to watch wakeup pipe, aborting";
+      close(acceptDescriptor);
+      return;
+    }
+
+    LOG(LOG_LEVEL_INFO) << PREFIX "Using " << demultiplexer->getName() << " demultiplexer";
+
+    while (!done) {
 
-      for (i = table.begin(); i != table.end(); i++) {
-	SocketTransport* t = (*i).first;
-	FD_SET(t->getDescriptor(), &read_set);
-      }
-      
       // Block for activity
-      status = select(largestSocket + 1, &read_set, NULL, NULL, NULL);
-      assert(status != -1);
+      if (!demultiplexer->wait(eventList)) {
+	assert(errno == EINTR);
+	continue;
+      }
       
-      // Check for activity on existing connections
-      for (i = table.begin(); i != table.end(); i++) {
-	SocketTransport* t = (*i).first;
+      for (i = eventList.begin(); i != eventList.end(); i++) {
+	Event_t& event = *i;
+
+	if (event.descriptor == acceptDescriptor) {
+	  // Check for new connections
+	  while (handleNewConnection(acceptDescriptor) != -1 &&
+		 demultiplexer->isEdgeTriggered()) {
+	    // Keep accepting
+	  }
+	  continue;
+	}
 
-	if (FD_ISSET(t->getDescriptor(), &read_set)) {
-	  handleIncomingData(t);
+	if (event.descriptor == wakeupDescriptors[0]) {
+	  handleCompletedJobs();
+	  continue;
+	}
+
+	// Check for activity on existing connections, which may be
+	// lost while handling the first kind of event
+	if ((event.events & EVENT_WRITE) && table[event.descriptor].transport != NULL) {
+	  handleOutgoingData(event.descriptor);
+	}
+
+	if ((event.events & EVENT_READ) && table[event.descriptor].transport != NULL &&
+	    !table[event.descriptor].paused) {
+	  handleIncomingData(event.descriptor);
 	}
-      }
-      
-      // Check for new connections
-      if (FD_ISSET(acceptDescriptor, &read_set)) {
-	int newSocket = handleNewConnection(acceptDescriptor);
-	largestSocket = MAX(largestSocket, newSocket);
       }
     }
 
@@ -197,7 +438,7 @@ namespace fusenet {
     descriptor = socket(AF_INET, SOCK_STREAM, 0);
 
     if (descriptor == -1) {
-      std::cerr << PREFIX "Unable to create socket, aborting" << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create socket, aborting";
       return;
     }
 
@@ -205,7 +446,7 @@ namespace fusenet {
     host = gethostbyname(hostName);
 
     if (host == NULL) {
-      std::cerr << PREFIX "Unable to resolve " << hostName << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to resolve " << hostName;
       return;
     }
 
@@ -217,7 +458,7 @@ namespace fusenet {
     status = connect(descriptor, reinterpret_cast<struct sockaddr*>(&remote), sizeof(remote));
 
     if (status == -1) {
-      std::cerr << PREFIX "Unable to establish connection to " << hostName << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to establish connection to " << hostName;
       return;
     }
     
@@ -225,7 +466,7 @@ namespace fusenet {
     Protocol* protocol = protocolCreator->create(&transport);
 
     if (protocol == NULL) {
-      std::cerr << PREFIX "Unable to create protocol, aborting" << std::endl;
+      LOG(LOG_LEVEL_ERROR) << PREFIX "Unable to create protocol, aborting";
     } else {
       protocol->onConnectionMade();
 
@@ -233,28 +474,35 @@ namespace fusenet {
 	protocol->onDataReceived(transport.receive());
       }
 
-      std::cout << TRANSPORT_PREFIX(&transport) << "Lost connection, exiting" << std::endl;
+      LOG(LOG_LEVEL_INFO) << TRANSPORT_PREFIX(&transport) << "Lost connection, exiting";
       protocol->onConnectionLost();
       delete protocol;
     }
   }
 
   void NetworkReactor::stopServing(void) {
-    std::map<SocketTransport*, Protocol*>::iterator i;
+    size_t descriptor;
     
-    for (i = table.begin(); i != table.end(); i++) {
-      SocketTransport* t = (*i).first;
-      Protocol* p = (*i).second;
-
-      table.erase(t);
-      p->onConnectionLost();
-      delete p;
-      delete t;
+    for (descriptor = 0; descriptor < table.size(); descriptor++) {
+      if (table[descriptor].transport != NULL) {
+	handleLostConnection(descriptor);
+      }
     }
   }
 
   NetworkReactor::~NetworkReactor(void) {
-    // Do nothing
+    std::vector<Job*>::iterator i;
+
+    for (i = completedJobs.begin(); i != completedJobs.end(); i++) {
+      delete *i;
+    }
+
+    if (wakeupDescriptors[0] != -1) {
+      close(wakeupDescriptors[0]);
+      close(wakeupDescriptors[1]);
+    }
+
+    pthread_mutex_destroy(&completedMutex);
+    delete demultiplexer;
   }
 }
-
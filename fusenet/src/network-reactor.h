@@ -14,11 +14,15 @@
  * Schmidt. Although modified a bit, the idea is the same.
  */
 
+#include <pthread.h>
+
+#include "demultiplexer.h"
+#include "job.h"
 #include "protocol-creator.h"
 #include "socket-transport.h"
 
 #include <iostream>
-#include <map>
+#include <vector>
 
 namespace fusenet {
 
@@ -30,15 +34,57 @@ namespace fusenet {
    * This reactor is custom made for BSD sockets, but could be adapted
    * to any case where events are delivered synchronously and can be
    * demultiplexed with functionality similar to Unix' select() call.
+   * The actual demultiplexing is delegated to a Demultiplexer, where
+   * each connection is registered once when it is made and removed
+   * when it is lost.
    */
   class NetworkReactor {
   public:
 
     /**
-     * Creates a new network reactor instance.
+     * Creates a new network reactor instance using the select()
+     * demultiplexer.
      */
     NetworkReactor(void);
 
+    /**
+     * Creates a new network reactor instance using the given
+     * demultiplexer. The reactor takes ownership of it.
+     *
+     * @param demultiplexer the demultiplexer
+     */
+    NetworkReactor(Demultiplexer* demultiplexer);
+
+    /**
+     * Set the send queue watermarks. When more than the high
+     * watermark is queued for sending on a connection, the reactor
+     * stops reading requests from it, and resumes once the queue has
+     * drained to the low watermark.
+     *
+     * @param low the low watermark in bytes
+     * @param high the high watermark in bytes
+     */
+    void setWatermarks(size_t low, size_t high);
+
+    /**
+     * Let the accept socket share its port with other reactors, so
+     * that the kernel spreads new connections between them. Must be
+     * called before serve().
+     *
+     * @param reusePort true to share the port
+     * @return false if port sharing is not supported
+     */
+    bool setReusePort(bool reusePort);
+
+    /**
+     * Hand back a job that has been executed, so that it is completed
+     * on the reactor thread. This is the only method that may be
+     * called from other threads.
+     *
+     * @param job the job, deleted by the reactor once completed
+     */
+    void post(Job* job);
+
     /**
      * Start servicing network events. This method returns when it is
      * time to shut down. This might be due to an error, or because of
@@ -70,7 +116,22 @@ namespace fusenet {
     ~NetworkReactor(void);
 
   private:
+
+    /**
+     * Connection type.
+     */
+    typedef struct {
+      SocketTransport* transport; //!< Transport, NULL if unused
+      Protocol* protocol;         //!< Protocol
+      int events;                 //!< Events waited for
+      bool paused;                //!< Reading paused by backpressure
+    } Connection_t;
     
+    /**
+     * Common constructor code.
+     */
+    void initialize(Demultiplexer* demultiplexer);
+
     /**
      * Creates the accept socket.
      */
@@ -79,15 +140,31 @@ namespace fusenet {
     /**
      * Handle incoming data on a connection.
      */
-    void handleIncomingData(SocketTransport* transport);
+    void handleIncomingData(int descriptor);
 
     /**
-     * Handle incoming data on a connection.
+     * Handle a connection that has become writable.
      */
-    void handleLostConnection(SocketTransport* transport);
+    void handleOutgoingData(int descriptor);
 
     /**
-     * Handle incoming data on a connection.
+     * Update the events waited for on a connection, based on how
+     * much it has queued for sending.
+     */
+    void updateInterest(int descriptor);
+
+    /**
+     * Complete the jobs posted by worker threads.
+     */
+    void handleCompletedJobs(void);
+
+    /**
+     * Handle lost connection.
+     */
+    void handleLostConnection(int descriptor);
+
+    /**
+     * Handle new connection.
      */
     int handleNewConnection(int socket);
 
@@ -102,9 +179,51 @@ namespace fusenet {
     const ProtocolCreator* protocolCreator;
 
     /**
-     * Internal connection -> (transport, protocol) mapping.
+     * Internal demultiplexer.
+     */
+    Demultiplexer* demultiplexer;
+
+    /**
+     * Internal descriptor -> (transport, protocol) mapping. It is
+     * indexed by descriptor, so finding the connection for an event
+     * is a constant time operation.
+     */
+    std::vector<Connection_t> table;
+
+    /**
+     * Send queue size at which a paused connection is resumed.
+     */
+    size_t lowWatermark;
+
+    /**
+     * Send queue size above which a connection is paused.
+     */
+    size_t highWatermark;
+
+    /**
+     * Share the accept socket port with other reactors.
+     */
+    bool reusePort;
+
+    /**
+     * Wakeup pipe, read and write end.
+     */
+    int wakeupDescriptors[2];
+
+    /**
+     * Jobs posted but not yet completed.
+     */
+    std::vector<Job*> completedJobs;
+
+    /**
+     * Set when a wakeup byte is in the pipe.
+     */
+    bool wakeupPending;
+
+    /**
+     * Protects the posted jobs and the wakeup flag.
      */
-    std::map<SocketTransport*, Protocol*> table;
+    pthread_mutex_t completedMutex;
   };
 }
 
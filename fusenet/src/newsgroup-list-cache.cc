@@ -0,0 +1,90 @@
+/**
+ * @file
+ *
+ * This file contains the newsgroup list cache implementation.
+ */
+
+#include <cstddef>
+
+#include "newsgroup-list-cache.h"
+
+namespace fusenet {
+
+  NewsgroupListCache::NewsgroupListCache(void) {
+    pthread_mutex_init(&mutex, NULL);
+    message = NULL;
+    generation = 0;
+    hits = 0;
+    misses = 0;
+  }
+
+  EncodedMessage* NewsgroupListCache::find(unsigned long& generation) {
+    EncodedMessage* found;
+
+    pthread_mutex_lock(&mutex);
+    found = message;
+
+    if (found != NULL) {
+      found->acquire();
+      hits++;
+    } else {
+      misses++;
+    }
+
+    generation = this->generation;
+    pthread_mutex_unlock(&mutex);
+    return found;
+  }
+
+  void NewsgroupListCache::store(unsigned long generation, EncodedMessage* message) {
+    pthread_mutex_lock(&mutex);
+
+    if (generation == this->generation && this->message == NULL) {
+      message->acquire();
+      this->message = message;
+    }
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void NewsgroupListCache::invalidate(void) {
+    EncodedMessage* dropped;
+
+    pthread_mutex_lock(&mutex);
+    dropped = message;
+    message = NULL;
+    generation++;
+    pthread_mutex_unlock(&mutex);
+
+    // The last reference may be held by a reply still being sent
+    if (dropped != NULL) {
+      dropped->release();
+    }
+  }
+
+  unsigned long NewsgroupListCache::getHits(void) {
+    unsigned long result;
+
+    pthread_mutex_lock(&mutex);
+    result = hits;
+    pthread_mutex_unlock(&mutex);
+    return result;
+  }
+
+  unsigned long NewsgroupListCache::getMisses(void) {
+    unsigned long result;
+
+    pthread_mutex_lock(&mutex);
+    result = misses;
+    pthread_mutex_unlock(&mutex);
+    return result;
+  }
+
+  NewsgroupListCache::~NewsgroupListCache(void) {
+    if (message != NULL) {
+      message->release();
+    }
+
+    pthread_mutex_destroy(&mutex);
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef NEWSGROUP_LIST_CACHE_H
+#define NEWSGROUP_LIST_CACHE_H
+
+/**
+ * @file
+ *
+ * This file contains the newsgroup list cache interface.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
+#include "shared.h"
+
+namespace fusenet {
+
+  /**
+   * Encoded message. Immutable once it has been stored in a cache,
+   * and reference counted so that it can be sent after the cache has
+   * dropped it.
+   */
+  class EncodedMessage : public Shared {
+
+  public:
+
+    /**
+     * The bytes of the message, as sent on the wire.
+     */
+    std::vector<uint8_t> bytes;
+  };
+
+  /**
+   * Cache of the encoded reply to list newsgroups, shared by all
+   * connections and reactor threads. A hit costs a lock and a
+   * reference, instead of reading and encoding the list again.
+   *
+   * The cache has a generation number, which is bumped whenever a
+   * newsgroup is created or deleted. A reply is only stored if the
+   * generation is still the one seen before the list was read from
+   * the database, so that a reply built from a list that was changed
+   * meanwhile is never cached.
+   */
+  class NewsgroupListCache {
+
+  public:
+
+    /**
+     * Create an empty cache.
+     */
+    NewsgroupListCache(void);
+
+    /**
+     * Look up the encoded reply.
+     *
+     * @param generation set to the current generation, to be handed
+     *        to store() on a miss
+     * @return the reply with a reference the caller must release, or
+     *         NULL on a miss
+     */
+    EncodedMessage* find(unsigned long& generation);
+
+    /**
+     * Store an encoded reply, unless the list has changed since it
+     * was read.
+     *
+     * @param generation the generation find() gave before the list
+     *        was read
+     * @param message the reply, which the cache takes a reference to
+     */
+    void store(unsigned long generation, EncodedMessage* message);
+
+    /**
+     * Drop the encoded reply. Called after a newsgroup has been
+     * created or deleted.
+     */
+    void invalidate(void);
+
+    /**
+     * Get the number of lookups that found a reply.
+     */
+    unsigned long getHits(void);
+
+    /**
+     * Get the number of lookups that did not.
+     */
+    unsigned long getMisses(void);
+
+    /**
+     * Destroy instance.
+     */
+    ~NewsgroupListCache(void);
+
+  private:
+
+    /**
+     * Protects everything below.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * The encoded reply, or NULL.
+     */
+    EncodedMessage* message;
+
+    /**
+     * Current generation.
+     */
+    unsigned long generation;
+
+    /**
+     * Number of hits.
+     */
+    unsigned long hits;
+
+    /**
+     * Number of misses.
+     */
+    unsigned long misses;
+  };
+}
+
+#endif
@@ -12,6 +12,22 @@ namespace fusenet {
     this->transport = transport;
   }
 
+  void Protocol::onDataReceived(const uint8_t* data, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+      onDataReceived(data[i]);
+    }
+  }
+
+  void Protocol::onPaused(void) {
+    // Does nothing
+  }
+
+  void Protocol::onResumed(void) {
+    // Does nothing
+  }
+
   Protocol::~Protocol(void) {
     // Does nothing
   }
@@ -44,11 +44,34 @@ namespace fusenet {
      */
     virtual void onDataReceived(uint8_t data) = 0;
 
+    /**
+     * Called on data receival with a block of data. The block may
+     * end anywhere, also in the middle of a message. The default
+     * implementation passes the data on one byte at a time.
+     *
+     * @param data the data received
+     * @param length the number of bytes received
+     */
+    virtual void onDataReceived(const uint8_t* data, size_t length);
+
     /**
      * Called on lost connection.
      */
     virtual void onConnectionLost(void) = 0;
 
+    /**
+     * Called when too much is queued for sending, and the reactor
+     * stops reading from the connection. The default implementation
+     * does nothing.
+     */
+    virtual void onPaused(void);
+
+    /**
+     * Called when the send queue has drained after a pause. The
+     * default implementation does nothing.
+     */
+    virtual void onResumed(void);
+
     /**
      * Destroys an instance.
      */
@@ -0,0 +1,205 @@
+/**
+ * @file
+ *
+ * This file contains the record encoding implementation.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "record.h"
+
+/**
+ * Bytes read from a file at a time.
+ */
+#define READ_BLOCK_SIZE (1024 * 1024)
+
+namespace fusenet {
+
+  void PutNumber(std::string& buffer, uint32_t number) {
+    buffer += static_cast<char>((number >> 24) & 0xff);
+    buffer += static_cast<char>((number >> 16) & 0xff);
+    buffer += static_cast<char>((number >> 8) & 0xff);
+    buffer += static_cast<char>(number & 0xff);
+  }
+
+  void PutString(std::string& buffer, const std::string& value) {
+    PutString(buffer, value.data(), value.size());
+  }
+
+  void PutString(std::string& buffer, const char* data, size_t length) {
+    PutNumber(buffer, length);
+    buffer.append(data, length);
+  }
+
+  uint32_t GetNumber(const char* data) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    return (static_cast<uint32_t>(bytes[0]) << 24) |
+      (static_cast<uint32_t>(bytes[1]) << 16) |
+      (static_cast<uint32_t>(bytes[2]) << 8) |
+      static_cast<uint32_t>(bytes[3]);
+  }
+
+  bool GetNumber(const std::string& buffer, size_t& position,
+		 uint32_t& value) {
+    if (position + 4 > buffer.size()) {
+      return false;
+    }
+
+    value = GetNumber(buffer.data() + position);
+    position += 4;
+    return true;
+  }
+
+  bool GetString(const std::string& buffer, size_t& position,
+		 std::string& value) {
+    uint32_t length;
+
+    if (!GetNumber(buffer, position, length) ||
+	length > buffer.size() - position) {
+      return false;
+    }
+
+    value.assign(buffer, position, length);
+    position += length;
+    return true;
+  }
+
+  uint32_t Checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 16777619U;
+    }
+
+    return hash;
+  }
+
+  std::string MakeRecord(uint8_t type, const std::string& payload) {
+    std::string record;
+
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+    record += static_cast<char>(type);
+    PutNumber(record, payload.size());
+    PutNumber(record, Checksum(payload.data(), payload.size()));
+    record += payload;
+    return record;
+  }
+
+  bool RecordValid(const std::string& record) {
+    return record.size() >= RECORD_HEADER_SIZE &&
+      GetNumber(record.data() + 1) == record.size() - RECORD_HEADER_SIZE &&
+      GetNumber(record.data() + 5) == Checksum(record.data() + RECORD_HEADER_SIZE,
+					       record.size() - RECORD_HEADER_SIZE);
+  }
+
+  bool ReadFully(int descriptor, char* data, size_t length, off_t offset) {
+    ssize_t n;
+
+    while (length > 0) {
+      n = pread(descriptor, data, length, offset);
+
+      if (n == -1 && errno == EINTR) {
+	continue;
+      }
+
+      if (n <= 0) {
+	return false;
+      }
+
+      data += n;
+      length -= n;
+      offset += n;
+    }
+
+    return true;
+  }
+
+  bool WriteFully(int descriptor, const char* data, size_t length) {
+    ssize_t n;
+
+    while (length > 0) {
+      n = write(descriptor, data, length);
+
+      if (n == -1 && errno == EINTR) {
+	continue;
+      }
+
+      if (n <= 0) {
+	return false;
+      }
+
+      data += n;
+      length -= n;
+    }
+
+    return true;
+  }
+
+  RecordReader::RecordReader(int descriptor) {
+    this->descriptor = descriptor;
+    position = 0;
+    offset = 0;
+  }
+
+  bool RecordReader::fill(size_t length) {
+    size_t used;
+    ssize_t n;
+
+    if (buffer.size() - position >= length) {
+      return true;
+    }
+
+    // Drop what has been returned before growing the buffer
+    buffer.erase(0, position);
+    position = 0;
+
+    while (buffer.size() < length) {
+      used = buffer.size();
+      buffer.resize(used + READ_BLOCK_SIZE);
+      n = read(descriptor, &buffer[used], READ_BLOCK_SIZE);
+      buffer.resize(n > 0 ? used + n : used);
+
+      if (n == -1 && errno == EINTR) {
+	continue;
+      }
+
+      if (n <= 0) {
+	return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool RecordReader::next(std::string& record) {
+    uint32_t length;
+
+    if (!fill(RECORD_HEADER_SIZE)) {
+      return false;
+    }
+
+    length = GetNumber(buffer.data() + position + 1);
+
+    if (!fill(RECORD_HEADER_SIZE + length)) {
+      return false;
+    }
+
+    record.assign(buffer, position, RECORD_HEADER_SIZE + length);
+
+    if (!RecordValid(record)) {
+      return false;
+    }
+
+    position += record.size();
+    offset += record.size();
+    return true;
+  }
+
+  off_t RecordReader::getOffset(void) const {
+    return offset;
+  }
+}
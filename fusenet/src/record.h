@@ -0,0 +1,143 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+/**
+ * @file
+ *
+ * This file contains the record encoding interface, shared by the
+ * databases that keep their data in append-only files.
+ *
+ * A record is a type byte, a big endian 32 bit payload length, a
+ * big endian 32 bit FNV-1a checksum of the payload, and the payload.
+ * Numbers in a payload are big endian 32 bit, and strings are a
+ * number holding the length followed by the bytes.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+/**
+ * Size of a record header: type, payload length and checksum.
+ */
+#define RECORD_HEADER_SIZE 9
+
+namespace fusenet {
+
+  /**
+   * Append a big endian 32 bit number.
+   */
+  void PutNumber(std::string& buffer, uint32_t number);
+
+  /**
+   * Append a length prefixed string.
+   */
+  void PutString(std::string& buffer, const std::string& value);
+
+  /**
+   * Append a length prefixed string from a buffer.
+   */
+  void PutString(std::string& buffer, const char* data, size_t length);
+
+  /**
+   * Decode a big endian 32 bit number.
+   */
+  uint32_t GetNumber(const char* data);
+
+  /**
+   * Decode a number at a position, and move past it.
+   */
+  bool GetNumber(const std::string& buffer, size_t& position,
+		 uint32_t& value);
+
+  /**
+   * Decode a length prefixed string at a position, and move past it.
+   */
+  bool GetString(const std::string& buffer, size_t& position,
+		 std::string& value);
+
+  /**
+   * FNV-1a checksum.
+   */
+  uint32_t Checksum(const char* data, size_t length);
+
+  /**
+   * Wrap a payload in a record.
+   */
+  std::string MakeRecord(uint8_t type, const std::string& payload);
+
+  /**
+   * Check the checksum of a complete record.
+   */
+  bool RecordValid(const std::string& record);
+
+  /**
+   * Read exactly length bytes at an offset.
+   */
+  bool ReadFully(int descriptor, char* data, size_t length, off_t offset);
+
+  /**
+   * Write all of a buffer.
+   */
+  bool WriteFully(int descriptor, const char* data, size_t length);
+
+  /**
+   * Reads the records of a file from start to end, a large block at
+   * a time.
+   */
+  class RecordReader {
+
+  public:
+
+    /**
+     * Create instance. The descriptor is not owned.
+     *
+     * @param descriptor the file to read, positioned at its start
+     */
+    RecordReader(int descriptor);
+
+    /**
+     * Read the next record.
+     *
+     * @param record the record, header included
+     * @return false at the end of the file, or at the first record
+     *	       that is torn or fails its checksum
+     */
+    bool next(std::string& record);
+
+    /**
+     * Get the offset just past the last record read.
+     */
+    off_t getOffset(void) const;
+
+  private:
+
+    /**
+     * Make sure that at least length bytes are buffered.
+     */
+    bool fill(size_t length);
+
+    /**
+     * The file.
+     */
+    int descriptor;
+
+    /**
+     * Bytes read from the file but not yet returned.
+     */
+    std::string buffer;
+
+    /**
+     * Position in the buffer of the next record.
+     */
+    size_t position;
+
+    /**
+     * Offset in the file of the next record.
+     */
+    off_t offset;
+  };
+}
+
+#endif
@@ -0,0 +1,711 @@
+/**
+ * @file
+ *
+ * This file contains the segment database implementation.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "log.h"
+#include "record.h"
+#include "segment-database.h"
+
+#define PREFIX "[SegmentDatabase] "
+
+/**
+ * Bytes read to find the title and author of an article, enough for
+ * all but unusually long headers.
+ */
+#define ARTICLE_PREFIX_SIZE 512
+
+/**
+ * Logs smaller than this are never compacted.
+ */
+#define COMPACT_THRESHOLD (64 * 1024)
+
+namespace fusenet {
+
+  /**
+   * Segment directory.
+   */
+  const std::string segmentDirectory = "seg/";
+
+  /**
+   * Catalog filename.
+   */
+  const std::string catalogFilename = "catalog";
+
+  /**
+   * Standard file mode.
+   */
+  const int segmentFileMode = 0644;
+
+  /**
+   * Record types.
+   */
+  typedef enum {
+    RECORD_CREATE_NEWSGROUP = 1,  //!< Catalog: identifier, name
+    RECORD_DELETE_NEWSGROUP = 2,  //!< Catalog: identifier
+    RECORD_ARTICLE = 3,           //!< Log: identifier, title, author, text
+    RECORD_TOMBSTONE = 4          //!< Log: identifier
+  } RecordType_t;
+
+  /**
+   * Read the record at an offset.
+   */
+  static bool ReadRecordAt(int descriptor, off_t offset, size_t length,
+			   std::string& record) {
+    record.resize(length);
+    return length == 0 || ReadFully(descriptor, &record[0], length, offset);
+  }
+
+  /**
+   * Get the path of a newsgroup log.
+   */
+  static std::string GetLogPath(int newsgroupIdentifier) {
+    std::ostringstream path;
+    path << segmentDirectory << newsgroupIdentifier << ".log";
+    return path.str();
+  }
+
+  /**
+   * Encode an article record.
+   */
+  static std::string MakeArticleRecord(const Article_t& article) {
+    std::string payload;
+
+    payload.reserve(16 + article.title.size() + article.author.size() +
+		    article.text.size());
+    PutNumber(payload, article.id);
+    PutString(payload, article.title);
+    PutString(payload, article.author);
+    PutString(payload, article.text);
+    return MakeRecord(RECORD_ARTICLE, payload);
+  }
+
+  /**
+   * Encode a record holding only an identifier.
+   */
+  static std::string MakeIdentifierRecord(RecordType_t type, int identifier) {
+    std::string payload;
+
+    PutNumber(payload, identifier);
+    return MakeRecord(type, payload);
+  }
+
+  /**
+   * Decode an article record. The text is left out when it is not
+   * wanted, or not in the buffer.
+   */
+  static bool DecodeArticle(const std::string& record, Article_t& article,
+			    bool withText) {
+    size_t position = RECORD_HEADER_SIZE;
+
+    if (record.size() < RECORD_HEADER_SIZE + 4 || record[0] != RECORD_ARTICLE) {
+      return false;
+    }
+
+    article.id = GetNumber(record.data() + position);
+    position += 4;
+
+    return GetString(record, position, article.title) &&
+      GetString(record, position, article.author) &&
+      (!withText || GetString(record, position, article.text));
+  }
+
+  SegmentDatabase::SegmentDatabase(void) {
+    catalogDescriptor = -1;
+    nextNewsgroup = 0;
+    load();
+  }
+
+  void SegmentDatabase::load(void) {
+    std::vector<int> deleted;
+    std::vector<int>::iterator d;
+    GroupMap_t::iterator i;
+    std::string record;
+    std::string catalogPath = segmentDirectory + catalogFilename;
+    struct stat status;
+    off_t offset = 0;
+
+    // Ignore error code, open fails anyway if it matters
+    mkdir(segmentDirectory.c_str(), 0755);
+
+    catalogDescriptor = open(catalogPath.c_str(), O_RDWR | O_CREAT | O_APPEND,
+			     segmentFileMode);
+
+    if (catalogDescriptor == -1 || fstat(catalogDescriptor, &status) == -1) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to open " << catalogPath;
+      return;
+    }
+
+    // Replay the catalog, it is small enough to check every record
+    while (offset + RECORD_HEADER_SIZE <= status.st_size) {
+      char header[RECORD_HEADER_SIZE];
+      uint32_t length;
+      size_t position = RECORD_HEADER_SIZE + 4;
+      int identifier;
+
+      if (!ReadFully(catalogDescriptor, header, sizeof(header), offset)) {
+	break;
+      }
+
+      length = GetNumber(header + 1);
+
+      if (length < 4 || length > status.st_size - offset - RECORD_HEADER_SIZE ||
+	  !ReadRecordAt(catalogDescriptor, offset, RECORD_HEADER_SIZE + length, record) ||
+	  !RecordValid(record)) {
+	break;
+      }
+
+      identifier = GetNumber(record.data() + RECORD_HEADER_SIZE);
+
+      if (record[0] == RECORD_CREATE_NEWSGROUP) {
+	Group_t* group = new Group_t;
+
+	if (!GetString(record, position, group->name)) {
+	  delete group;
+	  break;
+	}
+
+	group->descriptor = -1;
+	groups[identifier] = group;
+	names[group->name] = identifier;
+
+	if (identifier >= nextNewsgroup) {
+	  nextNewsgroup = identifier + 1;
+	}
+      } else if (record[0] == RECORD_DELETE_NEWSGROUP) {
+	i = groups.find(identifier);
+
+	if (i != groups.end()) {
+	  names.erase(i->second->name);
+	  delete i->second;
+	  groups.erase(i);
+	}
+
+	deleted.push_back(identifier);
+      } else {
+	break;
+      }
+
+      offset += RECORD_HEADER_SIZE + length;
+    }
+
+    if (offset < status.st_size) {
+      LOG(LOG_LEVEL_WARNING) << PREFIX << "Discarding " << status.st_size - offset
+			     << " bytes at end of catalog";
+
+      if (ftruncate(catalogDescriptor, offset) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate catalog";
+      }
+    }
+
+    // Logs of deleted newsgroups are normally removed right away,
+    // but a crash may have left some behind
+    for (d = deleted.begin(); d != deleted.end(); d++) {
+      unlink(GetLogPath(*d).c_str());
+    }
+
+    for (i = groups.begin(); i != groups.end(); i++) {
+      if (!openGroup(i->first, i->second)) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to open log of newsgroup "
+			     << i->first;
+      }
+    }
+  }
+
+  void SegmentDatabase::unload(void) {
+    GroupMap_t::iterator i;
+
+    for (i = groups.begin(); i != groups.end(); i++) {
+      if (i->second->descriptor != -1) {
+	close(i->second->descriptor);
+      }
+
+      delete i->second;
+    }
+
+    groups.clear();
+    names.clear();
+    nextNewsgroup = 0;
+
+    if (catalogDescriptor != -1) {
+      close(catalogDescriptor);
+      catalogDescriptor = -1;
+    }
+  }
+
+  bool SegmentDatabase::openGroup(int newsgroupIdentifier, Group_t* group) {
+    std::string path = GetLogPath(newsgroupIdentifier);
+    std::string record;
+    struct stat status;
+    off_t offset = 0;
+    off_t last = -1;
+    Slot_t replaced = { 0, 0 };
+    uint32_t lastIdentifier = 0;
+    off_t lastGarbage = 0;
+
+    group->size = 0;
+    group->garbage = 0;
+    group->slots.clear();
+    group->descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, segmentFileMode);
+
+    if (group->descriptor == -1 || fstat(group->descriptor, &status) == -1) {
+      return false;
+    }
+
+    // Index the log. Only the record headers are read, the checksum
+    // of the last record is checked below to catch a torn write.
+    while (offset + RECORD_HEADER_SIZE + 4 <= status.st_size) {
+      char header[RECORD_HEADER_SIZE + 4];
+      uint32_t length;
+      uint32_t identifier;
+
+      if (!ReadFully(group->descriptor, header, sizeof(header), offset)) {
+	break;
+      }
+
+      length = GetNumber(header + 1);
+      identifier = GetNumber(header + RECORD_HEADER_SIZE);
+
+      if (length < 4 || length > status.st_size - offset - RECORD_HEADER_SIZE ||
+	  identifier > 0x7fffffff) {
+	break;
+      }
+
+      if (header[0] != RECORD_ARTICLE && header[0] != RECORD_TOMBSTONE) {
+	break;
+      }
+
+      if (identifier >= group->slots.size()) {
+	Slot_t empty = { 0, 0 };
+	group->slots.resize(identifier + 1, empty);
+      }
+
+      // Kept so that the last record can be undone if it is torn
+      replaced = group->slots[identifier];
+      lastIdentifier = identifier;
+      lastGarbage = group->garbage;
+
+      if (header[0] == RECORD_ARTICLE) {
+	group->slots[identifier].offset = offset;
+	group->slots[identifier].length = RECORD_HEADER_SIZE + length;
+      } else {
+	group->garbage += group->slots[identifier].length + RECORD_HEADER_SIZE + length;
+	group->slots[identifier].length = 0;
+      }
+
+      last = offset;
+      offset += RECORD_HEADER_SIZE + length;
+    }
+
+    if (last != -1 &&
+	(!ReadRecordAt(group->descriptor, last, offset - last, record) ||
+	 !RecordValid(record))) {
+      // Forget the torn record, it was never acknowledged
+      group->slots[lastIdentifier] = replaced;
+      group->garbage = lastGarbage;
+      offset = last;
+    }
+
+    if (offset < status.st_size) {
+      LOG(LOG_LEVEL_WARNING) << PREFIX << "Discarding " << status.st_size - offset
+			     << " bytes at end of " << path;
+
+      if (ftruncate(group->descriptor, offset) == -1) {
+	return false;
+      }
+    }
+
+    group->size = offset;
+
+    if (group->size > COMPACT_THRESHOLD && group->garbage > group->size / 2) {
+      return compactGroup(newsgroupIdentifier, group);
+    }
+
+    return true;
+  }
+
+  bool SegmentDatabase::compactGroup(int newsgroupIdentifier, Group_t* group) {
+    std::string path = GetLogPath(newsgroupIdentifier);
+    std::string temporaryPath = path + ".tmp";
+    std::vector<Slot_t> slots = group->slots;
+    std::string buffer;
+    std::string record;
+    off_t size = 0;
+    size_t i;
+    int descriptor;
+    bool success = true;
+
+    descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, segmentFileMode);
+
+    if (descriptor == -1) {
+      return false;
+    }
+
+    for (i = 0; success && i < slots.size(); i++) {
+      if (slots[i].length > 0) {
+	success = ReadRecordAt(group->descriptor, slots[i].offset, slots[i].length, record);
+	slots[i].offset = size + buffer.size();
+	buffer += record;
+      } else if (i + 1 == slots.size()) {
+	// Keep the last identifier in use, so it is not handed out
+	// again
+	buffer += MakeIdentifierRecord(RECORD_TOMBSTONE, i);
+      }
+
+      if (buffer.size() >= 1024 * 1024 || i + 1 == slots.size()) {
+	success = success && WriteFully(descriptor, buffer.data(), buffer.size());
+	size += buffer.size();
+	buffer.clear();
+      }
+    }
+
+    // The new log must be on disk before it replaces the old one
+    success = success && fsync(descriptor) == 0;
+    close(descriptor);
+
+    if (!success || rename(temporaryPath.c_str(), path.c_str()) == -1) {
+      unlink(temporaryPath.c_str());
+      return false;
+    }
+
+    LOG(LOG_LEVEL_INFO) << PREFIX << "Compacted " << path << " from "
+			<< group->size << " to " << size << " bytes";
+
+    close(group->descriptor);
+    group->descriptor = open(path.c_str(), O_RDWR | O_APPEND);
+    group->slots = slots;
+    group->size = size;
+    group->garbage = 0;
+
+    if (slots.size() > 0 && slots.back().length == 0) {
+      group->garbage = RECORD_HEADER_SIZE + 4;
+    }
+
+    return group->descriptor != -1;
+  }
+
+  SegmentDatabase::Group_t* SegmentDatabase::findGroup(int newsgroupIdentifier) {
+    GroupMap_t::iterator i = groups.find(newsgroupIdentifier);
+
+    if (i == groups.end() || i->second->descriptor == -1) {
+      return NULL;
+    }
+
+    return i->second;
+  }
+
+  SegmentDatabase::Slot_t* SegmentDatabase::findSlot(Group_t* group,
+						     int articleIdentifier) {
+    if (articleIdentifier < 0 ||
+	static_cast<size_t>(articleIdentifier) >= group->slots.size() ||
+	group->slots[articleIdentifier].length == 0) {
+      return NULL;
+    }
+
+    return &group->slots[articleIdentifier];
+  }
+
+  bool SegmentDatabase::readRecord(Group_t* group, Slot_t* slot, std::string& record) {
+    return ReadRecordAt(group->descriptor, slot->offset, slot->length, record) &&
+      RecordValid(record);
+  }
+
+  bool SegmentDatabase::appendCatalog(const std::string& record) {
+    struct stat status;
+
+    if (catalogDescriptor == -1 || fstat(catalogDescriptor, &status) == -1) {
+      return false;
+    }
+
+    if (!WriteFully(catalogDescriptor, record.data(), record.size())) {
+      // Do not leave half a record behind for the next one to follow
+      if (ftruncate(catalogDescriptor, status.st_size) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate catalog";
+      }
+
+      return false;
+    }
+
+    return true;
+  }
+
+  Status_t SegmentDatabase::clear(void) {
+    DIR* directory;
+    struct dirent* entity;
+    std::string filename;
+
+    unload();
+    directory = opendir(segmentDirectory.c_str());
+
+    if (directory != NULL) {
+      while ((entity = readdir(directory)) != NULL) {
+	filename = entity->d_name;
+
+	if (filename != "." && filename != "..") {
+	  unlink((segmentDirectory + filename).c_str());
+	}
+      }
+
+      closedir(directory);
+    }
+
+    load();
+    return (catalogDescriptor != -1) ? STATUS_SUCCESS : STATUS_FAILURE;
+  }
+
+  Status_t SegmentDatabase::getNewsgroupList(NewsgroupList_t& newsgroupList) {
+    GroupMap_t::iterator i;
+
+    for (i = groups.begin(); i != groups.end(); i++) {
+      Newsgroup_t newsgroup;
+
+      newsgroup.id = i->first;
+      newsgroup.name = i->second->name;
+      newsgroupList.push_back(newsgroup);
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::checkNewsgroup(int newsgroupIdentifier) {
+    if (findGroup(newsgroupIdentifier) == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::createNewsgroup(std::string& newsgroupName) {
+    std::string record;
+    std::string payload;
+    Group_t* group;
+    int identifier = nextNewsgroup;
+
+    if (names.find(newsgroupName) != names.end()) {
+      return STATUS_FAILURE_ALREADY_EXISTS;
+    }
+
+    PutNumber(payload, identifier);
+    PutString(payload, newsgroupName);
+
+    // Identifiers are never reused, so any log by this name is junk
+    unlink(GetLogPath(identifier).c_str());
+
+    // The log is opened before the catalog names the newsgroup, so
+    // that the catalog never holds a newsgroup without one
+    group = new Group_t;
+    group->name = newsgroupName;
+
+    if (!openGroup(identifier, group) ||
+	!appendCatalog(MakeRecord(RECORD_CREATE_NEWSGROUP, payload))) {
+      if (group->descriptor != -1) {
+	close(group->descriptor);
+      }
+
+      unlink(GetLogPath(identifier).c_str());
+      delete group;
+      return STATUS_FAILURE;
+    }
+
+    nextNewsgroup++;
+    groups[identifier] = group;
+    names[newsgroupName] = identifier;
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::deleteNewsgroup(int newsgroupIdentifier) {
+    GroupMap_t::iterator i = groups.find(newsgroupIdentifier);
+
+    if (i == groups.end()) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    if (!appendCatalog(MakeIdentifierRecord(RECORD_DELETE_NEWSGROUP, newsgroupIdentifier))) {
+      return STATUS_FAILURE;
+    }
+
+    if (i->second->descriptor != -1) {
+      close(i->second->descriptor);
+    }
+
+    unlink(GetLogPath(newsgroupIdentifier).c_str());
+    names.erase(i->second->name);
+    delete i->second;
+    groups.erase(i);
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::listArticles(int newsgroupIdentifier,
+					 ArticleList_t& articleList) {
+    Group_t* group = findGroup(newsgroupIdentifier);
+    std::string record;
+    size_t i;
+
+    if (group == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    for (i = 0; i < group->slots.size(); i++) {
+      Article_t article;
+
+      if (group->slots[i].length > 0) {
+	if (!readRecord(group, &group->slots[i], record) ||
+	    !DecodeArticle(record, article, true)) {
+	  return STATUS_FAILURE;
+	}
+
+	articleList.push_back(article);
+      }
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::listArticleHeaders(int newsgroupIdentifier,
+					       ArticleHeaderList_t& headerList) {
+    Group_t* group = findGroup(newsgroupIdentifier);
+    std::string record;
+    size_t i;
+
+    if (group == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    for (i = 0; i < group->slots.size(); i++) {
+      Slot_t& slot = group->slots[i];
+      ArticleHeader_t header;
+      Article_t article;
+      size_t length = slot.length;
+
+      if (length == 0) {
+	continue;
+      }
+
+      // Read just the beginning of the record, and all of it only if
+      // the title and author do not fit
+      if (length > ARTICLE_PREFIX_SIZE) {
+	length = ARTICLE_PREFIX_SIZE;
+      }
+
+      if (!ReadRecordAt(group->descriptor, slot.offset, length, record)) {
+	return STATUS_FAILURE;
+      }
+
+      if (!DecodeArticle(record, article, false) &&
+	  (!readRecord(group, &slot, record) || !DecodeArticle(record, article, false))) {
+	return STATUS_FAILURE;
+      }
+
+      header.id = article.id;
+      header.title = article.title;
+      header.author = article.author;
+      header.size = slot.length - RECORD_HEADER_SIZE - 16 - article.title.size() -
+	article.author.size();
+      headerList.push_back(header);
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::createArticle(int newsgroupIdentifier,
+					  Article_t& article) {
+    Group_t* group = findGroup(newsgroupIdentifier);
+    std::string record;
+    Slot_t slot;
+
+    if (group == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    article.id = group->slots.size();
+    record = MakeArticleRecord(article);
+
+    if (!WriteFully(group->descriptor, record.data(), record.size())) {
+      if (ftruncate(group->descriptor, group->size) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate log";
+      }
+
+      return STATUS_FAILURE;
+    }
+
+    slot.offset = group->size;
+    slot.length = record.size();
+    group->slots.push_back(slot);
+    group->size += record.size();
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::deleteArticle(int newsgroupIdentifier,
+					  int articleIdentifier) {
+    Group_t* group = findGroup(newsgroupIdentifier);
+    std::string record;
+    Slot_t* slot;
+
+    if (group == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    slot = findSlot(group, articleIdentifier);
+
+    if (slot == NULL) {
+      return STATUS_FAILURE_A_DOES_NOT_EXIST;
+    }
+
+    record = MakeIdentifierRecord(RECORD_TOMBSTONE, articleIdentifier);
+
+    if (!WriteFully(group->descriptor, record.data(), record.size())) {
+      if (ftruncate(group->descriptor, group->size) == -1) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to truncate log";
+      }
+
+      return STATUS_FAILURE;
+    }
+
+    group->size += record.size();
+    group->garbage += slot->length + record.size();
+    slot->length = 0;
+
+    return STATUS_SUCCESS;
+  }
+
+  Status_t SegmentDatabase::getArticle(int newsgroupIdentifier,
+				       int articleIdentifier,
+				       Article_t& article) {
+    Group_t* group = findGroup(newsgroupIdentifier);
+    std::string record;
+    Slot_t* slot;
+
+    if (group == NULL) {
+      return STATUS_FAILURE_N_DOES_NOT_EXIST;
+    }
+
+    slot = findSlot(group, articleIdentifier);
+
+    if (slot == NULL) {
+      return STATUS_FAILURE_A_DOES_NOT_EXIST;
+    }
+
+    if (!readRecord(group, slot, record) || !DecodeArticle(record, article, true)) {
+      return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  SegmentDatabase::~SegmentDatabase(void) {
+    unload();
+  }
+}
@@ -0,0 +1,209 @@
+#ifndef SEGMENT_DATABASE_H
+#define SEGMENT_DATABASE_H
+
+/**
+ * @file
+ *
+ * This file contains the segment database interface.
+ */
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fusenet-types.h"
+#include "database.h"
+
+namespace fusenet {
+
+  /**
+   * Segment database. A persistent database built from append-only
+   * logs instead of one file per article. The directory for a working
+   * database looks like this:
+   *
+   * <pre>
+   *   seg/ --+-- catalog
+   *          |
+   *          +-- 0.log
+   *          |
+   *          +-- 1.log
+   *          |
+   *          :
+   * </pre>
+   *
+   * The catalog records every newsgroup created and deleted. Each
+   * newsgroup has one log, where every created article is appended,
+   * and every deleted article is recorded as a tombstone. Nothing is
+   * ever rewritten in place, so a create or delete is a single
+   * write().
+   *
+   * On startup the catalog and the logs are scanned to rebuild an
+   * in-memory index, which holds the position of every live article
+   * in its log. Reading an article is then a single pread(). A log
+   * that is mostly tombstones is compacted while it is opened, and a
+   * record torn by a crash at the end of a log is cut off.
+   */
+  class SegmentDatabase : public Database {
+
+  public:
+
+    /**
+     * Create instance, and load the database from disk.
+     */
+    SegmentDatabase(void);
+
+    /**
+     * Clear the database.
+     */
+    Status_t clear(void);
+
+    /**
+     * Get all newsgroups.
+     */
+    Status_t getNewsgroupList(NewsgroupList_t& newsgroupList);
+
+    /**
+     * Check that a newsgroup exists.
+     */
+    Status_t checkNewsgroup(int newsgroupIdentifier);
+
+    /**
+     * Create newsgroups.
+     */
+    Status_t createNewsgroup(std::string& newsgroupName);
+
+    /**
+     * Delete newsgroup.
+     */
+    Status_t deleteNewsgroup(int newsgroupIdentifier);
+
+    /**
+     * List articles.
+     */
+    Status_t listArticles(int newsgroupIdentifier,
+			  ArticleList_t& articleList);
+
+    /**
+     * List article headers.
+     */
+    Status_t listArticleHeaders(int newsgroupIdentifier,
+				ArticleHeaderList_t& headerList);
+
+    /**
+     * Create article.
+     */
+    Status_t createArticle(int newsgroupIdentifier,
+			   Article_t& article);
+
+    /**
+     * Delete article.
+     */
+    Status_t deleteArticle(int newsgroupIdentifer,
+			   int articleIdentifier);
+
+    /**
+     * Get article.
+     */
+    Status_t getArticle(int newsgroupIdentifer,
+			int articleIdentifier,
+			Article_t& article);
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~SegmentDatabase(void);
+
+  private:
+
+    /**
+     * Position of an article record in its log. A length of zero
+     * means that there is no such article.
+     */
+    typedef struct {
+      off_t offset;    //!< Record offset
+      uint32_t length; //!< Record length, header included
+    } Slot_t;
+
+    /**
+     * Newsgroup type.
+     */
+    typedef struct {
+      std::string name;           //!< Name
+      int descriptor;             //!< Log descriptor
+      off_t size;                 //!< Log size
+      off_t garbage;              //!< Bytes of deleted articles and tombstones
+      std::vector<Slot_t> slots;  //!< Articles, indexed by identifier
+    } Group_t;
+
+    typedef std::map<int, Group_t*> GroupMap_t;
+    typedef std::map<std::string, int> NameMap_t;
+
+    /**
+     * Load the catalog and all newsgroup logs.
+     */
+    void load(void);
+
+    /**
+     * Close all logs and forget the index.
+     */
+    void unload(void);
+
+    /**
+     * Open the log of a newsgroup and index its articles.
+     */
+    bool openGroup(int newsgroupIdentifier, Group_t* group);
+
+    /**
+     * Rewrite the log of a newsgroup with only its live articles.
+     */
+    bool compactGroup(int newsgroupIdentifier, Group_t* group);
+
+    /**
+     * Look up a newsgroup.
+     *
+     * @return the newsgroup, or NULL if it does not exist
+     */
+    Group_t* findGroup(int newsgroupIdentifier);
+
+    /**
+     * Look up the position of an article.
+     *
+     * @return the slot, or NULL if the article does not exist
+     */
+    Slot_t* findSlot(Group_t* group, int articleIdentifier);
+
+    /**
+     * Read the record in a slot.
+     */
+    bool readRecord(Group_t* group, Slot_t* slot, std::string& record);
+
+    /**
+     * Append a record to the catalog.
+     */
+    bool appendCatalog(const std::string& record);
+
+    /**
+     * Newsgroups by identifier.
+     */
+    GroupMap_t groups;
+
+    /**
+     * Newsgroup identifiers by name.
+     */
+    NameMap_t names;
+
+    /**
+     * Catalog descriptor.
+     */
+    int catalogDescriptor;
+
+    /**
+     * Identifier of the next newsgroup.
+     */
+    int nextNewsgroup;
+  };
+}
+
+#endif
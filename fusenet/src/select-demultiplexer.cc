@@ -0,0 +1,111 @@
+
+/**
+ * @file
+ *
+ * This file contains the select demultiplexer implementation.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "select-demultiplexer.h"
+
+namespace fusenet {
+
+  SelectDemultiplexer::SelectDemultiplexer(void) {
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    largestDescriptor = -1;
+  }
+
+  bool SelectDemultiplexer::add(int descriptor, int events) {
+    if (descriptor < 0 || descriptor >= FD_SETSIZE) {
+      return false;
+    }
+
+    if (events & EVENT_READ) {
+      FD_SET(descriptor, &readSet);
+    }
+
+    if (events & EVENT_WRITE) {
+      FD_SET(descriptor, &writeSet);
+    }
+
+    if (descriptor > largestDescriptor) {
+      largestDescriptor = descriptor;
+    }
+
+    return true;
+  }
+
+  bool SelectDemultiplexer::modify(int descriptor, int events) {
+    if (descriptor < 0 || descriptor >= FD_SETSIZE) {
+      return false;
+    }
+
+    FD_CLR(descriptor, &readSet);
+    FD_CLR(descriptor, &writeSet);
+    return add(descriptor, events);
+  }
+
+  void SelectDemultiplexer::remove(int descriptor) {
+    if (descriptor < 0 || descriptor >= FD_SETSIZE) {
+      return;
+    }
+
+    FD_CLR(descriptor, &readSet);
+    FD_CLR(descriptor, &writeSet);
+
+    while (largestDescriptor >= 0 &&
+	   !FD_ISSET(largestDescriptor, &readSet) &&
+	   !FD_ISSET(largestDescriptor, &writeSet)) {
+      largestDescriptor--;
+    }
+  }
+
+  bool SelectDemultiplexer::wait(EventList_t& eventList) {
+    fd_set readReady = readSet;
+    fd_set writeReady = writeSet;
+    int status;
+    int descriptor;
+
+    eventList.clear();
+    status = select(largestDescriptor + 1, &readReady, &writeReady, NULL, NULL);
+
+    if (status == -1) {
+      return false;
+    }
+
+    for (descriptor = 0; status > 0 && descriptor <= largestDescriptor; descriptor++) {
+      Event_t event;
+
+      event.descriptor = descriptor;
+      event.events = 0;
+
+      if (FD_ISSET(descriptor, &readReady)) {
+	event.events |= EVENT_READ;
+	status--;
+      }
+
+      if (FD_ISSET(descriptor, &writeReady)) {
+	event.events |= EVENT_WRITE;
+	status--;
+      }
+
+      if (event.events != 0) {
+	eventList.push_back(event);
+      }
+    }
+
+    return true;
+  }
+
+  const char* SelectDemultiplexer::getName(void) const {
+    return "select";
+  }
+
+  SelectDemultiplexer::~SelectDemultiplexer(void) {
+    // Does nothing
+  }
+}
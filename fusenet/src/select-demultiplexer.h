@@ -0,0 +1,81 @@
+#ifndef SELECT_DEMULTIPLEXER_H
+#define SELECT_DEMULTIPLEXER_H
+
+/**
+ * @file
+ *
+ * This file contains the select demultiplexer interface.
+ */
+
+#include <sys/select.h>
+
+#include "demultiplexer.h"
+
+namespace fusenet {
+
+  /**
+   * Demultiplexer based on select(). This is the portable fallback.
+   * The descriptor sets are kept between calls and only copied before
+   * each select(), but the call itself still scans every descriptor
+   * up to the largest one, and descriptors must be below FD_SETSIZE.
+   */
+  class SelectDemultiplexer : public Demultiplexer {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    SelectDemultiplexer(void);
+
+    /**
+     * Register a descriptor. Fails for descriptors that do not fit
+     * in a descriptor set.
+     */
+    bool add(int descriptor, int events);
+
+    /**
+     * Change the events to wait for on a registered descriptor.
+     */
+    bool modify(int descriptor, int events);
+
+    /**
+     * Unregister a descriptor.
+     */
+    void remove(int descriptor);
+
+    /**
+     * Block until at least one registered descriptor is ready.
+     */
+    bool wait(EventList_t& eventList);
+
+    /**
+     * Demultiplexer name.
+     */
+    const char* getName(void) const;
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~SelectDemultiplexer(void);
+
+  private:
+
+    /**
+     * Registered read interest.
+     */
+    fd_set readSet;
+
+    /**
+     * Registered write interest.
+     */
+    fd_set writeSet;
+
+    /**
+     * Largest registered descriptor, or -1.
+     */
+    int largestDescriptor;
+  };
+}
+
+#endif
@@ -4,17 +4,43 @@
  * This file contains the server creator implementation.
  */
 
+#include "log.h"
 #include "server-creator.h"
 #include "server.h"
 
 namespace fusenet {
   
-  ServerCreator::ServerCreator(Database* database) {
+  ServerCreator::ServerCreator(Database* database, NewsgroupListCache* cache,
+			       SubscriberRegistry* registry, Statistics* statistics) {
     this->database = database;
+    this->cache = cache;
+    this->registry = registry;
+    this->statistics = statistics;
+    this->workerPool = NULL;
+    this->reactor = NULL;
+
+    LOG(LOG_LEVEL_WARNING) << "[ServerCreator] Servers without a reactor can not "
+			   << "deliver notifications, subscriptions will be refused";
+  }
+
+  ServerCreator::ServerCreator(Database* database, NewsgroupListCache* cache,
+			       SubscriberRegistry* registry, Statistics* statistics,
+			       WorkerPool* workerPool, NetworkReactor* reactor) {
+    this->database = database;
+    this->cache = cache;
+    this->registry = registry;
+    this->statistics = statistics;
+    this->workerPool = workerPool;
+    this->reactor = reactor;
   }
 
   Protocol* ServerCreator::create(Transport* const transport) const {
-    return new Server(transport, database);
+    if (reactor != NULL) {
+      return new Server(transport, database, cache, registry, statistics,
+			workerPool, reactor);
+    }
+
+    return new Server(transport, database, cache, registry, statistics);
   }
 
 }
@@ -8,9 +8,14 @@
  */
 
 #include "database.h"
+#include "network-reactor.h"
+#include "newsgroup-list-cache.h"
 #include "protocol-creator.h"
 #include "protocol.h"
+#include "statistics.h"
+#include "subscriber-registry.h"
 #include "transport.h"
+#include "worker-pool.h"
 
 namespace fusenet {
 
@@ -22,11 +27,34 @@ namespace fusenet {
   public:
 
     /**
-     * Construct a server with a given database.
+     * Construct a server with a given database. Its servers have no
+     * reactor to deliver notifications through, so they refuse
+     * subscriptions.
      *
      * @param database the database to give the server instance.
+     * @param cache the newsgroup list cache shared by all servers
+     * @param registry the subscriber registry shared by all servers
+     * @param statistics the request statistics shared by all servers,
+     *        or NULL to neither time nor count requests
      */
-    ServerCreator(Database* const Database);
+    ServerCreator(Database* const database, NewsgroupListCache* cache,
+		  SubscriberRegistry* registry, Statistics* statistics);
+
+    /**
+     * Construct a server with a given database, that executes
+     * requests on a worker pool.
+     *
+     * @param database the database to give the server instance.
+     * @param cache the newsgroup list cache shared by all servers
+     * @param registry the subscriber registry shared by all servers
+     * @param statistics the request statistics shared by all servers,
+     *        or NULL to neither time nor count requests
+     * @param workerPool the worker pool, or NULL
+     * @param reactor the reactor the servers are created for
+     */
+    ServerCreator(Database* const database, NewsgroupListCache* cache,
+		  SubscriberRegistry* registry, Statistics* statistics,
+		  WorkerPool* workerPool, NetworkReactor* reactor);
 
     /**
      * Creates instances of server protocols.
@@ -41,6 +69,31 @@ namespace fusenet {
      * Database instance to give all new protocol instances.
      */
     Database* database;
+
+    /**
+     * Newsgroup list cache to give all new protocol instances.
+     */
+    NewsgroupListCache* cache;
+
+    /**
+     * Subscriber registry to give all new protocol instances.
+     */
+    SubscriberRegistry* registry;
+
+    /**
+     * Request statistics to give all new protocol instances.
+     */
+    Statistics* statistics;
+
+    /**
+     * Worker pool to give all new protocol instances, or NULL.
+     */
+    WorkerPool* workerPool;
+
+    /**
+     * Reactor the protocol instances belong to, or NULL.
+     */
+    NetworkReactor* reactor;
   };
 }
 
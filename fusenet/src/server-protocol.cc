@@ -4,10 +4,14 @@
  * This file contains the server protocol implementation.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
+#include "log.h"
+#include "message-builder.h"
 #include "server-protocol.h"
+#include "statistics.h"
 
 namespace fusenet {
 
@@ -24,6 +28,9 @@ namespace fusenet {
     case STATUS_FAILURE_A_DOES_NOT_EXIST:
       status = ERR_ART_DOES_NOT_EXIST;
       break;
+    case STATUS_NOT_MODIFIED:
+      status = ERR_NOT_MODIFIED;
+      break;
     case STATUS_FAILURE:
       status = ERR_NG_DOES_NOT_EXIST; // This is broken
       break;
@@ -35,169 +42,706 @@ namespace fusenet {
     return status;
   }
 
-  void ServerProtocol::replyListNewsgroups(NewsgroupList_t& newsgroupList) {
-    NewsgroupList_t::iterator i;
+  /**
+   * Size of the status of a reply.
+   */
+  static size_t StatusSize(Status_t status) {
+    return IS_SUCCESS(status) ? 1 : 2;
+  }
+
+  /**
+   * Add the status of a reply.
+   */
+  static void AddStatus(MessageBuilder& message, Status_t status) {
+    if (IS_SUCCESS(status)) {
+      message.addCommand(ANS_ACK);
+    } else {
+      message.addCommand(ANS_NAK);
+      message.addCommand(TranslateError(status));
+    }
+  }
+
+  ServerProtocol::ServerProtocol(Transport* transport) : MessageProtocol(transport) {
+    parseState = PARSE_COMMAND;
+    parseTime = 0;
+    parseStart = 0;
+    timed = false;
+    requestSize = 0;
+    command = 0;
+    signature = "";
+    parameter = 0;
+    bytesRead = 0;
+    stringLength = 0;
+    listCounted = false;
+    listRemaining = 0;
+  }
+
+  /**
+   * Size of the reply to list newsgroups.
+   */
+  static size_t ListNewsgroupsSize(const NewsgroupList_t& newsgroupList) {
+    NewsgroupList_t::const_iterator i;
+    size_t size;
+
+    size = 2 * MessageBuilder::commandSize() + MessageBuilder::numberSize();
+
+    for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
+      size += MessageBuilder::numberSize() + MessageBuilder::stringSize(i->name.size());
+    }
+
+    return size;
+  }
 
-    sendCommand(ANS_LIST_NG);
-    sendParameter(newsgroupList.size());
+  /**
+   * Add the reply to list newsgroups.
+   */
+  static void AddListNewsgroups(MessageBuilder& message,
+				const NewsgroupList_t& newsgroupList) {
+    NewsgroupList_t::const_iterator i;
+
+    message.addCommand(ANS_LIST_NG);
+    message.addNumber(newsgroupList.size());
 
     for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
-      Newsgroup_t& newsgroup = *i;
-      sendParameter(newsgroup.id);
-      sendParameter(newsgroup.name);
+      message.addNumber(i->id);
+      message.addString(i->name);
     }
 
-    sendCommand(ANS_END);
+    message.addCommand(ANS_END);
+  }
+
+  void ServerProtocol::replyListNewsgroups(NewsgroupList_t& newsgroupList) {
+    {
+      MessageBuilder message(transport, ListNewsgroupsSize(newsgroupList));
+      AddListNewsgroups(message, newsgroupList);
+    }
+
+    flush();
+  }
+
+  void ServerProtocol::encodeListNewsgroups(const NewsgroupList_t& newsgroupList,
+					    std::vector<uint8_t>& message) {
+    message.resize(ListNewsgroupsSize(newsgroupList));
+    MessageBuilder builder(&message[0], message.size());
+    AddListNewsgroups(builder, newsgroupList);
+  }
+
+  void ServerProtocol::replyEncoded(const std::vector<uint8_t>& message) {
+    transport->send(&message[0], message.size());
+    flush();
   }
 
   void ServerProtocol::replyCreateNewsgroup(Status_t status) {
-    sendCommand(ANS_CREATE_NG);
-    sendStatus(status);
-    sendCommand(ANS_END);
+    replyStatus(ANS_CREATE_NG, status);
   }
 
   void ServerProtocol::replyDeleteNewsgroup(Status_t status) {
-    sendCommand(ANS_DELETE_NG);
-    sendStatus(status);
-    sendCommand(ANS_END);
+    replyStatus(ANS_DELETE_NG, status);
   }
 
   void ServerProtocol::replyListArticles(Status_t status,
-					 ArticleList_t& articleList) {
-    ArticleList_t::iterator i;
+					 ArticleHeaderList_t& headerList) {
+    ArticleHeaderList_t::iterator i;
+    size_t size;
+
+    size = 2 * MessageBuilder::commandSize() + StatusSize(status);
+
+    if (IS_SUCCESS(status)) {
+      size += MessageBuilder::numberSize();
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	size += MessageBuilder::numberSize() + MessageBuilder::stringSize(i->title.size());
+      }
+    }
+
+    MessageBuilder message(transport, size);
+
+    message.addCommand(ANS_LIST_ART);
+    AddStatus(message, status);
+
+    if (IS_SUCCESS(status)) {
+      message.addNumber(headerList.size());
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	message.addNumber(i->id);
+	message.addString(i->title);
+      }
+    }
+
+    message.addCommand(ANS_END);
+    flush();
+  }
+
+  void ServerProtocol::replyListArticlePage(Status_t status,
+					    ArticleHeaderList_t& headerList,
+					    int nextCursor) {
+    ArticleHeaderList_t::iterator i;
+    size_t size;
 
-    sendCommand(ANS_LIST_ART);
-    sendStatus(status);
+    size = 2 * MessageBuilder::commandSize() + StatusSize(status);
 
     if (IS_SUCCESS(status)) {
-      sendParameter(articleList.size());
-      for (i = articleList.begin(); i != articleList.end(); i++) {
-	Article_t& article = *i;
-	sendParameter(article.id);
-	sendParameter(article.title);
+      size += 2 * MessageBuilder::numberSize();
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	size += MessageBuilder::numberSize() + MessageBuilder::stringSize(i->title.size());
       }
     }
 
-    sendCommand(ANS_END);
+    MessageBuilder message(transport, size);
+
+    message.addCommand(ANS_LIST_ART_PAGE);
+    AddStatus(message, status);
+
+    if (IS_SUCCESS(status)) {
+      message.addNumber(nextCursor);
+      message.addNumber(headerList.size());
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	message.addNumber(i->id);
+	message.addString(i->title);
+      }
+    }
+
+    message.addCommand(ANS_END);
+    flush();
   }
 
   void ServerProtocol::replyCreateArticle(Status_t status) {
-    sendCommand(ANS_CREATE_ART);
-    sendStatus(status);
-    sendCommand(ANS_END);
+    replyStatus(ANS_CREATE_ART, status);
   }
 
   void ServerProtocol::replyDeleteArticle(Status_t status) {
-    sendCommand(ANS_DELETE_ART);
-    sendStatus(status);
-    sendCommand(ANS_END);
+    replyStatus(ANS_DELETE_ART, status);
   }
 
   void ServerProtocol::replyGetArticle(Status_t status,
 				       Article_t& article) {
-    sendCommand(ANS_GET_ART);
-    sendStatus(status);
+    size_t size;
+
+    size = 2 * MessageBuilder::commandSize() + StatusSize(status);
 
     if (IS_SUCCESS(status)) {
-      sendParameter(article.title);
-      sendParameter(article.author);
-      sendParameter(article.text);
+      size += MessageBuilder::stringSize(article.title.size()) +
+	MessageBuilder::stringSize(article.author.size()) +
+	MessageBuilder::stringSize(article.text.size());
     }
 
-    sendCommand(ANS_END);
+    MessageBuilder message(transport, size);
+
+    message.addCommand(ANS_GET_ART);
+    AddStatus(message, status);
+
+    if (IS_SUCCESS(status)) {
+      message.addString(article.title);
+      message.addString(article.author);
+      message.addString(article.text);
+    }
+
+    message.addCommand(ANS_END);
+    flush();
   }
 
-  void ServerProtocol::handleListNewsgroups(void) {
-    receiveCommand();
-    onListNewsgroups();
+  /**
+   * Size of an article in a reply. A text in a file only counts its
+   * string header, since the text itself is sent from the file.
+   */
+  static size_t ArticleSize(const ArticleRef& article, bool inFile) {
+    return MessageBuilder::stringSize(article.getTitleSize()) +
+      MessageBuilder::stringSize(article.getAuthorSize()) +
+      MessageBuilder::stringSize(inFile ? 0 : article.getTextSize());
   }
 
-  void ServerProtocol::handleCreateNewsgroup(void) {
-    std::string name;
-    receiveParameter(name);
-    receiveCommand();
-    onCreateNewsgroup(name);
+  /**
+   * Add an article to a reply. A text in a file only gets its string
+   * header added.
+   */
+  static void AddArticle(MessageBuilder& message, const ArticleRef& article,
+			 bool inFile) {
+    message.addString(article.getTitle(), article.getTitleSize());
+    message.addString(article.getAuthor(), article.getAuthorSize());
+
+    if (inFile) {
+      message.addStringHeader(article.getTextSize());
+    } else {
+      message.addString(article.getText(), article.getTextSize());
+    }
   }
 
-  void ServerProtocol::handleDeleteNewsgroup(void) {
-    int id;
-    receiveParameter(&id);
-    receiveCommand();
-    onDeleteNewsgroup(id);
+  void ServerProtocol::replyGetArticle(Status_t status,
+				       const ArticleRef& article) {
+    bool inFile = IS_SUCCESS(status) && article.getTextDescriptor() != -1;
+    size_t size;
+
+    size = MessageBuilder::commandSize() + StatusSize(status);
+
+    if (IS_SUCCESS(status)) {
+      size += ArticleSize(article, inFile);
+    }
+
+    // A text in a file is sent after the message, followed by the end
+    if (!inFile) {
+      size += MessageBuilder::commandSize();
+    }
+
+    // The message must be complete before anything else is sent
+    {
+      MessageBuilder message(transport, size);
+
+      message.addCommand(ANS_GET_ART);
+      AddStatus(message, status);
+
+      if (IS_SUCCESS(status)) {
+	AddArticle(message, article, inFile);
+      }
+
+      if (!inFile) {
+	message.addCommand(ANS_END);
+      }
+    }
+
+    if (inFile) {
+      transport->sendFile(article.getOwner(), article.getTextDescriptor(),
+			  article.getTextOffset(), article.getTextSize());
+      sendCommand(ANS_END);
+    }
+
+    flush();
   }
 
-  void ServerProtocol::handleListArticles(void) {
-    int group;
-    receiveParameter(&group);
-    receiveCommand();
-    onListArticles(group);
+  void ServerProtocol::replyGetArticles(Status_t status,
+					const IdentifierList_t& articleIdentifiers,
+					const ArticleRefList_t& articles,
+					const StatusList_t& statuses) {
+    size_t count = IS_SUCCESS(status) ? articleIdentifiers.size() : 0;
+    size_t begin = 0;
+    size_t end;
+    size_t size;
+    bool inFile;
+
+    // Articles are encoded together up to and including the first
+    // text in a file, which is sent from the file before the rest
+    do {
+      size = 0;
+      inFile = false;
+
+      if (begin == 0) {
+	size += MessageBuilder::commandSize() + StatusSize(status);
+
+	if (IS_SUCCESS(status)) {
+	  size += MessageBuilder::numberSize();
+	}
+      }
+
+      for (end = begin; end < count && !inFile; end++) {
+	size += MessageBuilder::numberSize() + StatusSize(statuses[end]);
+
+	if (IS_SUCCESS(statuses[end])) {
+	  inFile = articles[end].getTextDescriptor() != -1;
+	  size += ArticleSize(articles[end], inFile);
+	}
+      }
+
+      if (!inFile) {
+	size += MessageBuilder::commandSize();
+      }
+
+      {
+	MessageBuilder message(transport, size);
+
+	if (begin == 0) {
+	  message.addCommand(ANS_GET_ARTS);
+	  AddStatus(message, status);
+
+	  if (IS_SUCCESS(status)) {
+	    message.addNumber(count);
+	  }
+	}
+
+	for (; begin < end; begin++) {
+	  message.addNumber(articleIdentifiers[begin]);
+	  AddStatus(message, statuses[begin]);
+
+	  if (IS_SUCCESS(statuses[begin])) {
+	    AddArticle(message, articles[begin], inFile && begin + 1 == end);
+	  }
+	}
+
+	if (!inFile) {
+	  message.addCommand(ANS_END);
+	}
+      }
+
+      if (inFile) {
+	const ArticleRef& article = articles[end - 1];
+	transport->sendFile(article.getOwner(), article.getTextDescriptor(),
+			    article.getTextOffset(), article.getTextSize());
+      }
+    } while (inFile);
+
+    flush();
   }
-    
-  void ServerProtocol::handleCreateArticle(void) {
-    int ngid;
-    Article_t article;
-    receiveParameter(&ngid);
-    receiveParameter(article.title);
-    receiveParameter(article.author);
-    receiveParameter(article.text);
-    receiveCommand();
-    onCreateArticle(ngid, article);
-  }
-
-  void ServerProtocol::handleDeleteArticle(void) {
-    int gid, aid;
-    receiveParameter(&gid);
-    receiveParameter(&aid);
-    receiveCommand();
-    onDeleteArticle(gid, aid);
-  }
-
-  void ServerProtocol::handleGetArticle(void) {
-    int gid, aid;
-    receiveParameter(&gid);
-    receiveParameter(&aid);
-    receiveCommand();
-    onGetArticle(gid, aid);
-  }
-
-  void ServerProtocol::sendStatus(Status_t status) {
+
+  void ServerProtocol::replyListNewsgroupsIfModified(Status_t status,
+						     Version_t version,
+						     const NewsgroupList_t& newsgroupList) {
+    NewsgroupList_t::const_iterator i;
+    size_t size;
+
+    size = 2 * MessageBuilder::commandSize() + StatusSize(status);
+
     if (IS_SUCCESS(status)) {
-      sendCommand(ANS_ACK);
-    } else {
-      sendCommand(ANS_NAK);
-      sendCommand(TranslateError(status));
+      size += 2 * MessageBuilder::numberSize();
+
+      for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
+	size += MessageBuilder::numberSize() + MessageBuilder::stringSize(i->name.size());
+      }
     }
+
+    MessageBuilder message(transport, size);
+
+    message.addCommand(ANS_LIST_NG_IF);
+    AddStatus(message, status);
+
+    if (IS_SUCCESS(status)) {
+      message.addNumber(version);
+      message.addNumber(newsgroupList.size());
+
+      for (i = newsgroupList.begin(); i != newsgroupList.end(); i++) {
+	message.addNumber(i->id);
+	message.addString(i->name);
+      }
+    }
+
+    message.addCommand(ANS_END);
+    flush();
+  }
+
+  void ServerProtocol::replyListArticlesIfModified(Status_t status,
+						   Version_t version,
+						   const ArticleHeaderList_t& headerList) {
+    ArticleHeaderList_t::const_iterator i;
+    size_t size;
+
+    size = 2 * MessageBuilder::commandSize() + StatusSize(status);
+
+    if (IS_SUCCESS(status)) {
+      size += 2 * MessageBuilder::numberSize();
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	size += MessageBuilder::numberSize() + MessageBuilder::stringSize(i->title.size());
+      }
+    }
+
+    MessageBuilder message(transport, size);
+
+    message.addCommand(ANS_LIST_ART_IF);
+    AddStatus(message, status);
+
+    if (IS_SUCCESS(status)) {
+      message.addNumber(version);
+      message.addNumber(headerList.size());
+
+      for (i = headerList.begin(); i != headerList.end(); i++) {
+	message.addNumber(i->id);
+	message.addString(i->title);
+      }
+    }
+
+    message.addCommand(ANS_END);
+    flush();
+  }
+
+  void ServerProtocol::replySubscribe(Status_t status) {
+    replyStatus(ANS_SUBSCRIBE, status);
+  }
+
+  void ServerProtocol::replyUnsubscribe(Status_t status) {
+    replyStatus(ANS_UNSUBSCRIBE, status);
+  }
+
+  void ServerProtocol::replyStatistics(const std::string& report) {
+    {
+      MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			     MessageBuilder::stringSize(report.size()));
+
+      message.addCommand(ANS_STATS);
+      message.addString(report);
+      message.addCommand(ANS_END);
+    }
+
+    flush();
+  }
+
+  void ServerProtocol::notifyNewArticle(int newsgroupIdentifier,
+					int articleIdentifier,
+					const std::string& title) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   2 * MessageBuilder::numberSize() +
+			   MessageBuilder::stringSize(title.size()));
+
+    message.addCommand(ANS_NEW_ART);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(articleIdentifier);
+    message.addString(title);
+    message.addCommand(ANS_END);
+    flush();
+  }
+
+  void ServerProtocol::notifyDeletedArticle(int newsgroupIdentifier,
+					    int articleIdentifier) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() +
+			   2 * MessageBuilder::numberSize());
+
+    message.addCommand(ANS_ART_DELETED);
+    message.addNumber(newsgroupIdentifier);
+    message.addNumber(articleIdentifier);
+    message.addCommand(ANS_END);
+    flush();
+  }
+
+  void ServerProtocol::replyStatus(MessageIdentifier_t answer, Status_t status) {
+    MessageBuilder message(transport, 2 * MessageBuilder::commandSize() + StatusSize(status));
+
+    message.addCommand(answer);
+    AddStatus(message, status);
+    message.addCommand(ANS_END);
+    flush();
   }
 
   void ServerProtocol::onDataReceived(uint8_t data) {
+    onDataReceived(&data, 1);
+  }
+
+  void ServerProtocol::onDataReceived(const uint8_t* data, size_t length) {
+    size_t i = 0;
+    size_t start = 0;
+
+    // A request that continues from an earlier block is timed from
+    // here, so waiting for the block does not count
+    if (timed) {
+      parseStart = Statistics::now();
+    }
+
+    while (i < length && !transport->isClosed()) {
+      switch (parseState) {
+      case PARSE_COMMAND:
+	if (!beginRequest(data[i])) {
+	  protocolError("Error, unknown command byte: ", data[i]);
+	}
+	start = i;
+	i++;
+	break;
+
+      case PARSE_PARAMETER:
+	if (data[i] == PAR_NUM && (signature[parameter] == 'n' ||
+				   signature[parameter] == 'l')) {
+	  parseState = PARSE_NUMBER;
+	} else if (data[i] == PAR_STRING && signature[parameter] == 's') {
+	  parseState = PARSE_STRING_LENGTH;
+	} else {
+	  protocolError("Error, unexpected parameter byte: ", data[i]);
+	}
+	bytesRead = 0;
+	i++;
+	break;
+
+      case PARSE_NUMBER:
+      case PARSE_STRING_LENGTH:
+	number[bytesRead++] = data[i++];
+
+	if (bytesRead == sizeof(number)) {
+	  size_t n;
+	  pack(number, &n);
+
+	  if (parseState == PARSE_NUMBER && signature[parameter] == 'l') {
+	    listNumber(n);
+	  } else if (parseState == PARSE_NUMBER) {
+	    numbers.push_back(static_cast<int>(n));
+	    nextParameter();
+	  } else {
+	    strings.push_back(std::string());
+	    stringLength = n;
+	    bytesRead = 0;
+	    parseState = PARSE_STRING;
+
+	    if (stringLength == 0) {
+	      nextParameter();
+	    }
+	  }
+	}
+	break;
+
+      case PARSE_STRING:
+	{
+	  size_t n = std::min(length - i, stringLength - bytesRead);
+	  strings.back().append(reinterpret_cast<const char*>(data + i), n);
+	  bytesRead += n;
+	  i += n;
 
+	  if (bytesRead == stringLength) {
+	    nextParameter();
+	  }
+	}
+	break;
+
+      case PARSE_END:
+	if (data[i] == COM_END) {
+	  if (timed) {
+	    // Decoding the next request starts where this one ends
+	    uint64_t now = Statistics::now();
+	    parseTime += now - parseStart;
+	    parseStart = now;
+	  }
+
+	  parseState = PARSE_COMMAND;
+	  requestSize += i + 1 - start;
+	  dispatchRequest();
+	} else {
+	  protocolError("Error, expected end byte but got: ", data[i]);
+	}
+	i++;
+	break;
+      }
+    }
+
+    if (parseState != PARSE_COMMAND) {
+      if (timed) {
+	parseTime += Statistics::now() - parseStart;
+      }
+
+      requestSize += length - start;
+    }
+  }
+
+  bool ServerProtocol::beginRequest(uint8_t data) {
     switch (data) {
     case COM_LIST_NG:
-      handleListNewsgroups();
+    case COM_STATS:
+      signature = "";
       break;
     case COM_CREATE_NG:
-      handleCreateNewsgroup();
+      signature = "s";
       break;
     case COM_DELETE_NG:
-      handleDeleteNewsgroup();
+    case COM_LIST_ART:
+    case COM_SUBSCRIBE:
+    case COM_UNSUBSCRIBE:
+    case COM_LIST_NG_IF:
+      signature = "n";
+      break;
+    case COM_CREATE_ART:
+      signature = "nsss";
+      break;
+    case COM_DELETE_ART:
+    case COM_GET_ART:
+    case COM_LIST_ART_IF:
+      signature = "nn";
+      break;
+    case COM_GET_ARTS:
+      signature = "nl";
+      break;
+    case COM_LIST_ART_PAGE:
+      signature = "nnnn";
+      break;
+    default:
+      return false;
+    }
+
+    command = data;
+    parseTime = 0;
+    requestSize = 0;
+    parameter = 0;
+    numbers.clear();
+    strings.clear();
+    list.clear();
+    listCounted = false;
+    parseState = (signature[0] == '\0') ? PARSE_END : PARSE_PARAMETER;
+
+    return true;
+  }
+
+  void ServerProtocol::nextParameter(void) {
+    parameter++;
+    parseState = (signature[parameter] == '\0') ? PARSE_END : PARSE_PARAMETER;
+  }
+
+  void ServerProtocol::listNumber(size_t n) {
+    if (!listCounted) {
+      listCounted = true;
+      listRemaining = n;
+    } else {
+      list.push_back(static_cast<int>(n));
+      listRemaining--;
+    }
+
+    if (listRemaining == 0) {
+      nextParameter();
+    } else {
+      parseState = PARSE_PARAMETER;
+    }
+  }
+
+  void ServerProtocol::dispatchRequest(void) {
+    switch (command) {
+    case COM_LIST_NG:
+      onListNewsgroups();
+      break;
+    case COM_CREATE_NG:
+      onCreateNewsgroup(strings[0]);
+      break;
+    case COM_DELETE_NG:
+      onDeleteNewsgroup(numbers[0]);
       break;
     case COM_LIST_ART:
-      handleListArticles();
+      onListArticles(numbers[0]);
       break;
     case COM_CREATE_ART:
-      handleCreateArticle();
+      {
+	Article_t article;
+	article.id = -1;
+	article.title.swap(strings[0]);
+	article.author.swap(strings[1]);
+	article.text.swap(strings[2]);
+	onCreateArticle(numbers[0], article);
+      }
       break;
     case COM_DELETE_ART:
-      handleDeleteArticle();
+      onDeleteArticle(numbers[0], numbers[1]);
       break;
     case COM_GET_ART:
-      handleGetArticle();
+      onGetArticle(numbers[0], numbers[1]);
+      break;
+    case COM_GET_ARTS:
+      onGetArticles(numbers[0], list);
+      break;
+    case COM_LIST_ART_PAGE:
+      onListArticlePage(numbers[0], numbers[1], numbers[2], numbers[3]);
+      break;
+    case COM_LIST_NG_IF:
+      onListNewsgroupsIfModified(static_cast<Version_t>(numbers[0]));
+      break;
+    case COM_LIST_ART_IF:
+      onListArticlesIfModified(numbers[0], static_cast<Version_t>(numbers[1]));
+      break;
+    case COM_SUBSCRIBE:
+      onSubscribe(numbers[0]);
+      break;
+    case COM_UNSUBSCRIBE:
+      onUnsubscribe(numbers[0]);
+      break;
+    case COM_STATS:
+      onStatistics();
       break;
     default:
-      std::cerr << "Error, unknown command byte: " 
-		<< static_cast<int>(data) << std::endl;
+      assert(0 == "This cannot happen");
       break;
     }
   }
-}
 
+  void ServerProtocol::protocolError(const char* message, uint8_t data) {
+    LOG(LOG_LEVEL_WARNING) << message << static_cast<int>(data);
+    parseState = PARSE_COMMAND;
+    transport->close();
+  }
+}
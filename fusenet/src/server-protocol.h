@@ -7,9 +7,12 @@
  * This file contains the server protocol interface.
  */
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
+#include "article-ref.h"
 #include "message-protocol.h"
 
 namespace fusenet {
@@ -30,7 +33,7 @@ namespace fusenet {
      *
      * @param transport the transport
      */
-    ServerProtocol(Transport* transport) : MessageProtocol(transport) { }
+    ServerProtocol(Transport* transport);
 
     /**
      * List newsgroups callback.
@@ -44,6 +47,23 @@ namespace fusenet {
      */
     void replyListNewsgroups(NewsgroupList_t& newsgroupList);
 
+    /**
+     * Encode the reply to list newsgroups, to be sent later with
+     * replyEncoded().
+     *
+     * @param newsgroupList the list of newsgroups
+     * @param message where to put the encoded reply
+     */
+    static void encodeListNewsgroups(const NewsgroupList_t& newsgroupList,
+				     std::vector<uint8_t>& message);
+
+    /**
+     * Reply with a message that was encoded beforehand.
+     *
+     * @param message the encoded reply
+     */
+    void replyEncoded(const std::vector<uint8_t>& message);
+
     /**
      * Create newsgroup.
      *
@@ -83,11 +103,36 @@ namespace fusenet {
      * Reply list articles.
      *
      * @param status the status
-     * @param articleList the article list
+     * @param headerList the article headers
      */
     void replyListArticles(Status_t status,
-			   ArticleList_t& articleList);
+			   ArticleHeaderList_t& headerList);
     
+    /**
+     * List a page of articles.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param cursor list the articles after this identifier, or
+     *        CURSOR_NONE to start from the first or the last article
+     * @param direction LIST_FORWARD or LIST_BACKWARD
+     * @param maxCount the largest number of articles asked for
+     */
+    virtual void onListArticlePage(int newsgroupIdentifier,
+				   int cursor,
+				   int direction,
+				   int maxCount) = 0;
+
+    /**
+     * Reply list a page of articles.
+     *
+     * @param status the status
+     * @param headerList the article headers
+     * @param nextCursor the cursor of the next page, or CURSOR_NONE
+     */
+    void replyListArticlePage(Status_t status,
+			      ArticleHeaderList_t& headerList,
+			      int nextCursor);
+
     /**
      * Create article.
      *
@@ -138,6 +183,143 @@ namespace fusenet {
     void replyGetArticle(Status_t status,
 			 Article_t& article);
 
+    /**
+     * Reply get article, encoding the article straight from where it
+     * is stored.
+     *
+     * @param status the status
+     * @param article the article
+     */
+    void replyGetArticle(Status_t status,
+			 const ArticleRef& article);
+
+    /**
+     * Get several articles.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifiers the article identifiers
+     */
+    virtual void onGetArticles(int newsgroupIdentifier,
+			       IdentifierList_t& articleIdentifiers) = 0;
+
+    /**
+     * Reply get several articles. Each article is sent with its
+     * identifier and its own status, in the order asked for.
+     *
+     * @param status the status, failing if the newsgroup does not exist
+     * @param articleIdentifiers the article identifiers
+     * @param articles the articles
+     * @param statuses the status of each article
+     */
+    void replyGetArticles(Status_t status,
+			  const IdentifierList_t& articleIdentifiers,
+			  const ArticleRefList_t& articles,
+			  const StatusList_t& statuses);
+
+    /**
+     * List newsgroups, unless the list has not changed.
+     *
+     * @param version the version of the list the client has, or
+     *        VERSION_NONE
+     */
+    virtual void onListNewsgroupsIfModified(Version_t version) = 0;
+
+    /**
+     * Reply list newsgroups if modified.
+     *
+     * @param status the status, STATUS_NOT_MODIFIED if the client's
+     *        list is current
+     * @param version the version of the list
+     * @param newsgroupList the newsgroups
+     */
+    void replyListNewsgroupsIfModified(Status_t status,
+				       Version_t version,
+				       const NewsgroupList_t& newsgroupList);
+
+    /**
+     * List articles, unless the newsgroup has not changed.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param version the version of the newsgroup the client has, or
+     *        VERSION_NONE
+     */
+    virtual void onListArticlesIfModified(int newsgroupIdentifier,
+					  Version_t version) = 0;
+
+    /**
+     * Reply list articles if modified.
+     *
+     * @param status the status, STATUS_NOT_MODIFIED if the client's
+     *        list is current
+     * @param version the version of the newsgroup
+     * @param headerList the article headers
+     */
+    void replyListArticlesIfModified(Status_t status,
+				     Version_t version,
+				     const ArticleHeaderList_t& headerList);
+
+    /**
+     * Subscribe to a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    virtual void onSubscribe(int newsgroupIdentifier) = 0;
+
+    /**
+     * Reply subscribe.
+     *
+     * @param status the status
+     */
+    void replySubscribe(Status_t status);
+
+    /**
+     * Unsubscribe from a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    virtual void onUnsubscribe(int newsgroupIdentifier) = 0;
+
+    /**
+     * Reply unsubscribe.
+     *
+     * @param status the status
+     */
+    void replyUnsubscribe(Status_t status);
+
+    /**
+     * Get the statistics of the requests handled by the server.
+     */
+    virtual void onStatistics(void) = 0;
+
+    /**
+     * Reply statistics.
+     *
+     * @param report the statistics, as text
+     */
+    void replyStatistics(const std::string& report);
+
+    /**
+     * Tell a subscriber about a new article. This is not a reply, and
+     * may be sent between any two replies.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     * @param title the article title
+     */
+    void notifyNewArticle(int newsgroupIdentifier,
+			  int articleIdentifier,
+			  const std::string& title);
+
+    /**
+     * Tell a subscriber about a deleted article. This is not a reply,
+     * and may be sent between any two replies.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifier the article identifier
+     */
+    void notifyDeletedArticle(int newsgroupIdentifier,
+			      int articleIdentifier);
+
     /**
      * Called on made connection.
      */
@@ -148,54 +330,168 @@ namespace fusenet {
      */
     virtual void onConnectionLost(void) = 0;
 
-  private:
+  protected:
 
     /**
-     * Handle list newsgroups.
+     * Called on data receival.
+     *
+     * @param data the data received
      */
-    void handleListNewsgroups(void);
+    void onDataReceived(uint8_t data);
 
     /**
-     * Handle create newsgroup.
+     * Called on data receival with a block of data. Consumes
+     * whatever is given and dispatches every request that becomes
+     * complete, never waiting for more data.
+     *
+     * @param data the data received
+     * @param length the number of bytes received
      */
-    void handleCreateNewsgroup(void);
+    void onDataReceived(const uint8_t* data, size_t length);
 
     /**
-     * Handle delete newsgroup.
+     * Nanoseconds spent decoding the request being dispatched, not
+     * counting the time between the blocks of data it came in.
      */
-    void handleDeleteNewsgroup(void);
+    uint64_t parseTime;
 
     /**
-     * Handle list articles.
+     * Size of the request being dispatched.
      */
-    void handleListArticles(void);
+    size_t requestSize;
 
     /**
-     * Handle create article.
+     * When decoding last started, or resumed after the request before
+     * was handled inline.
      */
-    void handleCreateArticle(void);
+    uint64_t parseStart;
 
     /**
-     * Handle delete article.
+     * True if requests are timed. Otherwise the clock is never read,
+     * and parseTime and parseStart stay 0.
      */
-    void handleDeleteArticle(void);
+    bool timed;
+
+  private:
 
     /**
-     * Handle get article.
+     * Request parser state.
      */
-    void handleGetArticle(void);
+    typedef enum {
+      PARSE_COMMAND,            //!< Waiting for a command byte
+      PARSE_PARAMETER,          //!< Waiting for a parameter type byte
+      PARSE_NUMBER,             //!< Reading the bytes of a number
+      PARSE_STRING_LENGTH,      //!< Reading the bytes of a string length
+      PARSE_STRING,             //!< Reading the bytes of a string
+      PARSE_END                 //!< Waiting for the end byte
+    }
+    ParseState_t;
 
     /**
-     * Send status message.
+     * Start parsing a request.
+     *
+     * @param command the command byte
+     * @return false if the command is unknown
      */
-    void sendStatus(Status_t);
+    bool beginRequest(uint8_t command);
 
     /**
-     * Called on data receival.
+     * Continue with the next parameter, or wait for the end byte if
+     * all parameters have been read.
+     */
+    void nextParameter(void);
+
+    /**
+     * Take a number of a list parameter, the first being the number
+     * of identifiers that follow.
      *
-     * @param data the data received
+     * @param n the number
      */
-    void onDataReceived(uint8_t data);
+    void listNumber(size_t n);
+
+    /**
+     * Dispatch a completely parsed request to its callback.
+     */
+    void dispatchRequest(void);
+
+    /**
+     * Report a protocol error and close the connection.
+     *
+     * @param message the error message
+     * @param data the offending byte
+     */
+    void protocolError(const char* message, uint8_t data);
+
+    /**
+     * Reply with nothing but a status.
+     *
+     * @param answer the answer command
+     * @param status the status
+     */
+    void replyStatus(MessageIdentifier_t answer, Status_t status);
+
+    /**
+     * Parser state.
+     */
+    ParseState_t parseState;
+
+    /**
+     * Command of the request being parsed.
+     */
+    uint8_t command;
+
+    /**
+     * Parameter types of the request being parsed, one character
+     * per parameter: 'n' for numbers, 's' for strings and 'l' for a
+     * count followed by that many numbers.
+     */
+    const char* signature;
+
+    /**
+     * Index in the signature of the parameter being read.
+     */
+    size_t parameter;
+
+    /**
+     * Bytes of the number or string length being read.
+     */
+    uint8_t number[4];
+
+    /**
+     * Number of bytes read so far of the number, string length or
+     * string being read.
+     */
+    size_t bytesRead;
+
+    /**
+     * Length of the string being read.
+     */
+    size_t stringLength;
+
+    /**
+     * Number parameters read so far.
+     */
+    std::vector<int> numbers;
+
+    /**
+     * String parameters read so far.
+     */
+    std::vector<std::string> strings;
+
+    /**
+     * Numbers of the list parameter read so far.
+     */
+    IdentifierList_t list;
+
+    /**
+     * Set once the count of the list parameter has been read.
+     */
+    bool listCounted;
+
+    /**
+     * Numbers of the list parameter still to be read.
+     */
+    size_t listRemaining;
   };
 
 }
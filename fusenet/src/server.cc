@@ -7,93 +7,661 @@
 #include <cassert>
 #include <string>
 
+#include "log.h"
 #include "server.h"
 
 #define PREFIX "[Server] [" << transport->getName() << "] "
 
+/**
+ * Largest number of requests handed to the worker pool at once.
+ */
+#define BATCH_SIZE 64
+
+/**
+ * Largest number of articles listed on one page, also used when a
+ * client asks for no particular number.
+ */
+#define LIST_PAGE_SIZE 1000
+
 namespace fusenet {
 
-  Server::Server(Transport* transport, Database* database) : ServerProtocol(transport) {
+  /**
+   * Check if a command changes the database.
+   */
+  static bool IsChange(MessageIdentifier_t command) {
+    return command == COM_CREATE_NG || command == COM_DELETE_NG ||
+      command == COM_CREATE_ART || command == COM_DELETE_ART;
+  }
+
+  /**
+   * Executes a batch of requests on a worker thread, and lets the
+   * server reply once it is back on the reactor thread. The job owns
+   * the requests.
+   */
+  class Server::RequestJob : public Job {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    RequestJob(Server* server) : Job(server->transport) {
+      this->server = server;
+      this->database = server->database;
+      this->cache = server->cache;
+      this->timed = server->timed;
+    }
+
+    /**
+     * Execute the requests, in order.
+     */
+    void execute(void) {
+      RequestList_t::iterator i;
+      uint64_t now = timed ? Statistics::now() : 0;
+
+      for (i = batch.begin(); i != batch.end(); i++) {
+	now = Server::execute(database, cache, **i, now);
+      }
+    }
+
+    /**
+     * Reply to the requests.
+     */
+    void complete(void) {
+      server->onRequestsCompleted(batch);
+    }
+
+    /**
+     * Destroy instance.
+     */
+    ~RequestJob(void) {
+      RequestList_t::iterator i;
+
+      for (i = batch.begin(); i != batch.end(); i++) {
+	Server::deleteRequest(*i);
+      }
+    }
+
+    /**
+     * The requests.
+     */
+    RequestList_t batch;
+
+  private:
+
+    /**
+     * The server, only used on the reactor thread.
+     */
+    Server* server;
+
+    /**
+     * The database, used on the worker thread.
+     */
+    Database* database;
+
+    /**
+     * The newsgroup list cache, used on the worker thread.
+     */
+    NewsgroupListCache* cache;
+
+    /**
+     * True if the requests are timed.
+     */
+    bool timed;
+  };
+
+  Server::Server(Transport* transport, Database* database,
+		 NewsgroupListCache* cache, SubscriberRegistry* registry,
+		 Statistics* statistics) : ServerProtocol(transport) {
     this->database = database;
+    this->cache = cache;
+    this->registry = registry;
+    this->statistics = statistics;
+    this->timed = statistics != NULL;
+    this->workerPool = NULL;
+    this->reactor = NULL;
+    activeJob = NULL;
+    paused = false;
+    subscription = NULL;
   }
 
-  void Server::onListNewsgroups(void) {
+  Server::Server(Transport* transport, Database* database, NewsgroupListCache* cache,
+		 SubscriberRegistry* registry, Statistics* statistics,
+		 WorkerPool* workerPool, NetworkReactor* reactor) : ServerProtocol(transport) {
+    this->database = database;
+    this->cache = cache;
+    this->registry = registry;
+    this->statistics = statistics;
+    this->timed = statistics != NULL;
+    this->workerPool = workerPool;
+    this->reactor = reactor;
+    activeJob = NULL;
+    paused = false;
+    subscription = NULL;
+  }
+
+  Server::Request_t* Server::createRequest(MessageIdentifier_t command) {
+    Request_t* request = new Request_t;
+
+    request->command = command;
+    request->newsgroupIdentifier = 0;
+    request->articleIdentifier = 0;
+    request->cursor = CURSOR_NONE;
+    request->direction = LIST_FORWARD;
+    request->maxCount = 0;
+    request->nextCursor = CURSOR_NONE;
+    request->version = VERSION_NONE;
+    request->status = STATUS_FAILURE;
+    request->newsgroupList = NULL;
+
+    // Called while the request is dispatched, when the parser knows
+    // what it took
+    request->sample.failed = false;
+    request->sample.bytesIn = requestSize;
+    request->sample.bytesOut = 0;
+    request->sample.time[PHASE_PARSE] = parseTime;
+    request->sample.time[PHASE_DATABASE] = 0;
+    request->sample.time[PHASE_REPLY] = 0;
+    return request;
+  }
+
+  void Server::deleteRequest(Request_t* request) {
+    if (request->newsgroupList != NULL) {
+      request->newsgroupList->release();
+    }
+
+    delete request;
+  }
+
+  void Server::submit(Request_t* request) {
+    if (workerPool == NULL) {
+      // Each phase starts when the one before ends, which saves
+      // reading the clock, and parsing resumes after the reply
+      parseStart = reply(*request, execute(database, cache, *request, parseStart));
+      deleteRequest(request);
+      return;
+    }
+
+    // Handed over by onDataReceived(), along with the requests that
+    // arrived with it
+    requests.push_back(request);
+  }
+
+  void Server::dispatchNext(void) {
+    if (requests.empty() || paused || transport->isClosed()) {
+      return;
+    }
+
+    activeJob = new RequestJob(this);
+
+    while (!requests.empty() && activeJob->batch.size() < BATCH_SIZE) {
+      activeJob->batch.push_back(requests.front());
+      requests.pop_front();
+    }
+
+    workerPool->submit(activeJob, reactor);
+  }
+
+  void Server::onRequestsCompleted(RequestList_t& batch) {
+    RequestList_t::iterator i;
+    uint64_t now = timed ? Statistics::now() : 0;
+
+    // The requests are deleted along with the job
+    activeJob = NULL;
+
+    for (i = batch.begin(); i != batch.end(); i++) {
+      now = reply(**i, now);
+    }
+
+    dispatchNext();
+  }
+
+  void Server::onDataReceived(const uint8_t* data, size_t length) {
+    ServerProtocol::onDataReceived(data, length);
+
+    if (activeJob == NULL) {
+      dispatchNext();
+    }
+  }
+
+  uint64_t Server::execute(Database* database, NewsgroupListCache* cache,
+			   Request_t& request, uint64_t start) {
     NewsgroupList_t newsgroupList;
-    
-    std::cout << PREFIX << "Getting list of newsgroups" << std::endl;
-    database->getNewsgroupList(newsgroupList);
+    unsigned long generation;
+    uint64_t end;
+
+    switch (request.command) {
+    case COM_LIST_NG:
+      request.newsgroupList = cache->find(generation);
+
+      if (request.newsgroupList != NULL) {
+	request.status = STATUS_SUCCESS;
+	break;
+      }
+
+      request.status = database->getNewsgroupList(newsgroupList);
+      request.newsgroupList = new EncodedMessage();
+      encodeListNewsgroups(newsgroupList, request.newsgroupList->bytes);
+
+      if (IS_SUCCESS(request.status)) {
+	cache->store(generation, request.newsgroupList);
+      }
+      break;
+    case COM_CREATE_NG:
+      request.status = database->createNewsgroup(request.newsgroupName);
+      cache->invalidate();
+      break;
+    case COM_DELETE_NG:
+      request.status = database->deleteNewsgroup(request.newsgroupIdentifier);
+      cache->invalidate();
+      break;
+    case COM_LIST_ART:
+      request.status = database->listArticleHeaders(request.newsgroupIdentifier,
+						    request.headerList);
+      break;
+    case COM_LIST_ART_PAGE:
+      request.status = database->listArticlePage(request.newsgroupIdentifier,
+						 request.cursor,
+						 request.direction,
+						 request.maxCount,
+						 request.headerList,
+						 request.nextCursor);
+      break;
+    case COM_CREATE_ART:
+      request.status = database->createArticle(request.newsgroupIdentifier,
+					       request.article);
+      break;
+    case COM_DELETE_ART:
+      request.status = database->deleteArticle(request.newsgroupIdentifier,
+					       request.articleIdentifier);
+      break;
+    case COM_GET_ART:
+      request.status = database->getArticleRef(request.newsgroupIdentifier,
+					       request.articleIdentifier,
+					       request.articleRef);
+      break;
+    case COM_GET_ARTS:
+      request.status = database->getArticleRefs(request.newsgroupIdentifier,
+						request.articleIdentifiers,
+						request.articleRefs,
+						request.statuses);
+      break;
+    case COM_LIST_NG_IF:
+      {
+	// The version is read first, so a change made while the list
+	// is read at worst makes the client ask again
+	Version_t known = request.version;
+
+	request.status = database->getNewsgroupListVersion(request.version);
+
+	if (IS_SUCCESS(request.status)) {
+	  if (known != VERSION_NONE && known == request.version) {
+	    request.status = STATUS_NOT_MODIFIED;
+	  } else {
+	    request.status = database->getNewsgroupList(request.newsgroups);
+	  }
+	}
+      }
+      break;
+    case COM_LIST_ART_IF:
+      {
+	Version_t known = request.version;
+
+	request.status = database->getNewsgroupVersion(request.newsgroupIdentifier,
+							request.version);
+
+	if (IS_SUCCESS(request.status)) {
+	  if (known != VERSION_NONE && known == request.version) {
+	    request.status = STATUS_NOT_MODIFIED;
+	  } else {
+	    request.status = database->listArticleHeaders(request.newsgroupIdentifier,
+							  request.headerList);
+	  }
+	}
+      }
+      break;
+    case COM_SUBSCRIBE:
+      request.status = database->checkNewsgroup(request.newsgroupIdentifier);
+      break;
+    case COM_UNSUBSCRIBE:
+    case COM_STATS:
+      request.status = STATUS_SUCCESS;
+      break;
+    default:
+      assert(false);
+    }
 
-    std::cout << PREFIX << "Replying to list newsgroups" << std::endl;
-    replyListNewsgroups(newsgroupList);
+    // A change is only acknowledged once it is durable
+    if (IsChange(request.command) && IS_SUCCESS(request.status)) {
+      request.status = database->commit();
+    }
+
+    if (start == 0) {
+      return 0;
+    }
+
+    end = Statistics::now();
+    request.sample.time[PHASE_DATABASE] = end - start;
+    return end;
+  }
+
+  uint64_t Server::reply(Request_t& request, uint64_t start) {
+    size_t queued = transport->queued();
+    uint64_t end;
+
+    switch (request.command) {
+    case COM_LIST_NG:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to list newsgroups (cache hits "
+			  << cache->getHits() << ", misses " << cache->getMisses()
+			  << ")";
+      replyEncoded(request.newsgroupList->bytes);
+      break;
+    case COM_CREATE_NG:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to create newsgroup '" 
+			  << request.newsgroupName << "'";
+      replyCreateNewsgroup(request.status);
+      break;
+    case COM_DELETE_NG:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to delete newsgroup " 
+			  << request.newsgroupIdentifier;
+      replyDeleteNewsgroup(request.status);
+      break;
+    case COM_LIST_ART:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to list articles";
+      replyListArticles(request.status, request.headerList);
+      break;
+    case COM_LIST_ART_PAGE:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to list a page of " << request.headerList.size()
+			  << " articles";
+      replyListArticlePage(request.status, request.headerList, request.nextCursor);
+      break;
+    case COM_CREATE_ART:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to create article";
+      replyCreateArticle(request.status);
+      break;
+    case COM_DELETE_ART:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to delete article";
+      replyDeleteArticle(request.status);
+      break;
+    case COM_GET_ART:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to get article";
+      replyGetArticle(request.status, request.articleRef);
+      break;
+    case COM_GET_ARTS:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to get " << request.articleIdentifiers.size()
+			  << " articles";
+      replyGetArticles(request.status, request.articleIdentifiers,
+		       request.articleRefs, request.statuses);
+      break;
+    case COM_LIST_NG_IF:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to list newsgroups if modified";
+      replyListNewsgroupsIfModified(request.status, request.version, request.newsgroups);
+      break;
+    case COM_LIST_ART_IF:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to list articles if modified";
+      replyListArticlesIfModified(request.status, request.version, request.headerList);
+      break;
+    case COM_SUBSCRIBE:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to subscribe to newsgroup "
+			  << request.newsgroupIdentifier;
+
+      // Notifications are delivered through the reactor
+      if (IS_SUCCESS(request.status) && reactor == NULL) {
+	LOG(LOG_LEVEL_WARNING) << PREFIX << "Refusing to subscribe to newsgroup "
+			       << request.newsgroupIdentifier
+			       << ", notifications need a reactor";
+	request.status = STATUS_FAILURE;
+      }
+
+      if (IS_SUCCESS(request.status)) {
+	if (subscription == NULL) {
+	  subscription = new Subscription(this, transport, reactor);
+	}
+
+	subscribedNewsgroups.insert(request.newsgroupIdentifier);
+	registry->subscribe(request.newsgroupIdentifier, subscription);
+      }
+
+      replySubscribe(request.status);
+      break;
+    case COM_UNSUBSCRIBE:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to unsubscribe from newsgroup "
+			  << request.newsgroupIdentifier;
+
+      if (subscribedNewsgroups.erase(request.newsgroupIdentifier) > 0) {
+	registry->unsubscribe(request.newsgroupIdentifier, subscription);
+      }
+
+      replyUnsubscribe(request.status);
+      break;
+    case COM_STATS:
+      LOG(LOG_LEVEL_DEBUG) << PREFIX << "Replying to statistics";
+      replyStatistics(statistics != NULL ? statistics->report() :
+		      "Statistics are not collected, start the server with --stats\n");
+      break;
+    default:
+      assert(false);
+    }
+
+    if (IsChange(request.command) && IS_SUCCESS(request.status)) {
+      publish(request);
+    }
+
+    if (statistics == NULL) {
+      return 0;
+    }
+
+    request.sample.failed = !IS_SUCCESS(request.status) &&
+      request.status != STATUS_NOT_MODIFIED;
+    request.sample.bytesOut = transport->queued() - queued;
+    end = Statistics::now();
+    request.sample.time[PHASE_REPLY] = end - start;
+    statistics->record(request.command, request.sample);
+    return end;
+  }
+
+  void Server::publish(Request_t& request) {
+    Notification_t notification;
+
+    notification.newsgroupIdentifier = request.newsgroupIdentifier;
+
+    switch (request.command) {
+    case COM_CREATE_ART:
+      notification.type = ANS_NEW_ART;
+      notification.articleIdentifier = request.article.id;
+      notification.title = request.article.title;
+      registry->publish(notification);
+      break;
+    case COM_DELETE_ART:
+      notification.type = ANS_ART_DELETED;
+      notification.articleIdentifier = request.articleIdentifier;
+      registry->publish(notification);
+      break;
+    case COM_DELETE_NG:
+      registry->dropNewsgroup(request.newsgroupIdentifier);
+      break;
+    default:
+      break;
+    }
+  }
+
+  void Server::onListNewsgroups(void) {
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting list of newsgroups";
+    submit(createRequest(COM_LIST_NG));
   }
 
   void Server::onCreateNewsgroup(std::string& newsgroupName) {
-    std::cout << PREFIX << "Replying to create newsgroup '" 
-	      << newsgroupName << "'" << std::endl;
-    replyCreateNewsgroup(database->createNewsgroup(newsgroupName));
+    Request_t* request = createRequest(COM_CREATE_NG);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Creating newsgroup '" 
+			<< newsgroupName << "'";
+    request->newsgroupName = newsgroupName;
+    submit(request);
   }
 
   void Server::onDeleteNewsgroup(int newsgroupIdentifier) {
-    std::cout << PREFIX << "Replying to delete newsgroup " 
-	      << newsgroupIdentifier << std::endl;
-    replyDeleteNewsgroup(database->deleteNewsgroup(newsgroupIdentifier));
+    Request_t* request = createRequest(COM_DELETE_NG);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Deleting newsgroup " 
+			<< newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    submit(request);
   }
 
   void Server::onListArticles(int newsgroupIdentifier) {
-    ArticleList_t articleList;
-    Status_t status;
+    Request_t* request = createRequest(COM_LIST_ART);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting list of list articles";
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    submit(request);
+  }
 
-    std::cout << PREFIX << "Getting list of list articles" << std::endl;
-    status = database->listArticles(newsgroupIdentifier, articleList);
+  void Server::onListArticlePage(int newsgroupIdentifier,
+				 int cursor,
+				 int direction,
+				 int maxCount) {
+    Request_t* request = createRequest(COM_LIST_ART_PAGE);
 
-    std::cout << PREFIX << "Replying to list articles" << std::endl;
-    replyListArticles(status, articleList);
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting a page of articles after " << cursor
+			<< " in newsgroup " << newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->cursor = cursor;
+    request->direction = direction == LIST_BACKWARD ? LIST_BACKWARD : LIST_FORWARD;
+    request->maxCount = maxCount > 0 && maxCount < LIST_PAGE_SIZE ? maxCount : LIST_PAGE_SIZE;
+    submit(request);
   }
 
   void Server::onCreateArticle(int newsgroupIdentifier,
 			       Article_t& article) {
-    Status_t status;
+    Request_t* request = createRequest(COM_CREATE_ART);
 
-    std::cout << PREFIX << "Creating article " << article.id 
-	      << " in newsgroup " << newsgroupIdentifier << std::endl;
-    status = database->createArticle(newsgroupIdentifier, article);
-
-    std::cout << PREFIX << "Replying to create article" << std::endl;
-    replyCreateArticle(status);
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Creating article " << article.id 
+			<< " in newsgroup " << newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->article = article;
+    submit(request);
   }
   
   void Server::onDeleteArticle(int newsgroupIdentifier,
 			       int articleIdentifier) {
-    Status_t status;
-
-    std::cout << PREFIX << "Deleting article " << articleIdentifier
-	      << " in newsgroup " << newsgroupIdentifier << std::endl;
-    status = database->deleteArticle(newsgroupIdentifier, articleIdentifier);
+    Request_t* request = createRequest(COM_DELETE_ART);
 
-    std::cout << PREFIX << "Replying to delete article" << std::endl;
-    replyDeleteArticle(status);
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Deleting article " << articleIdentifier
+			<< " in newsgroup " << newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->articleIdentifier = articleIdentifier;
+    submit(request);
   }
 
   void Server::onGetArticle(int newsgroupIdentifier,
 			    int articleIdentifier) {
-    Article_t article;
-    Status_t status;
+    Request_t* request = createRequest(COM_GET_ART);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting article " << articleIdentifier
+			<< " in newsgroup " << newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->articleIdentifier = articleIdentifier;
+    submit(request);
+  }
+
+  void Server::onGetArticles(int newsgroupIdentifier,
+			     IdentifierList_t& articleIdentifiers) {
+    Request_t* request = createRequest(COM_GET_ARTS);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting " << articleIdentifiers.size()
+			<< " articles in newsgroup " << newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->articleIdentifiers.swap(articleIdentifiers);
+    submit(request);
+  }
+
+  void Server::onListNewsgroupsIfModified(Version_t version) {
+    Request_t* request = createRequest(COM_LIST_NG_IF);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting list of newsgroups if not version "
+			<< version;
+    request->version = version;
+    submit(request);
+  }
+
+  void Server::onListArticlesIfModified(int newsgroupIdentifier,
+					Version_t version) {
+    Request_t* request = createRequest(COM_LIST_ART_IF);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting list of articles in newsgroup "
+			<< newsgroupIdentifier << " if not version " << version;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    request->version = version;
+    submit(request);
+  }
+
+  void Server::onSubscribe(int newsgroupIdentifier) {
+    Request_t* request = createRequest(COM_SUBSCRIBE);
+
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Subscribing to newsgroup "
+			<< newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    submit(request);
+  }
+
+  void Server::onUnsubscribe(int newsgroupIdentifier) {
+    Request_t* request = createRequest(COM_UNSUBSCRIBE);
 
-    std::cout << PREFIX << "Getting article " << articleIdentifier
-	      << " in newsgroup " << newsgroupIdentifier << std::endl;
-    status = database->getArticle(newsgroupIdentifier, articleIdentifier, article);
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Unsubscribing from newsgroup "
+			<< newsgroupIdentifier;
+    request->newsgroupIdentifier = newsgroupIdentifier;
+    submit(request);
+  }
 
-    std::cout << PREFIX << "Replying to get article" << std::endl;
-    replyGetArticle(status, article);
+  void Server::onStatistics(void) {
+    LOG(LOG_LEVEL_DEBUG) << PREFIX << "Getting statistics";
+    submit(createRequest(COM_STATS));
   }
 
   void Server::onConnectionMade(void) {
-    std::cout << PREFIX << "Connection established" << std::endl;
+    LOG(LOG_LEVEL_INFO) << PREFIX << "Connection established";
   }
 
   void Server::onConnectionLost(void) {
-    std::cout << PREFIX << "Connection lost" << std::endl;
+    LOG(LOG_LEVEL_INFO) << PREFIX << "Connection lost";
   }
 
-}
+  void Server::onPaused(void) {
+    paused = true;
+  }
+
+  void Server::onResumed(void) {
+    paused = false;
+
+    if (activeJob == NULL) {
+      dispatchNext();
+    }
+  }
+
+  Server::~Server(void) {
+    std::deque<Request_t*>::iterator i;
 
+    // Requests that are being executed belong to their job, which is
+    // deleted by the reactor once the worker is done with it
+    if (activeJob != NULL) {
+      activeJob->cancel();
+    }
+
+    for (i = requests.begin(); i != requests.end(); i++) {
+      deleteRequest(*i);
+    }
+
+    // Notifications still on their way to the reactor are dropped
+    if (subscription != NULL) {
+      std::set<int>::iterator j;
+
+      for (j = subscribedNewsgroups.begin(); j != subscribedNewsgroups.end(); j++) {
+	registry->unsubscribe(*j, subscription);
+      }
+
+      subscription->close();
+      subscription->release();
+    }
+  }
+
+}
@@ -7,28 +7,70 @@
  * This file contains the server interface.
  */
 
+#include <deque>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "server-protocol.h"
 #include "database.h"
+#include "network-reactor.h"
+#include "newsgroup-list-cache.h"
+#include "statistics.h"
+#include "subscriber-registry.h"
+#include "worker-pool.h"
 
 namespace fusenet {
 
   /**
-   * Server class.
+   * Server class. Decoded requests are either executed directly, or
+   * handed to a worker pool when one is given. With a worker pool,
+   * the requests that arrive together on one connection are handed
+   * over as one batch, and batches from one connection are executed
+   * one at a time and in order, so replies come back in the order
+   * the requests were made.
+   *
+   * Connections may subscribe to newsgroups. Once a new article or a
+   * deletion has been acknowledged to its poster, the subscribers are
+   * told about it through the subscriber registry. Subscriptions need
+   * a reactor to deliver the notifications on.
    */
   class Server : public ServerProtocol {
 
   public:
 
     /**
-     * Creates a server instance.
+     * Creates a server instance. Without a reactor, notifications can
+     * not be delivered, so subscriptions are refused.
      *
      * @param transport the transport
      * @param database the database
+     * @param cache the newsgroup list cache shared by all servers
+     * @param registry the subscriber registry shared by all servers
+     * @param statistics the request statistics shared by all servers,
+     *        or NULL to neither time nor count requests
      */
-    Server(Transport* transport, Database* database);
+    Server(Transport* transport, Database* database,
+	   NewsgroupListCache* cache, SubscriberRegistry* registry,
+	   Statistics* statistics);
+
+    /**
+     * Creates a server instance that executes requests on a worker
+     * pool.
+     *
+     * @param transport the transport
+     * @param database the database
+     * @param cache the newsgroup list cache shared by all servers
+     * @param registry the subscriber registry shared by all servers
+     * @param statistics the request statistics shared by all servers,
+     *        or NULL to neither time nor count requests
+     * @param workerPool the worker pool, or NULL to execute requests
+     *        directly
+     * @param reactor the reactor owning the connection
+     */
+    Server(Transport* transport, Database* database, NewsgroupListCache* cache,
+	   SubscriberRegistry* registry, Statistics* statistics,
+	   WorkerPool* workerPool, NetworkReactor* reactor);
 
     /**
      * List newsgroups callback.
@@ -56,6 +98,21 @@ namespace fusenet {
      */
     void onListArticles(int newsgroupIdentifier);
 
+    /**
+     * List a page of articles.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param cursor the identifier to list after, or CURSOR_NONE
+     * @param direction LIST_FORWARD or LIST_BACKWARD, anything else
+     *        counts as LIST_FORWARD
+     * @param maxCount the largest number of articles asked for, capped
+     *        by the server
+     */
+    void onListArticlePage(int newsgroupIdentifier,
+			   int cursor,
+			   int direction,
+			   int maxCount);
+
     /**
      * Create article.
      *
@@ -83,8 +140,156 @@ namespace fusenet {
     void onGetArticle(int newsgroupIdentifier,
 		      int articleIdentifier);
 
+    /**
+     * Get several articles.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param articleIdentifiers the article identifiers
+     */
+    void onGetArticles(int newsgroupIdentifier,
+		       IdentifierList_t& articleIdentifiers);
+
+    /**
+     * List newsgroups if modified.
+     *
+     * @param version the version the client has
+     */
+    void onListNewsgroupsIfModified(Version_t version);
+
+    /**
+     * List articles if modified.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param version the version the client has
+     */
+    void onListArticlesIfModified(int newsgroupIdentifier,
+				  Version_t version);
+
+    /**
+     * Subscribe to a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    void onSubscribe(int newsgroupIdentifier);
+
+    /**
+     * Unsubscribe from a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    void onUnsubscribe(int newsgroupIdentifier);
+
+    /**
+     * Get the request statistics.
+     */
+    void onStatistics(void);
+
+    /**
+     * Destroys a server instance.
+     */
+    ~Server(void);
+
   private:
 
+    /**
+     * Decoded request, and its result once executed.
+     */
+    typedef struct {
+      MessageIdentifier_t command;         //!< Request command
+      int newsgroupIdentifier;             //!< Newsgroup parameter
+      int articleIdentifier;               //!< Article parameter
+      std::string newsgroupName;           //!< Newsgroup name parameter
+      Article_t article;                   //!< Article parameter
+      ArticleRef articleRef;               //!< Result article
+      Status_t status;                     //!< Result status
+      EncodedMessage* newsgroupList;       //!< Result newsgroups, encoded
+      ArticleHeaderList_t headerList;      //!< Result article headers
+      IdentifierList_t articleIdentifiers; //!< Articles parameter
+      ArticleRefList_t articleRefs;        //!< Result articles
+      StatusList_t statuses;               //!< Result article statuses
+      int cursor;                          //!< Page cursor parameter
+      ListDirection_t direction;           //!< Page direction parameter
+      size_t maxCount;                     //!< Page size parameter
+      int nextCursor;                      //!< Result next page cursor
+      Version_t version;                   //!< Known version parameter, then result
+      NewsgroupList_t newsgroups;          //!< Result newsgroups
+      RequestSample_t sample;              //!< What the request took
+    } Request_t;
+
+    /**
+     * Job executing a batch of requests on a worker thread.
+     */
+    class RequestJob;
+
+    /**
+     * Batch of requests, oldest first.
+     */
+    typedef std::vector<Request_t*> RequestList_t;
+
+    /**
+     * Create a request.
+     */
+    Request_t* createRequest(MessageIdentifier_t command);
+
+    /**
+     * Delete a request and whatever it holds on to.
+     */
+    static void deleteRequest(Request_t* request);
+
+    /**
+     * Execute a request now, or queue it for the worker pool.
+     */
+    void submit(Request_t* request);
+
+    /**
+     * Hand the oldest queued requests to the worker pool, as one
+     * batch.
+     */
+    void dispatchNext(void);
+
+    /**
+     * Called when the batch handed to the worker pool is done.
+     *
+     * @param batch the requests, to reply to in order
+     */
+    void onRequestsCompleted(RequestList_t& batch);
+
+    /**
+     * Decode all requests in a block of received data, and hand
+     * those queued for the worker pool over once the whole block is
+     * decoded.
+     *
+     * @param data the data received
+     * @param length the number of bytes received
+     */
+    void onDataReceived(const uint8_t* data, size_t length);
+
+    /**
+     * Execute a request against a database. This may run on a worker
+     * thread, so it does not touch the server.
+     *
+     * @param start when execution started, or 0 if the request is not
+     *        timed
+     * @return when execution ended, or 0 if the request is not timed
+     */
+    static uint64_t execute(Database* database, NewsgroupListCache* cache,
+			    Request_t& request, uint64_t start);
+
+    /**
+     * Send the reply to an executed request.
+     *
+     * @param start when replying started, or 0 if the request is not
+     *        timed
+     * @return when replying ended, or 0 if the request is not timed
+     */
+    uint64_t reply(Request_t& request, uint64_t start);
+
+    /**
+     * Tell the subscribers of a newsgroup about an acknowledged
+     * change.
+     */
+    void publish(Request_t& request);
+
     /**
      * Called on made connection.
      */
@@ -95,10 +300,73 @@ namespace fusenet {
      */
     void onConnectionLost(void);
 
+    /**
+     * Called when the reactor pauses the connection.
+     */
+    void onPaused(void);
+
+    /**
+     * Called when the reactor resumes the connection.
+     */
+    void onResumed(void);
+
     /**
      * Database to use.
      */
     Database* database;
+
+    /**
+     * Newsgroup list cache.
+     */
+    NewsgroupListCache* cache;
+
+    /**
+     * Subscriber registry.
+     */
+    SubscriberRegistry* registry;
+
+    /**
+     * Request statistics, or NULL if not collected.
+     */
+    Statistics* statistics;
+
+    /**
+     * Worker pool, or NULL to execute requests directly.
+     */
+    WorkerPool* workerPool;
+
+    /**
+     * Reactor owning the connection.
+     */
+    NetworkReactor* reactor;
+
+    /**
+     * Requests waiting to be handed to the worker pool, oldest first.
+     */
+    std::deque<Request_t*> requests;
+
+    /**
+     * The job executing the batch before them, or NULL.
+     */
+    RequestJob* activeJob;
+
+    /**
+     * Set while the reactor has paused the connection. No new
+     * requests are handed to the worker pool meanwhile, since their
+     * replies would only add to the send queue.
+     */
+    bool paused;
+
+    /**
+     * Subscriptions of the connection, created on the first
+     * subscribe, or NULL.
+     */
+    Subscription* subscription;
+
+    /**
+     * Newsgroups the connection is subscribed to.
+     */
+    std::set<int> subscribedNewsgroups;
   };
 
 }
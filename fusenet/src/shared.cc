@@ -0,0 +1,28 @@
+/**
+ * @file
+ *
+ * This file contains the shared object implementation.
+ */
+
+#include "shared.h"
+
+namespace fusenet {
+
+  Shared::Shared(void) {
+    references = 1;
+  }
+
+  void Shared::acquire(void) {
+    __sync_add_and_fetch(&references, 1);
+  }
+
+  void Shared::release(void) {
+    if (__sync_sub_and_fetch(&references, 1) == 0) {
+      delete this;
+    }
+  }
+
+  Shared::~Shared(void) {
+    // Does nothing
+  }
+}
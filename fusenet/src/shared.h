@@ -0,0 +1,65 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+/**
+ * @file
+ *
+ * This file contains the shared object interface.
+ */
+
+namespace fusenet {
+
+  /**
+   * Base class for reference counted objects. An object starts out
+   * with one reference, held by whoever created it, and deletes
+   * itself when the last reference is released. The count is updated
+   * atomically, so references may be taken and released on different
+   * threads.
+   */
+  class Shared {
+
+  public:
+
+    /**
+     * Create instance, with one reference.
+     */
+    Shared(void);
+
+    /**
+     * Take another reference.
+     */
+    void acquire(void);
+
+    /**
+     * Release a reference, and delete the object if it was the last
+     * one.
+     */
+    void release(void);
+
+  protected:
+
+    /**
+     * Destroy instance. Only called by release().
+     */
+    virtual ~Shared(void);
+
+  private:
+
+    /**
+     * Not copyable.
+     */
+    Shared(const Shared&);
+
+    /**
+     * Not assignable.
+     */
+    Shared& operator=(const Shared&);
+
+    /**
+     * Number of references.
+     */
+    volatile int references;
+  };
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef SLOT_TABLE_H
+#define SLOT_TABLE_H
+
+/**
+ * @file
+ *
+ * This file contains the slot table template.
+ */
+
+#include <cstddef>
+#include <vector>
+#include <tr1/unordered_map>
+
+namespace fusenet {
+
+  /**
+   * Slot table. Holds pointers to a set of objects and gives each
+   * one a unique identifier, which is never reused. The table does
+   * not own the objects. The pointers are kept in a dense array in
+   * identifier order, and a hash map translates an identifier to its
+   * position in the array.
+   *
+   * Erasing an object leaves a hole in the array. When the holes
+   * outnumber the live objects the array is compacted, so walking
+   * the table and the memory it uses are proportional to the number
+   * of live objects, not to the number of identifiers ever handed
+   * out.
+   */
+  template <typename T>
+  class SlotTable {
+
+  public:
+
+    /**
+     * Create an empty table.
+     */
+    SlotTable(void) : nextIdentifier(0), holes(0) {
+      // Does nothing
+    }
+
+    /**
+     * Insert an object.
+     *
+     * @param value the object
+     * @return the identifier of the object
+     */
+    int insert(T* value) {
+      Entry_t entry;
+
+      entry.id = nextIdentifier++;
+      entry.value = value;
+      positions[entry.id] = entries.size();
+      entries.push_back(entry);
+      return entry.id;
+    }
+
+    /**
+     * Insert an object under a given identifier, when restoring a
+     * saved table. Objects must be restored in identifier order.
+     *
+     * @param id the identifier
+     * @param value the object
+     */
+    void restore(int id, T* value) {
+      Entry_t entry;
+
+      entry.id = id;
+      entry.value = value;
+      positions[id] = entries.size();
+      entries.push_back(entry);
+
+      if (id >= nextIdentifier) {
+	nextIdentifier = id + 1;
+      }
+    }
+
+    /**
+     * Get the identifier the next inserted object will get.
+     */
+    int next(void) const {
+      return nextIdentifier;
+    }
+
+    /**
+     * Never hand out identifiers below a given one, when restoring a
+     * saved table.
+     *
+     * @param id the lowest identifier to hand out
+     */
+    void skip(int id) {
+      if (id > nextIdentifier) {
+	nextIdentifier = id;
+      }
+    }
+
+    /**
+     * Look up an object.
+     *
+     * @param id the identifier
+     * @return the object, or NULL if there is no such object
+     */
+    T* find(int id) const {
+      typename PositionMap_t::const_iterator i = positions.find(id);
+
+      if (i == positions.end()) {
+	return NULL;
+      }
+
+      return entries[i->second].value;
+    }
+
+    /**
+     * Remove an object.
+     *
+     * @param id the identifier
+     * @return the object, or NULL if there is no such object
+     */
+    T* erase(int id) {
+      typename PositionMap_t::iterator i = positions.find(id);
+      T* value;
+
+      if (i == positions.end()) {
+	return NULL;
+      }
+
+      value = entries[i->second].value;
+      entries[i->second].value = NULL;
+      positions.erase(i);
+      holes++;
+
+      if (holes > positions.size()) {
+	compact();
+      }
+
+      return value;
+    }
+
+    /**
+     * Number of slots, holes included. Use with at() to walk the
+     * table in identifier order.
+     */
+    size_t slots(void) const {
+      return entries.size();
+    }
+
+    /**
+     * Find where an identifier would go, by binary search. Holes keep
+     * their identifiers, so the slots stay in identifier order.
+     *
+     * @param id the identifier
+     * @return the number of slots with an identifier of at most id,
+     *         which is also the first slot with a larger identifier
+     */
+    size_t upperBound(int id) const {
+      size_t low = 0;
+      size_t high = entries.size();
+
+      while (low < high) {
+	size_t middle = low + (high - low) / 2;
+
+	if (entries[middle].id <= id) {
+	  low = middle + 1;
+	} else {
+	  high = middle;
+	}
+      }
+
+      return low;
+    }
+
+    /**
+     * Get the object in a slot.
+     *
+     * @param slot the slot, less than slots()
+     * @return the object, or NULL if the slot is a hole
+     */
+    T* at(size_t slot) const {
+      return entries[slot].value;
+    }
+
+    /**
+     * Replace the object in a slot that is not a hole, keeping its
+     * identifier. Used when an object is moved in memory.
+     *
+     * @param slot the slot, less than slots()
+     * @param value the object
+     */
+    void replace(size_t slot, T* value) {
+      entries[slot].value = value;
+    }
+
+    /**
+     * Number of live objects.
+     */
+    size_t size(void) const {
+      return positions.size();
+    }
+
+    /**
+     * Number of objects inserted plus the number erased, counting
+     * identifiers skipped when restoring as both. Since identifiers
+     * are never reused this grows with every change, and it is kept
+     * by saving next() along with the objects.
+     */
+    unsigned long changes(void) const {
+      return 2 * static_cast<unsigned long>(nextIdentifier) - positions.size();
+    }
+
+  private:
+
+    /**
+     * Slot type.
+     */
+    typedef struct {
+      int id;   //!< Identifier
+      T* value; //!< Object, or NULL for a hole
+    } Entry_t;
+
+    typedef std::vector<Entry_t> EntryList_t;
+    typedef std::tr1::unordered_map<int, size_t> PositionMap_t;
+
+    /**
+     * Squeeze out the holes, keeping the identifier order.
+     */
+    void compact(void) {
+      EntryList_t live;
+
+      live.reserve(positions.size());
+
+      for (size_t i = 0; i < entries.size(); i++) {
+	if (entries[i].value) {
+	  positions[entries[i].id] = live.size();
+	  live.push_back(entries[i]);
+	}
+      }
+
+      entries.swap(live);
+      holes = 0;
+    }
+
+    /**
+     * Objects in identifier order.
+     */
+    EntryList_t entries;
+
+    /**
+     * Positions in entries by identifier.
+     */
+    PositionMap_t positions;
+
+    /**
+     * Identifier of the next object.
+     */
+    int nextIdentifier;
+
+    /**
+     * Number of holes in entries.
+     */
+    size_t holes;
+  };
+}
+
+#endif
@@ -5,8 +5,18 @@
  */
 
 #include <cassert>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#define HAVE_SENDFILE
+#endif
 
 #include "socket-transport.h"
 
@@ -16,21 +26,30 @@ namespace fusenet {
   
   SocketTransport::SocketTransport(int d) {
     descriptor = d;
+    noDelay = false;
   }
 
   SocketTransport::SocketTransport(int d, std::string& name) : Transport(name) {
     descriptor = d;
+    noDelay = false;
   }
 
-  void SocketTransport::send(uint8_t data) {
+  size_t SocketTransport::rawSend(const uint8_t* data, size_t length) {
+    ssize_t n;
+
     if (isClosed()) {
-      return;
+      return 0;
     }
 
-    int n = ::send(descriptor, &data, 1, 0);
+    do {
+      n = ::send(descriptor, data, length, 0);
+    } while (n == -1 && errno == EINTR);
 
-    if (n == -1) {
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      n = 0;
+    } else if (n == -1) {
       close();
+      n = 0;
     } else if (n == 0) {
       close();
     } else {
@@ -38,20 +57,28 @@ namespace fusenet {
     }
 
 #ifdef ENABLE_DEBUG
-    std::cout << TRANSPORT_PREFIX(this) << "send " << static_cast<int>(data) << std::endl;
+    std::cout << TRANSPORT_PREFIX(this) << "send " << n << " bytes" << std::endl;
 #endif
+
+    return n;
   }
 
-  uint8_t SocketTransport::receive(void)  {
+  size_t SocketTransport::rawReceive(uint8_t* data, size_t length)  {
+    ssize_t n;
+
     if (isClosed()) {
       return 0;
     }
 
-    uint8_t data;
-    int n = recv(descriptor, &data, 1, 0);
+    do {
+      n = recv(descriptor, data, length, 0);
+    } while (n == -1 && errno == EINTR);
 
-    if (n == -1) {
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      n = 0;
+    } else if (n == -1) {
       close();
+      n = 0;
     } else if (n == 0) {
       close();
     } else {
@@ -59,10 +86,63 @@ namespace fusenet {
     }
 
 #ifdef ENABLE_DEBUG
-    std::cout << TRANSPORT_PREFIX(this) "receive " << static_cast<int>(data) << std::endl;
+    std::cout << TRANSPORT_PREFIX(this) << "receive " << n << " bytes" << std::endl;
+#endif
+
+    return n;
+  }
+
+  size_t SocketTransport::rawSendFile(int file, off_t offset, size_t length) {
+#ifdef HAVE_SENDFILE
+    ssize_t n;
+
+    if (isClosed()) {
+      return 0;
+    }
+
+    // The end of the message goes out in a small write after the
+    // file, which Nagle's algorithm would hold back until the file
+    // has been acknowledged
+    if (!noDelay) {
+      int yes = 1;
+
+      setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+      noDelay = true;
+    }
+
+    do {
+      n = sendfile(descriptor, file, &offset, length);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      n = 0;
+    } else if (n <= 0) {
+      // Either the socket failed, or the file is shorter than promised
+      close();
+      n = 0;
+    } else {
+      // All is well
+    }
+
+#ifdef ENABLE_DEBUG
+    std::cout << TRANSPORT_PREFIX(this) << "send " << n << " bytes from file" << std::endl;
+#endif
+
+    return n;
+#else
+    return Transport::rawSendFile(file, offset, length);
 #endif
+  }
+
+  bool SocketTransport::setNonBlocking(void) {
+    int flags;
+
+    if (isClosed()) {
+      return false;
+    }
 
-    return data;
+    flags = fcntl(descriptor, F_GETFL);
+    return flags != -1 && fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) != -1;
   }
 
   int SocketTransport::getDescriptor(void) {
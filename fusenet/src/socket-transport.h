@@ -28,24 +28,12 @@ namespace fusenet {
     SocketTransport(int descriptor, std::string& name);
     
     /**
-     * Send data via socket. If something should go wrong, the
-     * error is silently ignored.
-     *
-     * @param data the data to send
+     * Make the socket non-blocking. Sending and receiving then
+     * return at once, with whatever could be transferred.
      *
-     * @todo Should we not have any sort of error handling?
+     * @return true on success
      */
-    void send(uint8_t data);
-
-    /**
-     * Receive data via socket. If something should go wrong, the eror
-     * is silently ignored.
-     *
-     * @return the data received
-     *
-     * @todo Should we not have any sort of error handling?
-     */
-    uint8_t receive(void);
+    bool setNonBlocking(void);
 
     /**
      * Get the socket descriptor.
@@ -68,12 +56,53 @@ namespace fusenet {
      */
     virtual ~SocketTransport(void);
 
+  protected:
+    
+    /**
+     * Send data via socket. If something should go wrong, the
+     * socket is closed. A full non-blocking socket is not an
+     * error.
+     *
+     * @param data the data to send
+     * @param length the number of bytes to send
+     * @return the number of bytes sent
+     */
+    size_t rawSend(const uint8_t* data, size_t length);
+
+    /**
+     * Receive data via socket. If something should go wrong, the
+     * socket is closed. An empty non-blocking socket is not an
+     * error.
+     *
+     * @param data where to store the data
+     * @param length the maximum number of bytes to receive
+     * @return the number of bytes received
+     */
+    size_t rawReceive(uint8_t* data, size_t length);
+
+    /**
+     * Send part of a file via socket. On Linux the data goes from the
+     * file to the socket with sendfile(), without being copied to
+     * user space. Errors are handled as in rawSend().
+     *
+     * @param descriptor the file
+     * @param offset where in the file to start
+     * @param length the maximum number of bytes to send
+     * @return the number of bytes sent
+     */
+    size_t rawSendFile(int descriptor, off_t offset, size_t length);
+
   private:
 
     /**
      * Internal connection.
      */
     int descriptor;
+
+    /**
+     * Whether Nagle's algorithm has been turned off.
+     */
+    bool noDelay;
   };
 }
 
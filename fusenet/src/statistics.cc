@@ -0,0 +1,317 @@
+/**
+ * @file
+ *
+ * This file contains the request statistics implementation.
+ */
+
+#include <sys/time.h>
+#include <time.h>
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "log.h"
+#include "statistics.h"
+
+#define PREFIX "[Statistics] "
+
+/**
+ * Buckets per power of two, as a power of two. Values below twice as
+ * many buckets get one bucket each.
+ */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+
+namespace fusenet {
+
+  /**
+   * Names of the commands in reports, by identifier.
+   */
+  static const char* const CommandNames[] = {
+    NULL, "LIST_NG", "CREATE_NG", "DELETE_NG", "LIST_ART", "CREATE_ART",
+    "DELETE_ART", "GET_ART", NULL, "GET_ARTS", "LIST_ART_PAGE", "SUBSCRIBE",
+    "UNSUBSCRIBE", "LIST_NG_IF", "LIST_ART_IF", "STATS"
+  };
+
+  /**
+   * Names of the phases in reports.
+   */
+  static const char* const PhaseNames[] = { "parse", "database", "reply" };
+
+  /**
+   * Find the bucket of a value. Values up to twice the sub-buckets
+   * count have buckets of their own; above that, each power of two
+   * is split into SUB_BUCKETS buckets.
+   */
+  static int BucketOf(uint64_t value, int buckets) {
+    int exponent = 0;
+    int bucket;
+
+    while ((value >> exponent) >= 2 * SUB_BUCKETS) {
+      exponent++;
+    }
+
+    bucket = exponent * SUB_BUCKETS + static_cast<int>(value >> exponent);
+    return bucket < buckets ? bucket : buckets - 1;
+  }
+
+  /**
+   * Find the highest value that falls into a bucket.
+   */
+  static uint64_t BucketLimit(int bucket) {
+    int exponent;
+    uint64_t mantissa;
+
+    if (bucket < 2 * SUB_BUCKETS) {
+      return bucket;
+    }
+
+    exponent = bucket / SUB_BUCKETS - 1;
+    mantissa = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return ((mantissa + 1) << exponent) - 1;
+  }
+
+  /**
+   * Add nanoseconds to a report, in microseconds.
+   */
+  static void AddMicroseconds(std::ostringstream& report, uint64_t nanoseconds) {
+    report << std::setw(12) << std::fixed << std::setprecision(1)
+	   << nanoseconds / 1000.0;
+  }
+
+  Statistics::Statistics(void) {
+    shards = new Shard_t[SHARDS + 1]();
+    pthread_key_create(&shardKey, NULL);
+    threads = 0;
+    interval = 0;
+    running = false;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&stopped, NULL);
+  }
+
+  uint64_t Statistics::now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+  }
+
+  Statistics::Shard_t* Statistics::getShard(void) {
+    Shard_t* shard = static_cast<Shard_t*>(pthread_getspecific(shardKey));
+
+    if (shard == NULL) {
+      unsigned long thread = __sync_fetch_and_add(&threads, 1);
+
+      shard = &shards[thread < SHARDS ? thread : SHARDS];
+      pthread_setspecific(shardKey, shard);
+    }
+
+    return shard;
+  }
+
+  void Statistics::record(MessageIdentifier_t command, const RequestSample_t& sample) {
+    Shard_t* shard;
+    Counters_t* counters;
+    int i;
+
+    if (static_cast<int>(command) >= COMMANDS) {
+      return;
+    }
+
+    shard = getShard();
+    counters = &shard->commands[command];
+
+    // A thread that owns its counters is the only one to change them,
+    // and a report may read them a request behind
+    if (shard != &shards[SHARDS]) {
+      counters->requests++;
+      counters->bytesIn += sample.bytesIn;
+      counters->bytesOut += sample.bytesOut;
+
+      if (sample.failed) {
+	counters->errors++;
+      }
+
+      for (i = 0; i < PHASES; i++) {
+	counters->buckets[i][BucketOf(sample.time[i], BUCKETS)]++;
+      }
+
+      return;
+    }
+
+    __sync_fetch_and_add(&counters->requests, 1);
+    __sync_fetch_and_add(&counters->bytesIn, sample.bytesIn);
+    __sync_fetch_and_add(&counters->bytesOut, sample.bytesOut);
+
+    if (sample.failed) {
+      __sync_fetch_and_add(&counters->errors, 1);
+    }
+
+    for (i = 0; i < PHASES; i++) {
+      __sync_fetch_and_add(&counters->buckets[i][BucketOf(sample.time[i], BUCKETS)], 1);
+    }
+  }
+
+  std::string Statistics::report(void) {
+    std::ostringstream report;
+    Counters_t total;
+    int command;
+    int shard;
+    int phase;
+    int i;
+
+    report << std::left << std::setw(16) << "command" << std::right
+	   << std::setw(12) << "requests" << std::setw(12) << "errors"
+	   << std::setw(16) << "bytes in" << std::setw(16) << "bytes out" << "\n";
+
+    for (command = 0; command < COMMANDS; command++) {
+      total.requests = 0;
+      total.errors = 0;
+      total.bytesIn = 0;
+      total.bytesOut = 0;
+
+      for (shard = 0; shard <= SHARDS; shard++) {
+	Counters_t& counters = shards[shard].commands[command];
+
+	total.requests += counters.requests;
+	total.errors += counters.errors;
+	total.bytesIn += counters.bytesIn;
+	total.bytesOut += counters.bytesOut;
+      }
+
+      if (total.requests == 0) {
+	continue;
+      }
+
+      report << std::left << std::setw(16) << CommandNames[command] << std::right
+	     << std::setw(12) << total.requests << std::setw(12) << total.errors
+	     << std::setw(16) << total.bytesIn << std::setw(16) << total.bytesOut << "\n";
+    }
+
+    report << "\n" << std::left << std::setw(16) << "command" << std::setw(10) << "phase"
+	   << std::right << std::setw(12) << "p50" << std::setw(12) << "p90"
+	   << std::setw(12) << "p99" << std::setw(12) << "p99.9"
+	   << std::setw(12) << "max" << "\n";
+
+    for (command = 0; command < COMMANDS; command++) {
+      for (phase = 0; phase < PHASES; phase++) {
+	static const double Percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t count = 0;
+	uint64_t seen = 0;
+	int percentile = 0;
+	int highest = 0;
+
+	for (i = 0; i < BUCKETS; i++) {
+	  total.buckets[phase][i] = 0;
+
+	  for (shard = 0; shard <= SHARDS; shard++) {
+	    total.buckets[phase][i] += shards[shard].commands[command].buckets[phase][i];
+	  }
+
+	  if (total.buckets[phase][i] > 0) {
+	    count += total.buckets[phase][i];
+	    highest = i;
+	  }
+	}
+
+	if (count == 0) {
+	  break;
+	}
+
+	report << std::left << std::setw(16) << CommandNames[command]
+	       << std::setw(10) << PhaseNames[phase] << std::right;
+
+	// A percentile is the highest value of the first bucket that
+	// reaches it, as HdrHistogram does
+	for (i = 0; i < BUCKETS && percentile < 4; i++) {
+	  seen += total.buckets[phase][i];
+
+	  while (percentile < 4 && seen >= Percentiles[percentile] * count) {
+	    AddMicroseconds(report, BucketLimit(i));
+	    percentile++;
+	  }
+	}
+
+	AddMicroseconds(report, BucketLimit(highest));
+	report << "\n";
+      }
+    }
+
+    return report.str();
+  }
+
+  bool Statistics::startDump(const std::string& path, int interval) {
+    this->path = path;
+    this->interval = interval;
+    running = true;
+
+    if (pthread_create(&thread, NULL, run, this) != 0) {
+      running = false;
+      return false;
+    }
+
+    return true;
+  }
+
+  void Statistics::save(void) {
+    std::string temporary = path + ".tmp";
+    std::string text = report();
+    FILE* file = fopen(temporary.c_str(), "w");
+    bool written;
+
+    if (file == NULL) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to create " << temporary;
+      return;
+    }
+
+    // Readers never see a partly written report
+    written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+      LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to write " << path;
+      remove(temporary.c_str());
+    }
+  }
+
+  void* Statistics::run(void* argument) {
+    static_cast<Statistics*>(argument)->dump();
+    return NULL;
+  }
+
+  void Statistics::dump(void) {
+    pthread_mutex_lock(&mutex);
+
+    while (running) {
+      struct timeval now;
+      struct timespec deadline;
+
+      gettimeofday(&now, NULL);
+      deadline.tv_sec = now.tv_sec + interval;
+      deadline.tv_nsec = now.tv_usec * 1000;
+      pthread_cond_timedwait(&stopped, &mutex, &deadline);
+
+      pthread_mutex_unlock(&mutex);
+      save();
+      pthread_mutex_lock(&mutex);
+    }
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  Statistics::~Statistics(void) {
+    if (running) {
+      pthread_mutex_lock(&mutex);
+      running = false;
+      pthread_cond_broadcast(&stopped);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(thread, NULL);
+    }
+
+    pthread_cond_destroy(&stopped);
+    pthread_mutex_destroy(&mutex);
+    pthread_key_delete(shardKey);
+    delete[] shards;
+  }
+}
@@ -0,0 +1,205 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+/**
+ * @file
+ *
+ * This file contains the request statistics interface.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "message-identifiers.h"
+
+namespace fusenet {
+
+  /**
+   * Phases of handling a request.
+   */
+  typedef enum {
+    PHASE_PARSE,     //!< Decoding the request
+    PHASE_DATABASE,  //!< Executing it, and committing changes
+    PHASE_REPLY      //!< Encoding and sending the reply
+  } Phase_t;
+
+  /**
+   * Number of phases.
+   */
+  const int PHASES = 3;
+
+  /**
+   * What handling one request took.
+   */
+  typedef struct {
+    bool failed;             //!< Answered with an error
+    uint64_t bytesIn;        //!< Size of the request
+    uint64_t bytesOut;       //!< Size of the reply
+    uint64_t time[PHASES];   //!< Nanoseconds spent in each phase
+  } RequestSample_t;
+
+  /**
+   * Counts, errors, bytes and latency histograms of the requests
+   * handled, for each command. The histograms have buckets of
+   * logarithmic size, eight per power of two, so a percentile read
+   * from them is off by at most an eighth.
+   *
+   * Each thread that records gets counters of its own, which are only
+   * summed up when a report is made, so recording neither takes a lock
+   * nor shares cache lines with other threads. Threads beyond SHARDS
+   * share one more set of counters, which they add to atomically.
+   */
+  class Statistics {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    Statistics(void);
+
+    /**
+     * Read the monotonic clock.
+     *
+     * @return the time in nanoseconds
+     */
+    static uint64_t now(void);
+
+    /**
+     * Record a request. May be called on any thread.
+     *
+     * @param command the command of the request
+     * @param sample what the request took
+     */
+    void record(MessageIdentifier_t command, const RequestSample_t& sample);
+
+    /**
+     * Make a report of everything recorded so far, one line for each
+     * command used and one for each of its phases. Latencies are in
+     * microseconds.
+     *
+     * @return the report
+     */
+    std::string report(void);
+
+    /**
+     * Write the report to a file at a fixed interval, from a thread of
+     * its own. The file is replaced as a whole each time.
+     *
+     * @param path the file
+     * @param interval the interval in seconds
+     * @return false if the thread could not be started
+     */
+    bool startDump(const std::string& path, int interval);
+
+    /**
+     * Stop dumping, after one last dump, and destroy instance.
+     */
+    ~Statistics(void);
+
+  private:
+
+    /**
+     * Number of histogram buckets, enough for about 18 minutes.
+     */
+    static const int BUCKETS = 304;
+
+    /**
+     * Number of command identifiers.
+     */
+    static const int COMMANDS = 16;
+
+    /**
+     * Number of sets of counters owned by a single thread. Threads
+     * beyond this share the set after them.
+     */
+    static const int SHARDS = 8;
+
+    /**
+     * Counters for one command.
+     */
+    typedef struct {
+      uint64_t requests;                  //!< Requests
+      uint64_t errors;                    //!< Requests answered with errors
+      uint64_t bytesIn;                   //!< Request bytes
+      uint64_t bytesOut;                  //!< Reply bytes
+      uint64_t buckets[PHASES][BUCKETS];  //!< Latency histograms
+    } Counters_t;
+
+    /**
+     * Counters of one thread, or of all threads beyond SHARDS.
+     */
+    typedef struct {
+      Counters_t commands[COMMANDS];  //!< By command identifier
+    } Shard_t;
+
+    /**
+     * Find the counters of the calling thread.
+     */
+    Shard_t* getShard(void);
+
+    /**
+     * Write the report to the dump file.
+     */
+    void save(void);
+
+    /**
+     * Dump thread entry point.
+     */
+    static void* run(void* argument);
+
+    /**
+     * Dump until stopped.
+     */
+    void dump(void);
+
+    /**
+     * The counters, SHARDS owned ones followed by the shared one.
+     */
+    Shard_t* shards;
+
+    /**
+     * The counters of each thread.
+     */
+    pthread_key_t shardKey;
+
+    /**
+     * Number of threads handed counters so far.
+     */
+    volatile unsigned long threads;
+
+    /**
+     * Dump file.
+     */
+    std::string path;
+
+    /**
+     * Seconds between dumps.
+     */
+    int interval;
+
+    /**
+     * Dump thread, if started.
+     */
+    pthread_t thread;
+
+    /**
+     * True while the dump thread runs.
+     */
+    bool running;
+
+    /**
+     * Protects running.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * Signalled when the dump thread should stop.
+     */
+    pthread_cond_t stopped;
+  };
+}
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file
+ *
+ * This file contains the subscriber registry implementation.
+ */
+
+#include <cstddef>
+
+#include "job.h"
+#include "subscriber-registry.h"
+
+namespace fusenet {
+
+  /**
+   * Sends the notifications queued for a subscription once it is
+   * completed on the reactor thread. There is nothing to execute. The
+   * job holds a reference to the subscription.
+   */
+  class Subscription::DeliveryJob : public Job {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    DeliveryJob(Subscription* subscription, Transport* transport) : Job(transport) {
+      this->subscription = subscription;
+      subscription->acquire();
+    }
+
+    /**
+     * Does nothing.
+     */
+    void execute(void) {
+      // Does nothing
+    }
+
+    /**
+     * Send the notifications.
+     */
+    void complete(void) {
+      subscription->deliver();
+    }
+
+    /**
+     * Destroy instance.
+     */
+    ~DeliveryJob(void) {
+      subscription->release();
+    }
+
+  private:
+
+    /**
+     * The subscription.
+     */
+    Subscription* subscription;
+  };
+
+  Subscription::Subscription(ServerProtocol* protocol, Transport* transport,
+			     NetworkReactor* reactor) {
+    pthread_mutex_init(&mutex, NULL);
+    this->protocol = protocol;
+    this->transport = transport;
+    this->reactor = reactor;
+    job = NULL;
+    closed = false;
+  }
+
+  void Subscription::notify(const Notification_t& notification) {
+    pthread_mutex_lock(&mutex);
+
+    if (!closed) {
+      pending.push_back(notification);
+
+      if (job == NULL) {
+	job = new DeliveryJob(this, transport);
+	reactor->post(job);
+      }
+    }
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void Subscription::deliver(void) {
+    NotificationList_t notifications;
+    NotificationList_t::iterator i;
+
+    pthread_mutex_lock(&mutex);
+    notifications.swap(pending);
+    job = NULL;
+    pthread_mutex_unlock(&mutex);
+
+    for (i = notifications.begin(); i != notifications.end(); i++) {
+      if (i->type == ANS_NEW_ART) {
+	protocol->notifyNewArticle(i->newsgroupIdentifier, i->articleIdentifier, i->title);
+      } else {
+	protocol->notifyDeletedArticle(i->newsgroupIdentifier, i->articleIdentifier);
+      }
+    }
+  }
+
+  void Subscription::close(void) {
+    pthread_mutex_lock(&mutex);
+    closed = true;
+    pending.clear();
+
+    // The reactor deletes the job without completing it
+    if (job != NULL) {
+      job->cancel();
+      job = NULL;
+    }
+
+    pthread_mutex_unlock(&mutex);
+  }
+
+  Subscription::~Subscription(void) {
+    pthread_mutex_destroy(&mutex);
+  }
+
+  SubscriberRegistry::SubscriberRegistry(void) {
+    pthread_rwlock_init(&lock, NULL);
+  }
+
+  void SubscriberRegistry::subscribe(int newsgroupIdentifier, Subscription* subscription) {
+    pthread_rwlock_wrlock(&lock);
+
+    if (subscriptions[newsgroupIdentifier].insert(subscription).second) {
+      subscription->acquire();
+    }
+
+    pthread_rwlock_unlock(&lock);
+  }
+
+  bool SubscriberRegistry::unsubscribe(int newsgroupIdentifier, Subscription* subscription) {
+    SubscriptionMap_t::iterator i;
+    bool found = false;
+
+    pthread_rwlock_wrlock(&lock);
+    i = subscriptions.find(newsgroupIdentifier);
+
+    if (i != subscriptions.end() && i->second.erase(subscription) > 0) {
+      found = true;
+
+      if (i->second.empty()) {
+	subscriptions.erase(i);
+      }
+    }
+
+    pthread_rwlock_unlock(&lock);
+
+    if (found) {
+      subscription->release();
+    }
+
+    return found;
+  }
+
+  void SubscriberRegistry::dropNewsgroup(int newsgroupIdentifier) {
+    SubscriptionMap_t::iterator i;
+    SubscriptionSet_t dropped;
+    SubscriptionSet_t::iterator j;
+
+    pthread_rwlock_wrlock(&lock);
+    i = subscriptions.find(newsgroupIdentifier);
+
+    if (i != subscriptions.end()) {
+      dropped.swap(i->second);
+      subscriptions.erase(i);
+    }
+
+    pthread_rwlock_unlock(&lock);
+
+    for (j = dropped.begin(); j != dropped.end(); j++) {
+      (*j)->release();
+    }
+  }
+
+  void SubscriberRegistry::publish(const Notification_t& notification) {
+    SubscriptionMap_t::iterator i;
+    SubscriptionSet_t::iterator j;
+
+    pthread_rwlock_rdlock(&lock);
+    i = subscriptions.find(notification.newsgroupIdentifier);
+
+    if (i != subscriptions.end()) {
+      for (j = i->second.begin(); j != i->second.end(); j++) {
+	(*j)->notify(notification);
+      }
+    }
+
+    pthread_rwlock_unlock(&lock);
+  }
+
+  SubscriberRegistry::~SubscriberRegistry(void) {
+    SubscriptionMap_t::iterator i;
+    SubscriptionSet_t::iterator j;
+
+    for (i = subscriptions.begin(); i != subscriptions.end(); i++) {
+      for (j = i->second.begin(); j != i->second.end(); j++) {
+	(*j)->release();
+      }
+    }
+
+    pthread_rwlock_destroy(&lock);
+  }
+}
@@ -0,0 +1,195 @@
+#ifndef SUBSCRIBER_REGISTRY_H
+#define SUBSCRIBER_REGISTRY_H
+
+/**
+ * @file
+ *
+ * This file contains the subscriber registry interface.
+ */
+
+#include <pthread.h>
+
+#include <set>
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+
+#include "message-identifiers.h"
+#include "network-reactor.h"
+#include "server-protocol.h"
+#include "shared.h"
+
+namespace fusenet {
+
+  /**
+   * Notification sent to the subscribers of a newsgroup.
+   */
+  typedef struct {
+    MessageIdentifier_t type;   //!< ANS_NEW_ART or ANS_ART_DELETED
+    int newsgroupIdentifier;    //!< Newsgroup
+    int articleIdentifier;      //!< Article
+    std::string title;          //!< Title, for new articles only
+  } Notification_t;
+
+  typedef std::vector<Notification_t> NotificationList_t;
+
+  /**
+   * The subscriptions of one connection. Notifications may be handed
+   * to it on any thread. They are queued, and sent by a job posted to
+   * the reactor owning the connection, so whoever publishes them never
+   * waits for the subscriber. Notifications that arrive while the job
+   * is pending go out with it.
+   */
+  class Subscription : public Shared {
+
+  public:
+
+    /**
+     * Create instance.
+     *
+     * @param protocol the protocol to send the notifications with
+     * @param transport the connection of the protocol
+     * @param reactor the reactor owning the connection
+     */
+    Subscription(ServerProtocol* protocol, Transport* transport,
+		 NetworkReactor* reactor);
+
+    /**
+     * Queue a notification. May be called on any thread.
+     *
+     * @param notification the notification
+     */
+    void notify(const Notification_t& notification);
+
+    /**
+     * Stop sending notifications, because the connection is going
+     * away. Must be called on the reactor thread.
+     */
+    void close(void);
+
+  protected:
+
+    /**
+     * Destroy instance. Only called by release().
+     */
+    ~Subscription(void);
+
+  private:
+
+    /**
+     * Job sending the queued notifications.
+     */
+    class DeliveryJob;
+
+    /**
+     * Send the queued notifications. Called on the reactor thread.
+     */
+    void deliver(void);
+
+    /**
+     * Protects the pending notifications, the job and the closed
+     * flag.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * Protocol to send the notifications with.
+     */
+    ServerProtocol* protocol;
+
+    /**
+     * Connection of the protocol.
+     */
+    Transport* transport;
+
+    /**
+     * Reactor owning the connection.
+     */
+    NetworkReactor* reactor;
+
+    /**
+     * Notifications not yet sent, oldest first.
+     */
+    NotificationList_t pending;
+
+    /**
+     * The job posted to send them, or NULL.
+     */
+    DeliveryJob* job;
+
+    /**
+     * Set once the connection is going away.
+     */
+    bool closed;
+  };
+
+  /**
+   * Registry of the subscriptions to each newsgroup, shared by all
+   * reactors. Publishing only takes a read lock, so posters in
+   * different threads do not wait for each other.
+   */
+  class SubscriberRegistry {
+
+  public:
+
+    /**
+     * Create instance.
+     */
+    SubscriberRegistry(void);
+
+    /**
+     * Subscribe to a newsgroup. Does nothing if already subscribed.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param subscription the subscription, which the registry takes
+     *        a reference to
+     */
+    void subscribe(int newsgroupIdentifier, Subscription* subscription);
+
+    /**
+     * Unsubscribe from a newsgroup.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     * @param subscription the subscription
+     * @return false if it was not subscribed
+     */
+    bool unsubscribe(int newsgroupIdentifier, Subscription* subscription);
+
+    /**
+     * Drop all subscriptions to a newsgroup. Called after the
+     * newsgroup has been deleted.
+     *
+     * @param newsgroupIdentifier the newsgroup identifier
+     */
+    void dropNewsgroup(int newsgroupIdentifier);
+
+    /**
+     * Hand a notification to every subscriber of its newsgroup.
+     *
+     * @param notification the notification
+     */
+    void publish(const Notification_t& notification);
+
+    /**
+     * Destroy instance.
+     */
+    ~SubscriberRegistry(void);
+
+  private:
+
+    typedef std::set<Subscription*> SubscriptionSet_t;
+    typedef std::tr1::unordered_map<int, SubscriptionSet_t> SubscriptionMap_t;
+
+    /**
+     * Protects the subscriptions.
+     */
+    pthread_rwlock_t lock;
+
+    /**
+     * Subscriptions by newsgroup identifier.
+     */
+    SubscriptionMap_t subscriptions;
+  };
+}
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * @file
+ *
+ * This file contains the synchronized database implementation.
+ */
+
+#include "synchronized-database.h"
+
+namespace fusenet {
+
+  SynchronizedDatabase::Guard::Guard(pthread_rwlock_t* lock, bool exclusive) {
+    this->lock = lock;
+
+    if (exclusive) {
+      pthread_rwlock_wrlock(lock);
+    } else {
+      pthread_rwlock_rdlock(lock);
+    }
+  }
+
+  SynchronizedDatabase::Guard::~Guard(void) {
+    pthread_rwlock_unlock(lock);
+  }
+
+  SynchronizedDatabase::SynchronizedDatabase(Database* database) {
+    this->database = database;
+    pthread_rwlock_init(&lock, NULL);
+  }
+
+  Status_t SynchronizedDatabase::getNewsgroupList(NewsgroupList_t& newsgroupList) {
+    Guard guard(&lock, false);
+    return database->getNewsgroupList(newsgroupList);
+  }
+
+  Status_t SynchronizedDatabase::checkNewsgroup(int newsgroupIdentifier) {
+    Guard guard(&lock, false);
+    return database->checkNewsgroup(newsgroupIdentifier);
+  }
+
+  Status_t SynchronizedDatabase::createNewsgroup(std::string& newsgroupName) {
+    Guard guard(&lock, true);
+    return database->createNewsgroup(newsgroupName);
+  }
+
+  Status_t SynchronizedDatabase::deleteNewsgroup(int newsgroupIdentifier) {
+    Guard guard(&lock, true);
+    return database->deleteNewsgroup(newsgroupIdentifier);
+  }
+
+  Status_t SynchronizedDatabase::listArticles(int newsgroupIdentifier,
+					      ArticleList_t& articleList) {
+    Guard guard(&lock, false);
+    return database->listArticles(newsgroupIdentifier, articleList);
+  }
+
+  Status_t SynchronizedDatabase::listArticleHeaders(int newsgroupIdentifier,
+						    ArticleHeaderList_t& headerList) {
+    Guard guard(&lock, false);
+    return database->listArticleHeaders(newsgroupIdentifier, headerList);
+  }
+
+  Status_t SynchronizedDatabase::listArticlePage(int newsgroupIdentifier,
+						 int cursor,
+						 ListDirection_t direction,
+						 size_t maxCount,
+						 ArticleHeaderList_t& headerList,
+						 int& nextCursor) {
+    Guard guard(&lock, false);
+    return database->listArticlePage(newsgroupIdentifier, cursor, direction,
+				     maxCount, headerList, nextCursor);
+  }
+
+  Status_t SynchronizedDatabase::createArticle(int newsgroupIdentifier,
+					       Article_t& article) {
+    Guard guard(&lock, true);
+    return database->createArticle(newsgroupIdentifier, article);
+  }
+
+  Status_t SynchronizedDatabase::deleteArticle(int newsgroupIdentifier,
+					       int articleIdentifier) {
+    Guard guard(&lock, true);
+    return database->deleteArticle(newsgroupIdentifier, articleIdentifier);
+  }
+
+  Status_t SynchronizedDatabase::getArticle(int newsgroupIdentifier,
+					    int articleIdentifier,
+					    Article_t& article) {
+    Guard guard(&lock, false);
+    return database->getArticle(newsgroupIdentifier, articleIdentifier, article);
+  }
+
+  Status_t SynchronizedDatabase::getArticleRef(int newsgroupIdentifier,
+					       int articleIdentifier,
+					       ArticleRef& article) {
+    Guard guard(&lock, false);
+    return database->getArticleRef(newsgroupIdentifier, articleIdentifier, article);
+  }
+
+  Status_t SynchronizedDatabase::getArticleRefs(int newsgroupIdentifier,
+						const IdentifierList_t& articleIdentifiers,
+						ArticleRefList_t& articles,
+						StatusList_t& statuses) {
+    Guard guard(&lock, false);
+    return database->getArticleRefs(newsgroupIdentifier, articleIdentifiers,
+				    articles, statuses);
+  }
+
+  Status_t SynchronizedDatabase::getNewsgroupListVersion(Version_t& version) {
+    Guard guard(&lock, false);
+    return database->getNewsgroupListVersion(version);
+  }
+
+  Status_t SynchronizedDatabase::getNewsgroupVersion(int newsgroupIdentifier,
+						     Version_t& version) {
+    Guard guard(&lock, false);
+    return database->getNewsgroupVersion(newsgroupIdentifier, version);
+  }
+
+  Status_t SynchronizedDatabase::commit(void) {
+    return database->commit();
+  }
+
+  SynchronizedDatabase::~SynchronizedDatabase(void) {
+    pthread_rwlock_destroy(&lock);
+  }
+}
@@ -0,0 +1,170 @@
+#ifndef SYNCHRONIZED_DATABASE_H
+#define SYNCHRONIZED_DATABASE_H
+
+/**
+ * @file
+ *
+ * This file contains the synchronized database interface.
+ */
+
+#include <pthread.h>
+
+#include "database.h"
+
+namespace fusenet {
+
+  /**
+   * Synchronized database. Wraps another database so that it can be
+   * shared between threads. Operations that only read run
+   * concurrently, while operations that modify the database get
+   * exclusive access.
+   */
+  class SynchronizedDatabase : public Database {
+
+  public:
+
+    /**
+     * Create instance. The wrapped database is not owned.
+     *
+     * @param database the database to synchronize access to
+     */
+    SynchronizedDatabase(Database* database);
+
+    /**
+     * Get all newsgroups.
+     */
+    Status_t getNewsgroupList(NewsgroupList_t& newsgroupList);
+
+    /**
+     * Check that a newsgroup exists.
+     */
+    Status_t checkNewsgroup(int newsgroupIdentifier);
+
+    /**
+     * Create newsgroups.
+     */
+    Status_t createNewsgroup(std::string& newsgroupName);
+
+    /**
+     * Delete newsgroup.
+     */
+    Status_t deleteNewsgroup(int newsgroupIdentifier);
+
+    /**
+     * List articles.
+     */
+    Status_t listArticles(int newsgroupIdentifier,
+			  ArticleList_t& articleList);
+
+    /**
+     * List article headers.
+     */
+    Status_t listArticleHeaders(int newsgroupIdentifier,
+				ArticleHeaderList_t& headerList);
+
+    /**
+     * List a page of article headers.
+     */
+    Status_t listArticlePage(int newsgroupIdentifier,
+			     int cursor,
+			     ListDirection_t direction,
+			     size_t maxCount,
+			     ArticleHeaderList_t& headerList,
+			     int& nextCursor);
+
+    /**
+     * Create article.
+     */
+    Status_t createArticle(int newsgroupIdentifier,
+			   Article_t& article);
+
+    /**
+     * Delete article.
+     */
+    Status_t deleteArticle(int newsgroupIdentifer,
+			   int articleIdentifier);
+
+    /**
+     * Get article.
+     */
+    Status_t getArticle(int newsgroupIdentifer,
+			int articleIdentifier,
+			Article_t& article);
+
+    /**
+     * Get a reference to an article.
+     */
+    Status_t getArticleRef(int newsgroupIdentifier,
+			   int articleIdentifier,
+			   ArticleRef& article);
+
+    /**
+     * Get references to several articles, all under one lock.
+     */
+    Status_t getArticleRefs(int newsgroupIdentifier,
+			    const IdentifierList_t& articleIdentifiers,
+			    ArticleRefList_t& articles,
+			    StatusList_t& statuses);
+
+    /**
+     * Get the version of the newsgroup list.
+     */
+    Status_t getNewsgroupListVersion(Version_t& version);
+
+    /**
+     * Get the version of a newsgroup.
+     */
+    Status_t getNewsgroupVersion(int newsgroupIdentifier,
+				 Version_t& version);
+
+    /**
+     * Wait for changes to be durable. Does not take the lock, so that
+     * other changes can go ahead and join the same sync.
+     */
+    Status_t commit(void);
+
+    /**
+     * Destroy instance.
+     */
+    virtual ~SynchronizedDatabase(void);
+
+  private:
+
+    /**
+     * Holds a lock for as long as it is in scope.
+     */
+    class Guard {
+
+    public:
+
+      /**
+       * Acquire the lock, shared or exclusive.
+       */
+      Guard(pthread_rwlock_t* lock, bool exclusive);
+
+      /**
+       * Release the lock.
+       */
+      ~Guard(void);
+
+    private:
+
+      /**
+       * The held lock.
+       */
+      pthread_rwlock_t* lock;
+    };
+
+    /**
+     * The wrapped database.
+     */
+    Database* database;
+
+    /**
+     * Readers/writer lock protecting the wrapped database.
+     */
+    pthread_rwlock_t lock;
+  };
+}
+
+#endif
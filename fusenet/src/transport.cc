@@ -4,16 +4,207 @@
  * This file contains the transport implementation.
  */
 
+#include <algorithm>
+
+#include <unistd.h>
+
 #include "transport.h"
 
+/**
+ * Size of the receive buffer. Larger reads bypass it.
+ */
+#define BUFFER_SIZE 16384
+
+/**
+ * Size of the blocks files are sent in when they have to be read.
+ */
+#define FILE_BLOCK_SIZE 65536
+
+/**
+ * Most send buffer capacity kept once everything is sent, enough for
+ * a pipelined batch of ordinary replies. The space a larger reply
+ * needed is given back, rather than held for the rest of the
+ * connection.
+ */
+#define SEND_BUFFER_CAPACITY 262144
+
 namespace fusenet {
 
   Transport::Transport(void) {
     transportName = "<unknown>";
+    receivePosition = 0;
+    receiveLength = 0;
+    sendPosition = 0;
+    fileBytes = 0;
+    dequeued = 0;
+    corks = 0;
   }
 
   Transport::Transport(std::string& name) {
     transportName = name;
+    receivePosition = 0;
+    receiveLength = 0;
+    sendPosition = 0;
+    fileBytes = 0;
+    dequeued = 0;
+    corks = 0;
+  }
+
+  void Transport::send(const uint8_t* data, size_t length) {
+    sendBuffer.insert(sendBuffer.end(), data, data + length);
+  }
+
+  uint8_t* Transport::extend(size_t length) {
+    size_t size = sendBuffer.size();
+
+    sendBuffer.resize(size + length);
+    return &sendBuffer[size];
+  }
+
+  void Transport::sendFile(Shared* owner, int descriptor, off_t offset, size_t length) {
+    FileSegment_t file;
+
+    if (length == 0) {
+      return;
+    }
+
+    owner->acquire();
+    file.position = sendBuffer.size();
+    file.owner = owner;
+    file.descriptor = descriptor;
+    file.offset = offset;
+    file.length = length;
+    files.push_back(file);
+    fileBytes += length;
+  }
+
+  void Transport::flush(void) {
+    size_t sent;
+    size_t end;
+    size_t i;
+
+    if (corks > 0) {
+      return;
+    }
+
+    while (pending() > 0 && !isClosed()) {
+      end = files.empty() ? sendBuffer.size() : files.front().position;
+
+      if (sendPosition < end) {
+	sent = rawSend(&sendBuffer[sendPosition], end - sendPosition);
+
+	if (sent == 0) {
+	  break;
+	}
+
+	sendPosition += sent;
+	dequeued += sent;
+      } else {
+	FileSegment_t& file = files.front();
+
+	sent = rawSendFile(file.descriptor, file.offset, file.length);
+
+	if (sent == 0) {
+	  break;
+	}
+
+	file.offset += sent;
+	file.length -= sent;
+	fileBytes -= sent;
+	dequeued += sent;
+
+	if (file.length == 0) {
+	  file.owner->release();
+	  files.pop_front();
+	}
+      }
+    }
+
+    if (pending() == 0 || isClosed()) {
+      clearSendQueue();
+    } else if (sendPosition > sendBuffer.size() / 2) {
+      // Reclaim the space of sent data once it dominates the queue
+      sendBuffer.erase(sendBuffer.begin(), sendBuffer.begin() + sendPosition);
+
+      for (i = 0; i < files.size(); i++) {
+	files[i].position -= sendPosition;
+      }
+
+      sendPosition = 0;
+    }
+  }
+
+  void Transport::uncork(void) {
+    if (--corks == 0) {
+      flush();
+    }
+  }
+
+  void Transport::clearSendQueue(void) {
+    size_t i;
+
+    dequeued += pending();
+
+    for (i = 0; i < files.size(); i++) {
+      files[i].owner->release();
+    }
+
+    files.clear();
+    fileBytes = 0;
+    sendPosition = 0;
+
+    if (sendBuffer.capacity() > SEND_BUFFER_CAPACITY) {
+      std::vector<uint8_t>().swap(sendBuffer);
+    } else {
+      sendBuffer.clear();
+    }
+  }
+
+  size_t Transport::rawSendFile(int descriptor, off_t offset, size_t length) {
+    uint8_t block[FILE_BLOCK_SIZE];
+    ssize_t n;
+
+    if (length > sizeof(block)) {
+      length = sizeof(block);
+    }
+
+    n = pread(descriptor, block, length, offset);
+
+    if (n <= 0) {
+      // The file is shorter than promised or unreadable, and the
+      // message cannot be completed
+      close();
+      return 0;
+    }
+
+    // Whatever rawSend() does not take is read again next time
+    return rawSend(block, n);
+  }
+
+  size_t Transport::receive(uint8_t* data, size_t length) {
+    size_t n;
+
+    if (available() == 0) {
+      if (length >= BUFFER_SIZE) {
+	// Large reads go straight to the caller
+	return isClosed() ? 0 : rawReceive(data, length);
+      }
+
+      if (receiveBuffer.empty()) {
+	receiveBuffer.resize(BUFFER_SIZE);
+      }
+
+      receivePosition = 0;
+      receiveLength = isClosed() ? 0 : rawReceive(&receiveBuffer[0], BUFFER_SIZE);
+    }
+
+    n = available() < length ? available() : length;
+    std::copy(receiveBuffer.begin() + receivePosition,
+	      receiveBuffer.begin() + receivePosition + n,
+	      data);
+    receivePosition += n;
+
+    return n;
   }
 
   std::string& Transport::getName(void) {
@@ -21,6 +212,6 @@ namespace fusenet {
   }
 
   Transport::~Transport(void) {
-    // Does nothing
+    clearSendQueue();
   }
 }
@@ -7,10 +7,15 @@
  * This file contains the transport interface.
  */
 
+#include <deque>
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include <sys/types.h>
 
 #include "fusenet-types.h"
+#include "shared.h"
 
 /**
  * Convenience macro for prefixing printouts.
@@ -22,6 +27,18 @@ namespace fusenet {
   /**
    * Base class for all transport. A transport gives the owner of it
    * the ability to receive and send data using it.
+   *
+   * All transports are buffered. Received data is read from the
+   * underlying channel in blocks into a receive buffer, and sent
+   * data is collected in a send buffer until it is flushed, which
+   * should be done at message boundaries, so that a whole message
+   * normally leaves in a single call. The transport can be corked
+   * while several messages are sent, so that they leave together.
+   * Subclasses only implement the raw block operations.
+   *
+   * Parts of files can be queued along with the buffered data, so
+   * that large blocks that already are in a file go from the file
+   * to the channel without passing through the send buffer.
    */
   class Transport {
 
@@ -38,16 +55,115 @@ namespace fusenet {
     Transport(std::string& name);
 
     /**
-     * Send data.
+     * Send data. The data is buffered until the next flush.
+     *
+     * @param data the data to send
+     */
+    void send(uint8_t data) {
+      sendBuffer.push_back(data);
+    }
+
+    /**
+     * Send a block of data. The data is buffered until the next
+     * flush.
      *
      * @param data the data to send
+     * @param length the number of bytes to send
+     */
+    void send(const uint8_t* data, size_t length);
+
+    /**
+     * Make room for a block of data at the end of the send buffer,
+     * for the caller to fill in. The data is sent with the next flush.
+     *
+     * @param length the number of bytes, more than zero
+     * @return where to put the data, valid until the next call that
+     * sends or flushes
+     */
+    uint8_t* extend(size_t length);
+
+    /**
+     * Send part of a file, after the data buffered so far. Nothing is
+     * read until the file is due to be sent. The file must stay open
+     * until then, which the transport ensures by holding a reference
+     * to its owner.
+     *
+     * @param owner the object that keeps the file open
+     * @param descriptor the file
+     * @param offset where in the file to start
+     * @param length the number of bytes to send
+     */
+    void sendFile(Shared* owner, int descriptor, off_t offset, size_t length);
+
+    /**
+     * Send buffered data. On a non-blocking transport, whatever
+     * cannot be sent right away stays queued until the next flush.
+     * Does nothing while the transport is corked.
+     */
+    void flush(void);
+
+    /**
+     * Hold back flushes, so that the messages sent meanwhile leave
+     * together once the transport is uncorked. Calls nest.
+     */
+    void cork(void) {
+      corks++;
+    }
+
+    /**
+     * Undo one cork(), and flush once the last one is undone.
+     */
+    void uncork(void);
+
+    /**
+     * Number of bytes queued for sending.
+     */
+    size_t pending(void) const {
+      return sendBuffer.size() - sendPosition + fileBytes;
+    }
+
+    /**
+     * Number of bytes queued for sending since the transport was
+     * created, whether sent yet or not.
+     */
+    size_t queued(void) const {
+      return dequeued + pending();
+    }
+
+    /**
+     * Receive data. Blocks until data is available.
+     *
+     * @return the data received, or zero if the transport closed
      */
-    virtual void send(uint8_t data) = 0;
+    uint8_t receive(void) {
+      uint8_t data = 0;
+
+      if (receivePosition < receiveLength) {
+	return receiveBuffer[receivePosition++];
+      }
+
+      receive(&data, 1);
+      return data;
+    }
+
+    /**
+     * Receive a block of data. Returns what is buffered, or reads
+     * the underlying channel once if nothing is buffered.
+     *
+     * @param data where to store the data
+     * @param length the maximum number of bytes to receive
+     * @return the number of bytes received, zero if the transport
+     * closed or, if it is non-blocking, if nothing was available
+     */
+    size_t receive(uint8_t* data, size_t length);
 
     /**
-     * Receive data.
+     * Number of received bytes that are buffered, and can be
+     * received without touching the underlying channel.
      */
-    virtual uint8_t receive(void) = 0;
+    size_t available(void) const {
+      return receiveLength - receivePosition;
+    }
 
     /**
      * Close transport.
@@ -70,15 +186,111 @@ namespace fusenet {
      * @todo Why can't I just say that the destructor should be = 0?
      */
     virtual ~Transport(void);
+
+  protected:
+
+    /**
+     * Send data on the underlying channel.
+     *
+     * @param data the data to send
+     * @param length the number of bytes to send
+     * @return the number of bytes sent, zero on error or if nothing
+     * could be sent without blocking
+     */
+    virtual size_t rawSend(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Receive data from the underlying channel.
+     *
+     * @param data where to store the data
+     * @param length the maximum number of bytes to receive
+     * @return the number of bytes received, zero on error or if
+     * nothing could be received without blocking
+     */
+    virtual size_t rawReceive(uint8_t* data, size_t length) = 0;
+
+    /**
+     * Send part of a file on the underlying channel. The default
+     * implementation reads a block of the file and sends it with
+     * rawSend(), subclasses may override it to send straight from
+     * the file. If the file cannot be read, the transport is closed.
+     *
+     * @param descriptor the file
+     * @param offset where in the file to start
+     * @param length the maximum number of bytes to send
+     * @return the number of bytes sent, zero on error or if nothing
+     * could be sent without blocking
+     */
+    virtual size_t rawSendFile(int descriptor, off_t offset, size_t length);
     
   private:
 
+    /**
+     * Part of a file waiting to be sent.
+     */
+    typedef struct {
+      size_t position;  //!< Send buffer position the file comes after
+      Shared* owner;    //!< Keeps the file open
+      int descriptor;   //!< File
+      off_t offset;     //!< Next byte to send
+      size_t length;    //!< Number of bytes left to send
+    } FileSegment_t;
+
+    /**
+     * Drop everything that waits to be sent.
+     */
+    void clearSendQueue(void);
+
     /**
      * Internal name.
      */
     std::string transportName;
+
+    /**
+     * Data waiting to be sent.
+     */
+    std::vector<uint8_t> sendBuffer;
+
+    /**
+     * Position of the next unsent byte in the send buffer.
+     */
+    size_t sendPosition;
+
+    /**
+     * Parts of files waiting to be sent, in send buffer order.
+     */
+    std::deque<FileSegment_t> files;
+
+    /**
+     * Number of file bytes waiting to be sent.
+     */
+    size_t fileBytes;
+
+    /**
+     * Number of bytes sent or dropped.
+     */
+    size_t dequeued;
+
+    /**
+     * Number of cork() calls not yet undone.
+     */
+    int corks;
+
+    /**
+     * Data received but not yet consumed.
+     */
+    std::vector<uint8_t> receiveBuffer;
+
+    /**
+     * Position of the next unconsumed byte in the receive buffer.
+     */
+    size_t receivePosition;
+
+    /**
+     * Number of valid bytes in the receive buffer.
+     */
+    size_t receiveLength;
   };
 }
 
 #endif
-
@@ -0,0 +1,107 @@
+/**
+ * @file
+ *
+ * This file contains the worker pool implementation.
+ */
+
+#include "log.h"
+#include "network-reactor.h"
+#include "worker-pool.h"
+
+#define PREFIX "[WorkerPool] "
+
+namespace fusenet {
+
+  WorkerPool::WorkerPool(int workers, size_t queueDepth) {
+    this->workers = workers;
+    this->queueDepth = (queueDepth > 0) ? queueDepth : 1;
+    stopping = false;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&notEmpty, NULL);
+    pthread_cond_init(&notFull, NULL);
+  }
+
+  bool WorkerPool::start(void) {
+    int i;
+
+    for (i = 0; i < workers; i++) {
+      pthread_t thread;
+
+      if (pthread_create(&thread, NULL, run, this) != 0) {
+	LOG(LOG_LEVEL_ERROR) << PREFIX << "Unable to start worker thread";
+	break;
+      }
+
+      threads.push_back(thread);
+    }
+
+    LOG(LOG_LEVEL_INFO) << PREFIX << "Started " << threads.size()
+			<< " worker(s), queue depth " << queueDepth;
+    return !threads.empty();
+  }
+
+  void WorkerPool::submit(Job* job, NetworkReactor* reactor) {
+    Entry_t entry = { job, reactor };
+
+    pthread_mutex_lock(&mutex);
+
+    while (queue.size() >= queueDepth) {
+      pthread_cond_wait(&notFull, &mutex);
+    }
+
+    queue.push_back(entry);
+    pthread_cond_signal(&notEmpty);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void* WorkerPool::run(void* argument) {
+    static_cast<WorkerPool*>(argument)->work();
+    return NULL;
+  }
+
+  void WorkerPool::work(void) {
+    Entry_t entry;
+
+    for (;;) {
+      pthread_mutex_lock(&mutex);
+
+      while (queue.empty() && !stopping) {
+	pthread_cond_wait(&notEmpty, &mutex);
+      }
+
+      if (stopping) {
+	pthread_mutex_unlock(&mutex);
+	return;
+      }
+
+      entry = queue.front();
+      queue.pop_front();
+      pthread_cond_signal(&notFull);
+      pthread_mutex_unlock(&mutex);
+
+      entry.job->execute();
+      entry.reactor->post(entry.job);
+    }
+  }
+
+  WorkerPool::~WorkerPool(void) {
+    size_t i;
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&notEmpty);
+    pthread_mutex_unlock(&mutex);
+
+    for (i = 0; i < threads.size(); i++) {
+      pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < queue.size(); i++) {
+      delete queue[i].job;
+    }
+
+    pthread_cond_destroy(&notFull);
+    pthread_cond_destroy(&notEmpty);
+    pthread_mutex_destroy(&mutex);
+  }
+}
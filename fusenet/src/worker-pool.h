@@ -0,0 +1,125 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+/**
+ * @file
+ *
+ * This file contains the worker pool interface.
+ */
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "job.h"
+
+namespace fusenet {
+
+  class NetworkReactor;
+
+  /**
+   * A fixed number of worker threads fed from a bounded queue. This
+   * is the synchronous half of a half-sync/half-async design: the
+   * reactors decode requests and queue them as jobs, the workers
+   * execute the jobs and post them back to the reactor they came
+   * from for completion.
+   */
+  class WorkerPool {
+
+  public:
+
+    /**
+     * Create instance. No threads are started until start() is
+     * called.
+     *
+     * @param workers the number of worker threads
+     * @param queueDepth the maximum number of queued jobs
+     */
+    WorkerPool(int workers, size_t queueDepth);
+
+    /**
+     * Start the worker threads.
+     *
+     * @return false if no thread could be started
+     */
+    bool start(void);
+
+    /**
+     * Queue a job. Blocks while the queue is full, which holds back
+     * the submitting reactor until the workers catch up.
+     *
+     * @param job the job
+     * @param reactor the reactor to complete the job on
+     */
+    void submit(Job* job, NetworkReactor* reactor);
+
+    /**
+     * Stop the workers and destroy instance. Queued jobs that have
+     * not been started are deleted.
+     */
+    ~WorkerPool(void);
+
+  private:
+
+    /**
+     * Queue entry type.
+     */
+    typedef struct {
+      Job* job;                 //!< Job to execute
+      NetworkReactor* reactor;  //!< Reactor to complete it on
+    } Entry_t;
+
+    /**
+     * Thread entry point.
+     */
+    static void* run(void* argument);
+
+    /**
+     * Execute jobs until stopped.
+     */
+    void work(void);
+
+    /**
+     * Number of worker threads to start.
+     */
+    int workers;
+
+    /**
+     * Maximum number of queued jobs.
+     */
+    size_t queueDepth;
+
+    /**
+     * Queued jobs.
+     */
+    std::deque<Entry_t> queue;
+
+    /**
+     * Started threads.
+     */
+    std::vector<pthread_t> threads;
+
+    /**
+     * Set when the workers should stop.
+     */
+    bool stopping;
+
+    /**
+     * Protects the queue and the stopping flag.
+     */
+    pthread_mutex_t mutex;
+
+    /**
+     * Signalled when a job is queued, or when stopping.
+     */
+    pthread_cond_t notEmpty;
+
+    /**
+     * Signalled when a job is taken from the queue.
+     */
+    pthread_cond_t notFull;
+  };
+}
+
+#endif
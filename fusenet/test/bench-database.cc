@@ -0,0 +1,111 @@
+/**
+ * @file
+ *
+ * Measures the memory database under create/delete churn. Every
+ * round creates a batch of short-lived newsgroups with a few
+ * articles each and deletes them again, while a small set of
+ * newsgroups stays alive. The time per round and the time to list
+ * the live newsgroups should stay flat however many newsgroups have
+ * come and gone before.
+ */
+
+#include <sys/time.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "memory-database.h"
+
+using namespace fusenet;
+
+static const int Live = 100;
+static const int Batch = 10000;
+static const int ArticlesPerNewsgroup = 4;
+static const int Lists = 100;
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static std::string Name(int serial) {
+  std::ostringstream name;
+  name << "group." << serial;
+  return name.str();
+}
+
+/**
+ * Creates a newsgroup with a few articles and returns its
+ * identifier, which is the identifier of the last newsgroup in the
+ * list since identifiers are handed out in increasing order.
+ */
+static int Create(Database& database, int serial) {
+  std::string name = Name(serial);
+  NewsgroupList_t newsgroupList;
+  Article_t article;
+  int newsgroupIdentifier;
+  int i;
+
+  if (!IS_SUCCESS(database.createNewsgroup(name))) {
+    std::cerr << "create failed" << std::endl;
+    exit(1);
+  }
+
+  database.getNewsgroupList(newsgroupList);
+  newsgroupIdentifier = newsgroupList.back().id;
+  article.title = "title";
+  article.author = "author";
+  article.text = "text";
+
+  for (i = 0; i < ArticlesPerNewsgroup; i++) {
+    database.createArticle(newsgroupIdentifier, article);
+  }
+
+  return newsgroupIdentifier;
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 10;
+  MemoryDatabase database;
+  int serial = 0;
+  int round;
+  int i;
+
+  for (i = 0; i < Live; i++) {
+    Create(database, serial++);
+  }
+
+  std::cout << "churned\tround\tlist\t(usec per newsgroup, usec per list)"
+	    << std::endl;
+
+  for (round = 0; round < rounds; round++) {
+    NewsgroupList_t newsgroupList;
+    double start = Now();
+    double listed;
+
+    for (i = 0; i < Batch; i++) {
+      int newsgroupIdentifier = Create(database, serial++);
+      ArticleList_t articleList;
+
+      database.deleteArticle(newsgroupIdentifier, 0);
+      database.listArticles(newsgroupIdentifier, articleList);
+      database.deleteNewsgroup(newsgroupIdentifier);
+    }
+
+    listed = Now();
+
+    for (i = 0; i < Lists; i++) {
+      newsgroupList.clear();
+      database.getNewsgroupList(newsgroupList);
+    }
+
+    std::cout << (round + 1) * Batch
+	      << "\t" << (listed - start) / Batch
+	      << "\t" << (Now() - listed) / Lists << std::endl;
+  }
+
+  return 0;
+}
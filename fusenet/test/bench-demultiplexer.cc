@@ -0,0 +1,129 @@
+/**
+ * @file
+ *
+ * Measures the cost of a demultiplexer wakeup as a function of the
+ * number of idle connections. One socket pair is kept active and
+ * the rest are registered but never written to, so the result shows
+ * how much each backend pays for descriptors that are not ready.
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "demultiplexer.h"
+
+using namespace fusenet;
+
+static const int Rounds = 2000;
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/**
+ * Returns the average wakeup time in microseconds, or a negative
+ * value if the connections could not be set up.
+ */
+static double Measure(DemultiplexerType_t type, int idle) {
+  Demultiplexer* demultiplexer = Demultiplexer::create(type);
+  std::vector<int> descriptors;
+  EventList_t eventList;
+  double result = -1;
+  int active[2];
+  int i;
+
+  if (demultiplexer == NULL) {
+    return result;
+  }
+
+  for (i = 0; i < idle; i++) {
+    int pair[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+      break;
+    }
+
+    descriptors.push_back(pair[0]);
+    descriptors.push_back(pair[1]);
+
+    if (!demultiplexer->add(pair[0], EVENT_READ)) {
+      break;
+    }
+  }
+
+  if (i == idle && socketpair(AF_UNIX, SOCK_STREAM, 0, active) == 0) {
+    descriptors.push_back(active[0]);
+    descriptors.push_back(active[1]);
+
+    if (demultiplexer->add(active[0], EVENT_READ)) {
+      double start = Now();
+      char byte = 0;
+
+      for (i = 0; i < Rounds; i++) {
+	if (write(active[1], &byte, 1) != 1 || !demultiplexer->wait(eventList) ||
+	    read(active[0], &byte, 1) != 1) {
+	  break;
+	}
+      }
+
+      if (i == Rounds) {
+	result = (Now() - start) / Rounds;
+      }
+    }
+  }
+
+  for (i = 0; i < static_cast<int>(descriptors.size()); i++) {
+    close(descriptors[i]);
+  }
+
+  delete demultiplexer;
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  const int defaultCounts[] = { 10, 100, 1000, 5000, 10000, 50000 };
+  std::vector<int> counts;
+  size_t i;
+
+  if (argc > 1) {
+    for (i = 1; i < static_cast<size_t>(argc); i++) {
+      counts.push_back(atoi(argv[i]));
+    }
+  } else {
+    counts.assign(defaultCounts, defaultCounts + sizeof(defaultCounts) / sizeof(int));
+  }
+
+  std::cout << "idle\tselect\tepoll\tepoll-et\t(usec per wakeup)" << std::endl;
+
+  for (i = 0; i < counts.size(); i++) {
+    DemultiplexerType_t types[] = { DEMULTIPLEXER_SELECT,
+				    DEMULTIPLEXER_EPOLL,
+				    DEMULTIPLEXER_EPOLL_EDGE };
+    size_t j;
+
+    std::cout << counts[i];
+
+    for (j = 0; j < sizeof(types) / sizeof(types[0]); j++) {
+      double usec = Measure(types[j], counts[i]);
+
+      if (usec < 0) {
+	std::cout << "\t-";
+      } else {
+	std::cout << "\t" << usec;
+      }
+    }
+
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
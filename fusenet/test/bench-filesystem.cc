@@ -0,0 +1,93 @@
+/**
+ * @file
+ *
+ * Measures writing and reading articles of different sizes with the
+ * filesystem database. Every article is written to its own file and
+ * then read back a number of times, so that the reads come from the
+ * page cache and measure the cost of parsing and copying rather than
+ * of the disk.
+ */
+
+#include <sys/time.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "filesystem-database.h"
+
+using namespace fusenet;
+
+static const size_t Sizes[] = { 1024, 64 * 1024, 8 * 1024 * 1024 };
+static const int Bytes = 64 * 1024 * 1024;
+static const int Reads = 4;
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+int main(void) {
+  FilesystemDatabase database;
+  std::string name = "bench";
+  NewsgroupList_t newsgroupList;
+  int newsgroupIdentifier;
+  size_t s;
+
+  database.clear();
+  database.createNewsgroup(name);
+  database.getNewsgroupList(newsgroupList);
+  newsgroupIdentifier = newsgroupList.back().id;
+
+  std::cout << "size\twrite\tread\t(usec per article)" << std::endl;
+
+  for (s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++) {
+    int count = Bytes / Sizes[s] < 1000 ? Bytes / Sizes[s] : 1000;
+    ArticleList_t articleList;
+    Article_t article;
+    double start;
+    double written;
+    int i;
+    int j;
+
+    article.title = "title";
+    article.author = "author";
+    article.text = std::string(Sizes[s], 'x');
+
+    start = Now();
+
+    for (i = 0; i < count; i++) {
+      if (!IS_SUCCESS(database.createArticle(newsgroupIdentifier, article))) {
+	std::cerr << "create failed" << std::endl;
+	exit(1);
+      }
+    }
+
+    written = Now();
+
+    for (j = 0; j < Reads; j++) {
+      for (i = 0; i < count; i++) {
+	if (!IS_SUCCESS(database.getArticle(newsgroupIdentifier, i, article)) ||
+	    article.text.size() != Sizes[s]) {
+	  std::cerr << "get failed" << std::endl;
+	  exit(1);
+	}
+      }
+    }
+
+    std::cout << Sizes[s]
+	      << "\t" << (written - start) / count
+	      << "\t" << (Now() - written) / count / Reads << std::endl;
+
+    // Start over, so that identifiers are 0 .. count - 1 again
+    database.deleteNewsgroup(newsgroupIdentifier);
+    database.createNewsgroup(name);
+    newsgroupList.clear();
+    database.getNewsgroupList(newsgroupList);
+    newsgroupIdentifier = newsgroupList.back().id;
+  }
+
+  database.clear();
+  return 0;
+}
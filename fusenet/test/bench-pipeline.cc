@@ -0,0 +1,244 @@
+/**
+ * @file
+ *
+ * Measures pipelined requests over loopback. A server with a memory
+ * database runs on a thread of its own, and a client gets the same
+ * article over and over, sending a window of requests at a time and
+ * the next window once all replies are in. A window of one is the
+ * old request/reply behaviour. The server logs at LOG_LEVEL, warning by
+ * default, through the background log thread.
+ *
+ * usage: bench-pipeline [ PORT [ WORKERS [ LOG_LEVEL ] ] ]
+ */
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "client-protocol.h"
+#include "log.h"
+#include "memory-database.h"
+#include "network-reactor.h"
+#include "newsgroup-list-cache.h"
+#include "protocol-creator.h"
+#include "server-creator.h"
+#include "statistics.h"
+#include "subscriber-registry.h"
+#include "synchronized-database.h"
+#include "worker-pool.h"
+
+using namespace fusenet;
+
+static const int Depths[] = { 1, 8, 64 };
+static const double Seconds = 2;
+static const size_t TextSize = 1024;
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * What the server thread needs.
+ */
+typedef struct {
+  int port;
+  Database* database;
+  NewsgroupListCache* cache;
+  SubscriberRegistry* registry;
+  Statistics* statistics;
+  WorkerPool* workerPool;
+} ServerThread_t;
+
+static void* Serve(void* argument) {
+  ServerThread_t* server = static_cast<ServerThread_t*>(argument);
+  NetworkReactor reactor;
+  ServerCreator creator(server->database, server->cache, server->registry,
+			server->statistics, server->workerPool, &reactor);
+
+  reactor.serve(server->port, &creator);
+  return NULL;
+}
+
+/**
+ * Outcome of one run.
+ */
+typedef struct {
+  long replies;
+  long failures;
+  double elapsed;
+} Result_t;
+
+/**
+ * Client that keeps getting one article, a window at a time.
+ */
+class BenchClient : public ClientProtocol {
+public:
+  BenchClient(Transport* transport, int depth, int newsgroup, int article,
+	      Result_t* result) :
+    ClientProtocol(transport), depth(depth), newsgroupIdentifier(newsgroup),
+    articleIdentifier(article), result(result) { }
+
+  void onConnectionMade(void) {
+    start = Now();
+    sendWindow();
+  }
+
+  void onGetArticle(Status_t status, Article_t& article) {
+    result->replies++;
+
+    if (!IS_SUCCESS(status) || article.text.size() != TextSize) {
+      result->failures++;
+    }
+
+    if (getOutstanding() > 0) {
+      return;
+    }
+
+    if (Now() - start < Seconds) {
+      sendWindow();
+    } else {
+      result->elapsed = Now() - start;
+      transport->close();
+    }
+  }
+
+  void onListNewsgroups(Status_t, NewsgroupList_t&) { }
+  void onCreateNewsgroup(Status_t) { }
+  void onDeleteNewsgroup(Status_t) { }
+  void onListArticles(Status_t, ArticleList_t&) { }
+  void onListArticlePage(Status_t, ArticleList_t&, int) { }
+  void onCreateArticle(Status_t) { }
+  void onDeleteArticle(Status_t) { }
+  void onGetArticles(Status_t, ArticleList_t&, StatusList_t&) { }
+  void onListNewsgroupsIfModified(Status_t, Version_t, NewsgroupList_t&) { }
+  void onListArticlesIfModified(Status_t, Version_t, ArticleList_t&) { }
+  void onSubscribe(Status_t) { }
+  void onUnsubscribe(Status_t) { }
+  void onStatistics(std::string&) { }
+  void onNewArticle(int, int, std::string&) { }
+  void onArticleDeleted(int, int) { }
+  void onConnectionLost(void) { }
+
+private:
+  void sendWindow(void) {
+    int i;
+
+    beginPipeline();
+
+    for (i = 0; i < depth; i++) {
+      getArticle(newsgroupIdentifier, articleIdentifier);
+    }
+
+    endPipeline();
+  }
+
+  int depth;
+  int newsgroupIdentifier;
+  int articleIdentifier;
+  Result_t* result;
+  double start;
+};
+
+/**
+ * Hands out the bench client.
+ */
+class BenchCreator : public ProtocolCreator {
+public:
+  BenchCreator(int depth, int newsgroup, int article, Result_t* result) :
+    depth(depth), newsgroup(newsgroup), article(article), result(result) { }
+
+  Protocol* create(Transport* const transport) const {
+    return new BenchClient(transport, depth, newsgroup, article, result);
+  }
+
+private:
+  int depth;
+  int newsgroup;
+  int article;
+  Result_t* result;
+};
+
+int main(int argc, char* argv[]) {
+  MemoryDatabase memoryDatabase;
+  SynchronizedDatabase synchronizedDatabase(&memoryDatabase);
+  NewsgroupListCache cache;
+  SubscriberRegistry registry;
+  Statistics statistics;
+  WorkerPool workerPool(argc > 2 ? atoi(argv[2]) : 0, 1024);
+  ServerThread_t server;
+  NewsgroupList_t newsgroupList;
+  ArticleHeaderList_t headerList;
+  std::string name = "bench";
+  std::streambuf* output = std::cout.rdbuf();
+  std::ostream results(output);
+  pthread_t thread;
+  LogLevel_t level = LOG_LEVEL_WARNING;
+  Article_t article;
+  size_t i;
+
+  memoryDatabase.createNewsgroup(name);
+  memoryDatabase.getNewsgroupList(newsgroupList);
+  article.title = "title";
+  article.author = "author";
+  article.text = std::string(TextSize, 'x');
+  memoryDatabase.createArticle(newsgroupList[0].id, article);
+  memoryDatabase.listArticleHeaders(newsgroupList[0].id, headerList);
+
+  server.port = argc > 1 ? atoi(argv[1]) : 4712;
+  server.database = &memoryDatabase;
+  server.cache = &cache;
+  server.registry = &registry;
+  server.statistics = &statistics;
+  server.workerPool = NULL;
+
+  if (argc > 2 && atoi(argv[2]) > 0 && workerPool.start()) {
+    server.database = &synchronizedDatabase;
+    server.workerPool = &workerPool;
+  }
+
+  if (argc > 3 && !Log::parseLevel(argv[3], level)) {
+    results << "Unknown log level " << argv[3] << std::endl;
+    _exit(1);
+  }
+
+  Log::setLevel(level);
+  Log::start();
+
+  // The client prints every reply, only the results are of interest
+  // here
+  std::cout.rdbuf(NULL);
+
+  if (pthread_create(&thread, NULL, Serve, &server) != 0) {
+    results << "Unable to start server thread" << std::endl;
+    _exit(1);
+  }
+
+  usleep(200000);
+
+  for (i = 0; i < sizeof(Depths) / sizeof(Depths[0]); i++) {
+    Result_t result = { 0, 0, 0 };
+    BenchCreator creator(Depths[i], newsgroupList[0].id, headerList[0].id, &result);
+    NetworkReactor reactor;
+
+    reactor.initiate("127.0.0.1", server.port, &creator);
+
+    if (result.elapsed == 0) {
+      results << "Unable to connect" << std::endl;
+      _exit(1);
+    }
+
+    results << "depth " << Depths[i] << ": "
+	    << static_cast<long>(result.replies / result.elapsed)
+	    << " req/s, " << result.failures << " failures" << std::endl;
+  }
+
+  // The server thread never returns
+  std::cout.rdbuf(output);
+  _exit(0);
+}
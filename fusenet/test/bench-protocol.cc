@@ -0,0 +1,102 @@
+/**
+ * @file
+ *
+ * Measures encoding replies. A server protocol replies to a listing
+ * of many articles over a transport that throws the data away, so
+ * that only the time spent encoding the reply and handing it to the
+ * transport is measured.
+ */
+
+#include <sys/time.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "server-protocol.h"
+#include "transport.h"
+
+using namespace fusenet;
+
+static const int Articles = 10000;
+static const int Replies = 200;
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/**
+ * Transport that accepts and forgets everything.
+ */
+class NullTransport : public Transport {
+public:
+  NullTransport(void) : sent(0) { }
+  void close(void) { }
+  bool isClosed(void) const { return false; }
+  size_t sent;
+protected:
+  size_t rawSend(const uint8_t*, size_t length) { sent += length; return length; }
+  size_t rawReceive(uint8_t*, size_t) { return 0; }
+};
+
+/**
+ * Server protocol that only replies.
+ */
+class BenchProtocol : public ServerProtocol {
+public:
+  BenchProtocol(Transport* transport) : ServerProtocol(transport) { }
+  void onListNewsgroups(void) { }
+  void onCreateNewsgroup(std::string&) { }
+  void onDeleteNewsgroup(int) { }
+  void onListArticles(int) { }
+  void onCreateArticle(int, Article_t&) { }
+  void onDeleteArticle(int, int) { }
+  void onGetArticle(int, int) { }
+  void onGetArticles(int, IdentifierList_t&) { }
+  void onListArticlePage(int, int, int, int) { }
+  void onListNewsgroupsIfModified(Version_t) { }
+  void onListArticlesIfModified(int, Version_t) { }
+  void onSubscribe(int) { }
+  void onUnsubscribe(int) { }
+  void onStatistics(void) { }
+  void onConnectionMade(void) { }
+  void onConnectionLost(void) { }
+};
+
+int main(void) {
+  NullTransport transport;
+  BenchProtocol protocol(&transport);
+  ArticleHeaderList_t headerList;
+  double start;
+  double elapsed;
+  int i;
+
+  for (i = 0; i < Articles; i++) {
+    std::ostringstream title;
+    ArticleHeader_t header;
+
+    title << "Article number " << i;
+    header.id = i;
+    header.title = title.str();
+    header.author = "author";
+    header.size = 100;
+    headerList.push_back(header);
+  }
+
+  start = Now();
+
+  for (i = 0; i < Replies; i++) {
+    protocol.replyListArticles(STATUS_SUCCESS, headerList);
+  }
+
+  elapsed = Now() - start;
+
+  std::cout << Articles << " articles, "
+	    << transport.sent / Replies << " bytes per reply: "
+	    << elapsed / Replies << " usec per reply, "
+	    << transport.sent / elapsed << " MB/s" << std::endl;
+  return 0;
+}
@@ -11,21 +11,63 @@
 #include <cppunit/TestSuite.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
 #include "fusenet-types.h"
+#include "journal.h"
 #include "memory-database.h"
 #include "filesystem-database.h"
+#include "segment-database.h"
+#include "synchronized-database.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace fusenet;
 
 static bool UseMemoryDatabase = false;
+static bool UseSegmentDatabase = false;
+static bool UseJournal = false;
+
+static Database* ReopenDatabase(void) {
+  if (UseMemoryDatabase && UseJournal) {
+    // Tiny snapshots, so that the tests take a few of them
+    return new MemoryDatabase(new Journal("wal", SYNC_NONE, 0, 4096));
+  } else if (UseMemoryDatabase) {
+    return NULL;
+  } else if (UseSegmentDatabase) {
+    return new SegmentDatabase();
+  } else {
+    // Syncs on commit with a short window, so that concurrent commits
+    // are grouped
+    return new FilesystemDatabase(SYNC_INTERVAL, 1);
+  }
+}
 
 static Database* MakeDatabase(void) {
-  if (UseMemoryDatabase) {
+  if (UseMemoryDatabase && UseJournal) {
+    CPPUNIT_ASSERT(system("rm -rf wal") == 0);
+    return ReopenDatabase();
+  } else if (UseMemoryDatabase) {
     return new MemoryDatabase();
+  } else if (UseSegmentDatabase) {
+    SegmentDatabase* pDatabase = new SegmentDatabase();
+    if (pDatabase != NULL) {
+      pDatabase->clear();
+    }
+    return pDatabase;
   } else {
-    FilesystemDatabase* pDatabase = new FilesystemDatabase();
+    FilesystemDatabase* pDatabase = new FilesystemDatabase(SYNC_INTERVAL, 1);
     if (pDatabase != NULL) {
       pDatabase->clear();
+      pDatabase->setFileThreshold(64 * 1024);
     }
     return pDatabase;
   }
@@ -114,6 +156,7 @@ class ListNewsgroupsTest : public NewsgroupTestFixture {
   CPPUNIT_TEST_SUITE(ListNewsgroupsTest);
   CPPUNIT_TEST(testEmpty);
   CPPUNIT_TEST(testNonEmpty);
+  CPPUNIT_TEST(testCheck);
   CPPUNIT_TEST_SUITE_END();
 public:
   void testEmpty() {
@@ -130,6 +173,19 @@ public:
     CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
     CPPUNIT_ASSERT(newsgroupList.size() == 1);
   }
+  void testCheck() {
+    NewsgroupList_t newsgroupList;
+    std::string name("foo");
+    CPPUNIT_ASSERT(pDatabase->checkNewsgroup(0) == STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createNewsgroup(name)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->checkNewsgroup(newsgroupList[0].id)));
+    CPPUNIT_ASSERT(pDatabase->checkNewsgroup(newsgroupList[0].id + 1) ==
+		   STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteNewsgroup(newsgroupList[0].id)));
+    CPPUNIT_ASSERT(pDatabase->checkNewsgroup(newsgroupList[0].id) ==
+		   STATUS_FAILURE_N_DOES_NOT_EXIST);
+  }
 };
 
 class DeleteNewsgroupTest : public NewsgroupTestFixture {
@@ -221,6 +277,7 @@ public:
     CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
     CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
     CPPUNIT_ASSERT(articleList.size() == 1);
+    CPPUNIT_ASSERT(article.id == articleList[0].id);
   }
   void testIncrement() {
     Article_t article;
@@ -251,15 +308,100 @@ class ListArticlesTest : public ArticleTestFixture {
   CPPUNIT_TEST_SUITE(ListArticlesTest);
   CPPUNIT_TEST(testNonExistant);
   CPPUNIT_TEST(testEmpty);
+  CPPUNIT_TEST(testHeaders);
+  CPPUNIT_TEST(testPages);
   CPPUNIT_TEST_SUITE_END();
 public:
   void testNonExistant() {
     ArticleList_t articleList;
+    ArticleHeaderList_t headerList;
     CPPUNIT_ASSERT(pDatabase->listArticles(newsgroup.id + 1, articleList) == STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(pDatabase->listArticleHeaders(newsgroup.id + 1, headerList) == STATUS_FAILURE_N_DOES_NOT_EXIST);
   }
   void testEmpty() {
     ArticleList_t articleList;
+    ArticleHeaderList_t headerList;
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticleHeaders(newsgroup.id, headerList)));
+    CPPUNIT_ASSERT(headerList.size() == 0);
+  }
+  void testHeaders() {
+    Article_t article;
+    ArticleList_t articleList;
+    ArticleHeaderList_t headerList;
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...\nis watching you";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
     CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticleHeaders(newsgroup.id, headerList)));
+    CPPUNIT_ASSERT(headerList.size() == 1);
+    CPPUNIT_ASSERT(headerList[0].id == articleList[0].id);
+    CPPUNIT_ASSERT(headerList[0].title == "1984");
+    CPPUNIT_ASSERT(headerList[0].author == "George Orwell");
+    CPPUNIT_ASSERT(headerList[0].size == article.text.size());
+  }
+  void testPages() {
+    Article_t article;
+    ArticleHeaderList_t headerList;
+    ArticleHeaderList_t page;
+    std::vector<int> live;
+    int cursor;
+    int i;
+    CPPUNIT_ASSERT(pDatabase->listArticlePage(newsgroup.id + 1, CURSOR_NONE, LIST_FORWARD, 2, page, cursor) == STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, CURSOR_NONE, LIST_FORWARD, 2, page, cursor)));
+    CPPUNIT_ASSERT(page.empty() && cursor == CURSOR_NONE);
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    for (i = 0; i < 7; i++) {
+      article.title = std::string(1, 'a' + i);
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    }
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticleHeaders(newsgroup.id, headerList)));
+    for (i = 0; i < 7; i++) {
+      live.push_back(headerList[i].id);
+    }
+    std::sort(live.begin(), live.end());
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, live[3])));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, live[6])));
+    live.erase(live.begin() + 6);
+    live.erase(live.begin() + 3);
+    // Oldest first, two at a time
+    cursor = CURSOR_NONE;
+    headerList.clear();
+    do {
+      page.clear();
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, cursor, LIST_FORWARD, 2, page, cursor)));
+      CPPUNIT_ASSERT(page.size() == 2 || (page.size() == 1 && cursor == CURSOR_NONE));
+      headerList.insert(headerList.end(), page.begin(), page.end());
+    } while (cursor != CURSOR_NONE);
+    CPPUNIT_ASSERT(headerList.size() == live.size());
+    for (i = 0; i < 5; i++) {
+      CPPUNIT_ASSERT(headerList[i].id == live[i]);
+    }
+    CPPUNIT_ASSERT(headerList[0].title == "a" && headerList[0].author == "George Orwell");
+    // Newest first, the last page full
+    cursor = CURSOR_NONE;
+    headerList.clear();
+    do {
+      page.clear();
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, cursor, LIST_BACKWARD, 5, page, cursor)));
+      headerList.insert(headerList.end(), page.begin(), page.end());
+    } while (cursor != CURSOR_NONE);
+    CPPUNIT_ASSERT(headerList.size() == live.size());
+    for (i = 0; i < 5; i++) {
+      CPPUNIT_ASSERT(headerList[i].id == live[4 - i]);
+    }
+    // Cursors need not be articles
+    page.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, live[4] + 1, LIST_BACKWARD, 1, page, cursor)));
+    CPPUNIT_ASSERT(page.size() == 1 && page[0].id == live[4] && cursor == live[4]);
+    page.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, live[2] + 1, LIST_FORWARD, 10, page, cursor)));
+    CPPUNIT_ASSERT(page.size() == 2 && page[0].id == live[3] && cursor == CURSOR_NONE);
+    page.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticlePage(newsgroup.id, live[4], LIST_FORWARD, 10, page, cursor)));
+    CPPUNIT_ASSERT(page.empty() && cursor == CURSOR_NONE);
   }
 };
 
@@ -295,6 +437,9 @@ class GetArticleTest : public ArticleTestFixture {
   CPPUNIT_TEST(testWrongNewsgroup);
   CPPUNIT_TEST(testWrongArticle);
   CPPUNIT_TEST(testRight);
+  CPPUNIT_TEST(testLarge);
+  CPPUNIT_TEST(testRef);
+  CPPUNIT_TEST(testMany);
   CPPUNIT_TEST_SUITE_END();
 public:
   void testWrongNewsgroup() {
@@ -320,6 +465,400 @@ public:
     CPPUNIT_ASSERT(article.author == "George Orwell");
     CPPUNIT_ASSERT(article.text == "Big brother ...");
   }
+  void testLarge() {
+    Article_t article;
+    ArticleList_t articleList;
+    ArticleRef ref;
+    std::string text;
+    // Leading white space and a text large enough to be mapped
+    text = "\n  Big brother ...\n" + std::string(256 * 1024, 'x') + "\n";
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = text;
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 1);
+    article = articleList.front();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getArticle(newsgroup.id, article.id, article)));
+    CPPUNIT_ASSERT(article.title == "1984");
+    CPPUNIT_ASSERT(article.author == "George Orwell");
+    CPPUNIT_ASSERT(article.text == text);
+    // The text may be left in the file
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getArticleRef(newsgroup.id, article.id, ref)));
+    CPPUNIT_ASSERT(std::string(ref.getTitle(), ref.getTitleSize()) == "1984");
+    CPPUNIT_ASSERT(ref.getTextSize() == text.size());
+    if (ref.getTextDescriptor() != -1) {
+      std::string stored(ref.getTextSize(), '\0');
+      CPPUNIT_ASSERT(pread(ref.getTextDescriptor(), &stored[0], stored.size(),
+			   ref.getTextOffset()) == static_cast<ssize_t>(stored.size()));
+      CPPUNIT_ASSERT(stored == text);
+    } else {
+      CPPUNIT_ASSERT(std::string(ref.getText(), ref.getTextSize()) == text);
+    }
+  }
+  void testRef() {
+    Article_t article;
+    ArticleList_t articleList;
+    ArticleRef ref;
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    CPPUNIT_ASSERT(pDatabase->getArticleRef(newsgroup.id, 0, ref) == STATUS_FAILURE_A_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    article = articleList.front();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getArticleRef(newsgroup.id, article.id, ref)));
+    // The reference outlives the article and its newsgroup
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteNewsgroup(newsgroup.id)));
+    CPPUNIT_ASSERT(ref.getIdentifier() == article.id);
+    CPPUNIT_ASSERT(std::string(ref.getTitle(), ref.getTitleSize()) == "1984");
+    CPPUNIT_ASSERT(std::string(ref.getAuthor(), ref.getAuthorSize()) == "George Orwell");
+    CPPUNIT_ASSERT(std::string(ref.getText(), ref.getTextSize()) == "Big brother ...");
+  }
+  void testMany() {
+    Article_t article;
+    ArticleList_t articleList;
+    IdentifierList_t identifiers;
+    ArticleRefList_t refs;
+    StatusList_t statuses;
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    article.text = std::string(128 * 1024, 'x');
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 2);
+    identifiers.push_back(articleList[1].id);
+    identifiers.push_back(articleList[0].id + articleList[1].id + 1);
+    identifiers.push_back(articleList[0].id);
+    CPPUNIT_ASSERT(pDatabase->getArticleRefs(newsgroup.id + 1, identifiers, refs, statuses) ==
+		   STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getArticleRefs(newsgroup.id, identifiers, refs, statuses)));
+    CPPUNIT_ASSERT(refs.size() == 3 && statuses.size() == 3);
+    CPPUNIT_ASSERT(IS_SUCCESS(statuses[0]) && IS_SUCCESS(statuses[2]));
+    CPPUNIT_ASSERT(statuses[1] == STATUS_FAILURE_A_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(refs[0].getIdentifier() == articleList[1].id);
+    CPPUNIT_ASSERT(refs[2].getIdentifier() == articleList[0].id);
+    CPPUNIT_ASSERT(std::string(refs[0].getTitle(), refs[0].getTitleSize()) == "1984");
+    CPPUNIT_ASSERT(refs[0].getTextSize() + refs[2].getTextSize() == 128 * 1024 + 15);
+    identifiers.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getArticleRefs(newsgroup.id, identifiers, refs, statuses)));
+    CPPUNIT_ASSERT(refs.empty() && statuses.empty());
+    CPPUNIT_ASSERT(pDatabase->getArticleRefs(newsgroup.id + 1, identifiers, refs, statuses) ==
+		   STATUS_FAILURE_N_DOES_NOT_EXIST);
+  }
+};
+
+class RecoveryTest : public ArticleTestFixture {
+  CPPUNIT_TEST_SUITE(RecoveryTest);
+  CPPUNIT_TEST(testReopen);
+  CPPUNIT_TEST(testCommit);
+  CPPUNIT_TEST(testTornAppend);
+  CPPUNIT_TEST(testTornTombstone);
+  CPPUNIT_TEST(testDamagedSnapshot);
+  CPPUNIT_TEST_SUITE_END();
+  typedef struct {
+    Database* database;
+    int newsgroupIdentifier;
+    int failures;
+  } Writer_t;
+  static void* write(void* argument) {
+    Writer_t* writer = static_cast<Writer_t*>(argument);
+    Article_t article;
+    int i;
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    for (i = 0; i < 25; i++) {
+      if (!IS_SUCCESS(writer->database->createArticle(writer->newsgroupIdentifier, article)) ||
+	  !IS_SUCCESS(writer->database->commit())) {
+	writer->failures++;
+      }
+    }
+    return NULL;
+  }
+public:
+  void testReopen() {
+    Article_t article;
+    ArticleList_t articleList;
+    NewsgroupList_t newsgroupList;
+    std::string name("bar");
+    int i;
+    if (UseMemoryDatabase && !UseJournal) {
+      return;
+    }
+    article.title = "1984";
+    article.author = "George Orwell";
+    for (i = 0; i < 100; i++) {
+      article.text = std::string(i * 10, 'x');
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    }
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    // Delete the article without text, wherever it is listed
+    i = 0;
+    while (articleList[i].text.size() > 0) {
+      i++;
+    }
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, articleList[i].id)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createNewsgroup(name)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteNewsgroup(newsgroupList.back().id)));
+    delete pDatabase;
+    pDatabase = ReopenDatabase();
+    CPPUNIT_ASSERT(pDatabase != NULL);
+    newsgroupList.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
+    CPPUNIT_ASSERT(newsgroupList.size() == 1);
+    CPPUNIT_ASSERT(newsgroupList[0].id == newsgroup.id);
+    CPPUNIT_ASSERT(newsgroupList[0].name == "foo");
+    articleList.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 99);
+    for (i = 0; i < 99; i++) {
+      CPPUNIT_ASSERT(articleList[i].title == "1984");
+      CPPUNIT_ASSERT(articleList[i].text == std::string(articleList[i].text.size(), 'x'));
+      CPPUNIT_ASSERT(articleList[i].text.size() > 0);
+    }
+  }
+  void testCommit() {
+    SynchronizedDatabase database(pDatabase);
+    pthread_t threads[4];
+    Writer_t writers[4];
+    ArticleList_t articleList;
+    int i;
+    for (i = 0; i < 4; i++) {
+      writers[i].database = &database;
+      writers[i].newsgroupIdentifier = newsgroup.id;
+      writers[i].failures = 0;
+      CPPUNIT_ASSERT(pthread_create(&threads[i], NULL, write, &writers[i]) == 0);
+    }
+    for (i = 0; i < 4; i++) {
+      pthread_join(threads[i], NULL);
+      CPPUNIT_ASSERT(writers[i].failures == 0);
+    }
+    CPPUNIT_ASSERT(IS_SUCCESS(database.commit()));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 100);
+  }
+  void testTornAppend() {
+    Article_t article;
+    ArticleList_t articleList;
+    struct rlimit limit;
+    struct rlimit saved;
+    struct stat status;
+    if (!UseMemoryDatabase || !UseJournal) {
+      return;
+    }
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    // Let the log grow by only part of the next record
+    CPPUNIT_ASSERT(stat("wal/log.0", &status) == 0);
+    CPPUNIT_ASSERT(getrlimit(RLIMIT_FSIZE, &saved) == 0);
+    limit = saved;
+    limit.rlim_cur = status.st_size + 100;
+    signal(SIGXFSZ, SIG_IGN);
+    CPPUNIT_ASSERT(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+    article.text = std::string(1000, 'x');
+    CPPUNIT_ASSERT(pDatabase->createArticle(newsgroup.id, article) == STATUS_FAILURE);
+    CPPUNIT_ASSERT(setrlimit(RLIMIT_FSIZE, &saved) == 0);
+    signal(SIGXFSZ, SIG_DFL);
+    // The failed change is gone, and the one after it is kept
+    article.text = "War is peace";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    delete pDatabase;
+    pDatabase = ReopenDatabase();
+    CPPUNIT_ASSERT(pDatabase != NULL);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 2);
+    CPPUNIT_ASSERT(articleList[0].text == "Big brother ...");
+    CPPUNIT_ASSERT(articleList[1].text == "War is peace");
+    CPPUNIT_ASSERT(articleList[1].id == articleList[0].id + 1);
+  }
+  void testTornTombstone() {
+    Article_t article;
+    ArticleList_t articleList;
+    std::ostringstream path;
+    struct stat status;
+    char checksum;
+    int fd;
+    if (!UseSegmentDatabase) {
+      return;
+    }
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, articleList[0].id)));
+    delete pDatabase;
+    pDatabase = NULL;
+    // Tear the tombstone, the last record of the log, so that only
+    // its checksum gives it away
+    path << "seg/" << newsgroup.id << ".log";
+    CPPUNIT_ASSERT(stat(path.str().c_str(), &status) == 0);
+    fd = open(path.str().c_str(), O_RDWR);
+    CPPUNIT_ASSERT(fd != -1);
+    CPPUNIT_ASSERT(pread(fd, &checksum, 1, status.st_size - 8) == 1);
+    checksum ^= 0xff;
+    CPPUNIT_ASSERT(pwrite(fd, &checksum, 1, status.st_size - 8) == 1);
+    close(fd);
+    // The article is back, and stays back
+    pDatabase = ReopenDatabase();
+    CPPUNIT_ASSERT(pDatabase != NULL);
+    articleList.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 2);
+    delete pDatabase;
+    pDatabase = ReopenDatabase();
+    CPPUNIT_ASSERT(pDatabase != NULL);
+    articleList.clear();
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(articleList.size() == 2);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, articleList[0].id)));
+  }
+  void testDamagedSnapshot() {
+    Article_t article;
+    ArticleList_t articleList;
+    NewsgroupList_t newsgroupList;
+    MemoryDatabase* database;
+    std::string snapshot;
+    std::string name("bar");
+    struct dirent* entry;
+    struct stat status;
+    DIR* dir;
+    int fd;
+    int i;
+    if (!UseMemoryDatabase || !UseJournal) {
+      return;
+    }
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = std::string(1000, 'x');
+    for (i = 0; i < 10; i++) {
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    }
+    delete pDatabase;
+    pDatabase = NULL;
+    // Damage the middle of the snapshot
+    dir = opendir("wal");
+    CPPUNIT_ASSERT(dir != NULL);
+    while ((entry = readdir(dir)) != NULL) {
+      if (strncmp(entry->d_name, "snapshot.", 9) == 0) {
+	snapshot = std::string("wal/") + entry->d_name;
+      }
+    }
+    closedir(dir);
+    CPPUNIT_ASSERT(!snapshot.empty());
+    CPPUNIT_ASSERT(stat(snapshot.c_str(), &status) == 0);
+    fd = open(snapshot.c_str(), O_WRONLY);
+    CPPUNIT_ASSERT(fd != -1);
+    CPPUNIT_ASSERT(pwrite(fd, "garbage", 7, status.st_size / 2) == 7);
+    close(fd);
+    // Nothing is served, and no change is taken
+    database = new MemoryDatabase(new Journal("wal", SYNC_NONE, 0, 4096));
+    pDatabase = database;
+    CPPUNIT_ASSERT(!database->isRecovered());
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
+    CPPUNIT_ASSERT(newsgroupList.empty());
+    CPPUNIT_ASSERT(pDatabase->listArticles(newsgroup.id, articleList) == STATUS_FAILURE_N_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(pDatabase->createNewsgroup(name) == STATUS_FAILURE);
+    CPPUNIT_ASSERT(pDatabase->createArticle(newsgroup.id, article) == STATUS_FAILURE);
+    CPPUNIT_ASSERT(pDatabase->deleteNewsgroup(newsgroup.id) == STATUS_FAILURE);
+    // The journal is left as it was
+    CPPUNIT_ASSERT(stat(snapshot.c_str(), &status) == 0);
+  }
+};
+
+class VersionTest : public ArticleTestFixture {
+  CPPUNIT_TEST_SUITE(VersionTest);
+  CPPUNIT_TEST(testChanges);
+  CPPUNIT_TEST(testReopen);
+  CPPUNIT_TEST_SUITE_END();
+  Version_t listVersion() {
+    Version_t version;
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupListVersion(version)));
+    return version;
+  }
+  Version_t newsgroupVersion() {
+    Version_t version;
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupVersion(newsgroup.id, version)));
+    return version;
+  }
+public:
+  void testChanges() {
+    std::vector<Version_t> seen;
+    ArticleList_t articleList;
+    NewsgroupList_t newsgroupList;
+    Article_t article;
+    Version_t version;
+    std::string name("bar");
+    int i;
+    if (newsgroupVersion() == VERSION_NONE) {
+      return;
+    }
+    CPPUNIT_ASSERT(pDatabase->getNewsgroupVersion(newsgroup.id + 1, version) == STATUS_FAILURE_N_DOES_NOT_EXIST);
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    seen.push_back(newsgroupVersion());
+    for (i = 0; i < 10; i++) {
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+      seen.push_back(newsgroupVersion());
+    }
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(newsgroupVersion() == seen.back());
+    for (i = 0; i < 5; i++) {
+      CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, articleList[i].id)));
+      seen.push_back(newsgroupVersion());
+    }
+    CPPUNIT_ASSERT(pDatabase->deleteArticle(newsgroup.id, articleList[0].id) == STATUS_FAILURE_A_DOES_NOT_EXIST);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    seen.push_back(newsgroupVersion());
+    std::sort(seen.begin(), seen.end());
+    CPPUNIT_ASSERT(std::unique(seen.begin(), seen.end()) == seen.end());
+    seen.clear();
+    seen.push_back(listVersion());
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createNewsgroup(name)));
+    seen.push_back(listVersion());
+    CPPUNIT_ASSERT(pDatabase->createNewsgroup(name) == STATUS_FAILURE_ALREADY_EXISTS);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->getNewsgroupList(newsgroupList)));
+    CPPUNIT_ASSERT(listVersion() == seen.back());
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteNewsgroup(newsgroupList.back().id)));
+    seen.push_back(listVersion());
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createNewsgroup(name)));
+    seen.push_back(listVersion());
+    std::sort(seen.begin(), seen.end());
+    CPPUNIT_ASSERT(std::unique(seen.begin(), seen.end()) == seen.end());
+  }
+  void testReopen() {
+    ArticleList_t articleList;
+    Article_t article;
+    Version_t before;
+    Version_t beforeList;
+    if (newsgroupVersion() == VERSION_NONE || (UseMemoryDatabase && !UseJournal)) {
+      return;
+    }
+    article.title = "1984";
+    article.author = "George Orwell";
+    article.text = "Big brother ...";
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->listArticles(newsgroup.id, articleList)));
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->deleteArticle(newsgroup.id, articleList[0].id)));
+    before = newsgroupVersion();
+    beforeList = listVersion();
+    delete pDatabase;
+    pDatabase = ReopenDatabase();
+    CPPUNIT_ASSERT(pDatabase != NULL);
+    CPPUNIT_ASSERT(newsgroupVersion() == before);
+    CPPUNIT_ASSERT(listVersion() == beforeList);
+    CPPUNIT_ASSERT(IS_SUCCESS(pDatabase->createArticle(newsgroup.id, article)));
+    CPPUNIT_ASSERT(newsgroupVersion() != before);
+  }
 };
 
 int main(int argc, char* argv[])
@@ -335,12 +874,19 @@ int main(int argc, char* argv[])
     } else if (strcmp("fs", argv[1]) == 0) {
       std::cout << "Using filesystem database" << std::endl;
       UseMemoryDatabase = false;
+    } else if (strcmp("seg", argv[1]) == 0) {
+      std::cout << "Using segment database" << std::endl;
+      UseSegmentDatabase = true;
+    } else if (strcmp("wal", argv[1]) == 0) {
+      std::cout << "Using memory database with a journal" << std::endl;
+      UseMemoryDatabase = true;
+      UseJournal = true;
     } else {
-      std::cerr << "usage: test-database [ mem | fs ]" << std::endl;
+      std::cerr << "usage: test-database [ mem | fs | seg | wal ]" << std::endl;
       return 1;
     }
   } else {
-    std::cerr << "usage: test-database [ mem | fs ]" << std::endl;
+    std::cerr << "usage: test-database [ mem | fs | seg | wal ]" << std::endl;
     return 1;
   }
 
@@ -352,6 +898,8 @@ int main(int argc, char* argv[])
   CPPUNIT_TEST_SUITE_REGISTRATION(ListArticlesTest);
   CPPUNIT_TEST_SUITE_REGISTRATION(DeleteArticleTest);
   CPPUNIT_TEST_SUITE_REGISTRATION(GetArticleTest);
+  CPPUNIT_TEST_SUITE_REGISTRATION(RecoveryTest);
+  CPPUNIT_TEST_SUITE_REGISTRATION(VersionTest);
 
   CppUnit::Test* test =
     CppUnit::TestFactoryRegistry::getRegistry().makeTest();